@@ -1,10 +1,21 @@
 #pragma once
+#include <filesystem>
+
 #include "PICA/shader.hpp"
+#include "logger.hpp"
 
 #if defined(PANDA3DS_DYNAPICA_SUPPORTED) && (defined(PANDA3DS_X64_HOST) || defined(PANDA3DS_ARM64_HOST))
 #define PANDA3DS_SHADER_JIT_SUPPORTED
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #ifdef PANDA3DS_X64_HOST
 #include "shader_rec_emitter_x64.hpp"
@@ -14,29 +25,121 @@
 #endif
 
 class ShaderJIT {
+  public:
+	struct Stats {
+		u32 interpretedDraws = 0;  // Draws that had to run on the interpreter because their shader was still being compiled
+		u32 compiledShaders = 0;   // Shaders that finished compiling in the background
+		u32 cacheHits = 0;
+		u32 cacheMisses = 0;
+		u32 evictions = 0;   // Shaders evicted from the cache to stay under the size limit
+		usize codeBytes = 0;  // Executable memory held by the cache at the end of the frame
+	};
+
+  private:
+	Stats frameStats;
+	Stats lastFrameStats;
+	MAKE_LOG_FUNCTION(log, shaderJITLogger)
+
 #ifdef PANDA3DS_SHADER_JIT_SUPPORTED
 	using Hash = PICAShader::Hash;
-	using ShaderCache = std::unordered_map<Hash, std::unique_ptr<ShaderEmitter>>;
+	struct CacheEntry {
+		std::unique_ptr<ShaderEmitter> emitter;
+		u64 lastUsedFrame;
+	};
+
+	using ShaderCache = std::unordered_map<Hash, CacheEntry>;
 	ShaderEmitter::PrologueCallback prologueCallback;
 	ShaderEmitter::InstructionCallback entrypointCallback;
 
 	ShaderCache cache;
+	u64 currentFrame = 0;
+	usize codeBytes = 0;  // Executable memory held by the emitters in the cache
+
+	// Once the cache holds more than "cacheLimit" shaders (0 = unlimited), the least recently used ones that haven't been used
+	// for "evictionAge" frames get evicted at the end of the frame. Their code buffers are kept around to compile new shaders into
+	static constexpr u64 evictionAge = 60;
+	static constexpr usize maxSpareEmitters = 8;
+	u32 cacheLimit = 0;
+	std::vector<std::unique_ptr<ShaderEmitter>> spareEmitters;  // Protected by compilerMutex, as the compiler thread takes from it too
+
+	// Uniform specialization: Shaders get compiled with the values of the bool and int uniforms they branch or loop on baked in,
+	// and these values become part of the cache key. Which uniforms a program uses is found once per program and cached
+	struct UniformUsage {
+		u32 boolMask = 0;  // Bool uniforms read by IFU, CALLU or JMPU
+		u32 intMask = 0;   // Int uniforms read by LOOP
+	};
+
+	bool specializeUniforms = false;
+	std::unordered_map<Hash, UniformUsage> uniformUsage;  // Keyed by program hash
+
+	// Background compilation: On a cache miss, a snapshot of the shader unit is queued to the compiler thread and the draw runs on the
+	// interpreter. Finished shaders are moved into the cache the next time prepare is called
+	struct CompileJob {
+		Hash hash;
+		std::unique_ptr<PICAShader> shader;
+		bool specializeUniforms;
+	};
+
+	bool backgroundCompilation = false;
+	bool stopCompiler = false;
+	std::thread compilerThread;
+	std::mutex compilerMutex;
+	std::condition_variable compilerWakeup;
+	std::deque<CompileJob> compileQueue;
+	std::vector<std::pair<Hash, std::unique_ptr<ShaderEmitter>>> finishedShaders;  // Compiled, but not in the cache yet
+	std::unordered_set<Hash> pendingShaders;                                        // Queued or being compiled
+
+	// Every program compiled for the current title gets appended to a cache file, which is used to precompile them on the next launch
+	// Programs are keyed by their code and operand descriptors, as a compiled shader covers every possible entrypoint
+	std::optional<std::filesystem::path> diskCachePath;
+	std::unordered_set<Hash> recordedShaders;  // Programs that are already in the cache file
+
+	// Get the cache key for the shader unit's current program, and uniforms if specializing
+	Hash getShaderHash(PICAShader& shaderUnit);
+	static UniformUsage scanUniformUsage(const PICAShader& shaderUnit);
+
+	void compilerLoop();
+	void collectFinishedShaders();
+	void insertShader(Hash hash, std::unique_ptr<ShaderEmitter> emitter);
+	void evictShaders();
+	// Get an emitter to compile a shader into, reusing the code buffer of an evicted shader if there's one
+	std::unique_ptr<ShaderEmitter> allocateEmitter();
+	void recordShader(Hash hash, const PICAShader& shaderUnit);
+	void setActiveShader(ShaderEmitter* emitter, u32 entrypoint) {
+		entrypointCallback = emitter->getInstructionCallback(entrypoint);
+		prologueCallback = emitter->getPrologueCallback();
+	}
 #endif
 
   public:
 #ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+	~ShaderJIT();
+
 	// Call this before starting to process a batch of vertices
 	// This will read the PICA config (uploaded shader and shader operand descriptors) and search if we've already compiled this shader
 	// If yes, it sets it as the active shader. if not, then it compiles it, adds it to the cache, and sets it as active,
 	// The caller must make sure the entrypoint has been properly set beforehand
-	void prepare(PICAShader& shaderUnit);
+	// With background compilation enabled, a shader that isn't in the cache gets queued for compilation instead, and this returns false
+	// The caller must then run the shader through the interpreter. Returns true if a compiled shader is active
+	bool prepare(PICAShader& shaderUnit);
 	void reset();
 	void run(PICAShader& shaderUnit) { prologueCallback(shaderUnit, entrypointCallback); }
+	void setBackgroundCompilation(bool enable);
+	void setCacheLimit(u32 limit) { cacheLimit = limit; }
+	// Only affects shaders compiled from now on. Shaders compiled the other way stay in the cache but can't be hit anymore
+	void setUniformSpecialization(bool enable) { specializeUniforms = enable; }
+	// Compile every program in the shader cache file at "path" on background threads and wait for them to finish, then keep
+	// appending newly seen programs to it. Call after reset, when loading a title
+	void loadDiskCache(const std::filesystem::path& path);
+
+	// Call once per frame to evict stale shaders, and report and reset the per-frame statistics
+	void endFrame();
 
 	static constexpr bool isAvailable() { return true; }
 #else
-	void prepare(PICAShader& shaderUnit) {
+	bool prepare(PICAShader& shaderUnit) {
 		Helpers::panic("Vertex Loader JIT: Tried to run ShaderJIT::Prepare on platform that does not support shader jit");
+		return false;
 	}
 
 	void run(PICAShader& shaderUnit) {
@@ -48,6 +151,14 @@ class ShaderJIT {
 	Callback activeShaderCallback = nullptr;
 
 	void reset() {}
+	void setBackgroundCompilation(bool enable) {}
+	void loadDiskCache(const std::filesystem::path& path) {}
+	void setCacheLimit(u32 limit) {}
+	void setUniformSpecialization(bool enable) {}
+	void endFrame() {}
 	static constexpr bool isAvailable() { return false; }
 #endif
-};
\ No newline at end of file
+
+	// Statistics of the last finished frame
+	const Stats& getFrameStats() const { return lastFrameStats; }
+};
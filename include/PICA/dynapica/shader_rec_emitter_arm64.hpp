@@ -33,6 +33,9 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 
 	u32 recompilerPC = 0;  // PC the recompiler is currently recompiling @
 	u32 loopLevel = 0;     // The current loop nesting level (0 = not in a loop)
+	// When set, the bool and int uniforms of the shader unit being compiled are baked into the code, so uniform branches and loop
+	// setup get resolved at compile time. The resulting code is only valid for those uniform values
+	bool specializeUniforms = false;
 
 	// Shows whether the loaded shader has any log2 and exp2 instructions
 	bool codeHasLog2 = false;
@@ -80,6 +83,8 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 	// Check the value of the bool uniform for instructions like ifu and callu
 	// Result is returned in the zero flag. If the comparison is true then zero == 0, else zero == 1 (Opposite of checkCmpRegister)
 	void checkBoolUniform(const PICAShader& shader, u32 instruction);
+	// Compile-time version of checkBoolUniform, for uniform specialization
+	bool getBoolUniform(const PICAShader& shader, u32 instruction) { return (shader.boolUniform >> Helpers::getBits<22, 4>(instruction)) & 1; }
 
 	// Instruction recompilation functions
 	void recADD(const PICAShader& shader, u32 instruction);
@@ -129,7 +134,9 @@ class ShaderEmitter : private oaknut::CodeBlock, public oaknut::CodeGenerator {
 	InstructionCallback getInstructionCallback(u32 pc) { return getLabelPointer<InstructionCallback>(instructionLabels.at(pc)); }
 
 	PrologueCallback getPrologueCallback() { return prologueCb; }
-	void compile(const PICAShader& shaderUnit);
+	void compile(const PICAShader& shaderUnit, bool specializeUniforms = false);
+
+	static constexpr size_t getCodeBufferSize() { return allocSize; }
 };
 
 #endif  // arm64 recompiler check
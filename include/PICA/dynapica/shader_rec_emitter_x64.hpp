@@ -35,6 +35,9 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 
 	u32 recompilerPC = 0;  // PC the recompiler is currently recompiling @
 	u32 loopLevel = 0;     // The current loop nesting level (0 = not in a loop)
+	// When set, the bool and int uniforms of the shader unit being compiled are baked into the code, so uniform branches and loop
+	// setup get resolved at compile time. The resulting code is only valid for those uniform values
+	bool specializeUniforms = false;
 
 	bool haveSSE4_1 = false;  // Shows if the CPU supports SSE4.1
 	bool haveAVX = false;     // Shows if the CPU supports AVX (NOT AVX2, NOT AVX512. Regular AVX)
@@ -78,6 +81,8 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 	// Check the value of the bool uniform for instructions like ifu and callu
 	// Result is returned in the zero flag. If the comparison is true then zero == 0, else zero == 1 (Opposite of checkCmpRegister)
 	void checkBoolUniform(const PICAShader& shader, u32 instruction);
+	// Compile-time version of checkBoolUniform, for uniform specialization
+	bool getBoolUniform(const PICAShader& shader, u32 instruction) { return (shader.boolUniform >> Helpers::getBits<22, 4>(instruction)) & 1; }
 
 	// Prints a log. This is not meant to be used outside of debugging so it is very slow with our internal ABI.
 	void emitPrintLog(const PICAShader& shaderUnit);
@@ -137,7 +142,18 @@ class ShaderEmitter : public Xbyak::CodeGenerator {
 		}
 	}
 
-	void compile(const PICAShader& shaderUnit);
+	void compile(const PICAShader& shaderUnit, bool specializeUniforms = false);
+
+	// Rewind the emitter so that a different shader can be compiled into the same code buffer. This also invalidates all labels
+	void reset() {
+		Xbyak::CodeGenerator::reset();
+		returnPCs.clear();
+		codeHasLog2 = false;
+		codeHasExp2 = false;
+		prologueCb = nullptr;
+	}
+
+	static constexpr size_t getCodeBufferSize() { return allocSize; }
 
 	// PC must be a valid entrypoint here. It doesn't have that much overhead in this case, so we use std::array<>::at() to assert it does
 	InstructionCallback getInstructionCallback(u32 pc) {
@@ -0,0 +1,38 @@
+#pragma once
+
+// Only do anything if we're on an x64 target with JIT support enabled
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include "PICA/dynapica/vertex_loader_rec.hpp"
+#include "helpers.hpp"
+#include "x64_regs.hpp"
+#include "xbyak/xbyak.h"
+#include "xbyak/xbyak_util.h"
+
+class VertexLoaderEmitter : public Xbyak::CodeGenerator {
+	// Even 16 attributes with 4 components each fit in here with plenty of space to spare
+	static constexpr size_t executableMemorySize = 0x1000;
+	// Allocate some extra space as padding for security purposes in the extremely unlikely occasion we manage to overflow the above size
+	static constexpr size_t allocSize = executableMemorySize + 0x1000;
+
+	using Layout = VertexLoaderJIT::Layout;
+	using AttributeFetch = VertexLoaderJIT::AttributeFetch;
+
+	bool haveSSE4_1 = false;  // Shows if the CPU supports SSE4.1, for pmovsx/pmovzx
+	Xbyak::util::Cpu cpuCaps;
+
+	VertexLoaderJIT::Callback callback = nullptr;
+
+	// Emit code that fetches a single attribute of the vertex whose index is in the index register
+	void emitFetch(const AttributeFetch& fetch);
+
+  public:
+	VertexLoaderEmitter() : Xbyak::CodeGenerator(allocSize) {
+		cpuCaps = Xbyak::util::Cpu();
+		haveSSE4_1 = cpuCaps.has(Xbyak::util::Cpu::tSSE41);
+	}
+
+	void compile(const Layout& layout);
+	VertexLoaderJIT::Callback getCallback() { return callback; }
+};
+
+#endif  // x64 recompiler check
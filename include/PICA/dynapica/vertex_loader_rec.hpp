@@ -1,28 +1,106 @@
 #pragma once
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+#include "PICA/float_types.hpp"
+#include "PICA/pica_hash.hpp"
 #include "helpers.hpp"
-#include "renderer_gl/renderer_gl.hpp"
-#include "x64_regs.hpp"
 
-// Recompiler that takes the current vertex attribute configuration, ie the format of vertices (VAO in OpenGL) and emits optimized
-// code in our CPU's native architecture for loading vertices. Unimplemented at the moment, we've only got a skeleton of it here for later
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#define PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+#endif
 
+class VertexLoaderEmitter;
+
+// Recompiler that takes the current vertex attribute configuration, ie the format of vertices (VAO in OpenGL) and emits optimized
+// code in our CPU's native architecture for fetching vertices, converting them to f24 and writing them to the vertex shader input registers
+// Compiled loaders are cached by a hash of the attribute format registers. On hosts where we can't JIT, the decoded layout is instead
+// run through fetch functions specialized for every attribute type and component count
 class VertexLoaderJIT {
-	using PICARegs = const std::array<u32, 0x300>&;
-	using Callback = void(*)(Vertex* output, size_t count);  // A function pointer to JIT-emitted code
-	Callback compileConfig(PICARegs regs);
+  public:
+	using vec4f = std::array<Floats::f24, 4>;
+	using InputRegisters = std::array<vec4f, 16>;  // Vertex shader input registers of a single vertex
+	static constexpr u32 maxAttribCount = 12;
 
-public:
-#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
-	#define PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+	// The attribute format registers, which are everything that decides what a loader does
+	struct Config {
+		u64 vertexCfg;     // GPUREG_ATTRIBBUFFERS_FORMAT_LOW | (GPUREG_ATTRIBBUFFERS_FORMAT_HIGH << 32)
+		u64 inputAttrCfg;  // Attribute -> shader input register permutation (GPUREG_VSH_ATTRIBUTES_PERMUTATION)
+		u32 totalAttribCount;
+		u32 fixedAttribMask;
+		std::array<u64, maxAttribCount> bufferConfigs;  // config1 | (config2 << 32) for every attribute buffer
 
-	void loadVertices(Vertex* output, size_t count, PICARegs regs);
-	static constexpr bool isAvailable() { return true; }
+		bool operator==(const Config& other) const = default;
+	};
 
-#else
-	void loadVertices(Vertex* output, size_t count, PICARegs regs) {
-		Helpers::panic("Vertex Loader JIT: Tried to load vertices with JIT on platform that does not support vertex loader jit");
+	// Per-draw arguments for the active loader
+	struct Context {
+		std::array<const u8*, maxAttribCount> buffers;  // Host pointer to the first vertex of every attribute buffer the loader reads
+		const vec4f* fixedAttributes;
+	};
+
+	// Fetches "count" vertices, with indices taken from "indices", and writes their inputs to output[0, count)
+	using Callback = void (*)(const Context& context, const u32* indices, u32 count, InputRegisters* output);
+
+	// One step of loading a vertex: Either fetch & convert an attribute from a buffer, or copy a fixed attribute
+	struct AttributeFetch {
+		enum class Type : u8 { S8 = 0, U8 = 1, S16 = 2, Float = 3, Fixed = 4 };
+
+		Type type;
+		u8 componentCount;  // Number of components read from memory, the rest are filled with (0, 0, 0, 1)
+		u8 inputRegister;   // Shader input register the attribute goes to
+		u8 source;          // Attribute buffer to read from, or fixed attribute index for fixed attributes
+		u32 offset;         // Offset of the attribute from the start of the vertex
+	};
+
+	struct Layout {
+		std::array<AttributeFetch, 16> fetches;
+		u32 fetchCount = 0;
+
+		std::array<u32, maxAttribCount> strides{};       // Bytes between consecutive vertices in each buffer
+		std::array<u32, maxAttribCount> vertexSizes{};   // Bytes actually read from each vertex of each buffer. 0 if a buffer is unused
+	};
+
+  private:
+	struct Loader {
+		Config config;
+		Layout layout;
+		Callback callback = nullptr;
+
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+		std::unique_ptr<VertexLoaderEmitter> emitter;
+#endif
+	};
+
+	using Hash = PICAHash::HashType;
+	std::unordered_map<Hash, std::unique_ptr<Loader>> cache;
+	Loader* activeLoader = nullptr;
+
+	static Layout decodeLayout(const Config& config);
+	static void interpretLayout(const Layout& layout, const Context& context, const u32* indices, u32 count, InputRegisters* output);
+
+  public:
+	VertexLoaderJIT();
+	~VertexLoaderJIT();
+
+	// Call this before loading the vertices of a draw. Finds the loader for this attribute configuration, or compiles it if there's none
+	void prepare(const Config& config);
+	void reset();
+
+	const Layout& getLayout() const { return activeLoader->layout; }
+
+	void load(const Context& context, const u32* indices, u32 count, InputRegisters* output) {
+		if (activeLoader->callback != nullptr) {
+			activeLoader->callback(context, indices, count, output);
+		} else {
+			interpretLayout(activeLoader->layout, context, indices, count, output);
+		}
 	}
 
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+	static constexpr bool isAvailable() { return true; }
+#else
 	static constexpr bool isAvailable() { return false; }
 #endif
-};
\ No newline at end of file
+};
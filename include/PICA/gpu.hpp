@@ -1,10 +1,13 @@
 #pragma once
 #include <array>
+#include <utility>
 
 #include "PICA/dynapica/shader_rec.hpp"
+#include "PICA/dynapica/vertex_loader_rec.hpp"
 #include "PICA/float_types.hpp"
 #include "PICA/pica_vertex.hpp"
 #include "PICA/regs.hpp"
+#include "PICA/shader_batch.hpp"
 #include "PICA/shader_unit.hpp"
 #include "compiler_builtins.hpp"
 #include "config.hpp"
@@ -12,6 +15,7 @@
 #include "logger.hpp"
 #include "memory.hpp"
 #include "renderer.hpp"
+#include "thread_pool.hpp"
 
 class GPU {
 	static constexpr u32 regNum = 0x300;
@@ -25,6 +29,20 @@ class GPU {
 	EmulatorConfig& config;
 	ShaderUnit shaderUnit;
 	ShaderJIT shaderJIT;  // Doesn't do anything if JIT is disabled or not supported
+	PICAShaderBatch shaderBatch{shaderUnit.vs};  // Runs the vertex shader on several vertices at once when the JIT is off
+	VertexLoaderJIT vertexLoader;  // Fetches vertex attributes into shader input registers
+	// Set when one of the registers that decide the vertex attribute layout is written to. The loader is then looked up again on the next draw
+	bool vertexLoaderDirty = true;
+
+	// Draws with at least this many vertices to shade get split across the vertex thread pool
+	static constexpr u32 parallelVertexThreshold = 1024;
+	// Vertex shader state for every thread of the pool except the calling one, which uses shaderUnit.vs and shaderBatch
+	struct VertexWorker {
+		std::unique_ptr<PICAShader> shader;
+		std::unique_ptr<PICAShaderBatch> batch;
+	};
+	ThreadPool vertexThreadPool{0, 4};
+	std::vector<VertexWorker> vertexWorkers;
 
 	u8* vram = nullptr;
 	MAKE_LOG_FUNCTION(log, gpuLogger)
@@ -32,13 +50,14 @@ class GPU {
 	static constexpr u32 maxAttribCount = 12;  // Up to 12 vertex attributes
 	static constexpr u32 vramSize = u32(6_MB);
 	Registers regs;                           // GPU internal registers
-	std::array<vec4f, 16> currentAttributes;  // Vertex attributes before being passed to the shader
 
 	std::array<vec4f, 16> immediateModeAttributes;  // Vertex attributes uploaded via immediate mode submission
 	std::array<PICA::Vertex, 3> immediateModeVertices;
 
 	// Pointers for the output registers as arranged after GPUREG_VSH_OUTMAP_MASK is applied
 	std::array<Floats::f24*, 16> vsOutputRegisters;
+	// Same as above, but as register indices, for reading outputs back from the batched shader interpreter
+	std::array<u8, 16> vsOutputIndices;
 	// Previous value for GPUREG_VSH_OUTMAP_MASK
 	u32 oldVsOutputMask;
 
@@ -48,6 +67,13 @@ class GPU {
 	template <bool indexed, bool useShaderJIT>
 	void drawArrays();
 
+	void updateVertexLoader();
+
+	template <bool useShaderJIT>
+	void shadeVertices(
+		PICAShader& shader, PICAShaderBatch& batch, const VertexLoaderJIT::Context& context, const u32* indices, PICA::Vertex* output, u32 count
+	);
+
 	// Silly method of avoiding linking problems. TODO: Change to something less silly
 	void drawArrays(bool indexed);
 
@@ -92,8 +118,23 @@ class GPU {
 	// Set to false by the renderer when the lighting_lut is uploaded ot the GPU
 	bool lightingLUTDirty = false;
 
+	// PICA::RegGroup flags of the register groups that changed since the renderer last consumed them
+	u32 dirtyRegGroups = PICA::RegGroup::All;
+	u32 consumeDirtyRegGroups() { return std::exchange(dirtyRegGroups, 0); }
+
 	GPU(Memory& mem, EmulatorConfig& config);
-	void display() { renderer->display(); }
+	void display() {
+		renderer->display();
+		shaderJIT.endFrame();
+	}
+
+	// Precompile the shaders recorded in the given shader cache file and record newly seen shaders to it
+	void loadShaderCache(const std::filesystem::path& path) {
+		if (ShaderJIT::isAvailable() && config.shaderJitEnabled) {
+			shaderJIT.loadDiskCache(path);
+		}
+	}
+	bool supportsGPUThread() const { return renderer->supportsGPUThread(); }
 	void screenshot(const std::string& name) { renderer->screenshot(name); }
 	void deinitGraphicsContext() { renderer->deinitGraphicsContext(); }
 
@@ -108,7 +149,9 @@ class GPU {
 
 	Registers& getRegisters() { return regs; }
 	ExternalRegisters& getExtRegisters() { return externalRegs; }
-	void startCommandList(u32 addr, u32 size);
+	// Run the command list at host pointer "buffer". The GSP looks it up from the guest's virtual address, as that's only safe on the
+	// emulation thread
+	void startCommandList(u32* buffer, u32 size);
 
 	// Used by the GSP GPU service for readHwRegs/writeHwRegs/writeHwRegsMasked
 	u32 readReg(u32 address);
@@ -142,33 +185,23 @@ class GPU {
 	// This is necessary because vertex attribute fetching uses physical addresses
 	template <typename T>
 	T readPhysical(u32 paddr) {
-		if (paddr >= PhysicalAddrs::FCRAM && paddr <= PhysicalAddrs::FCRAMEnd) {
-			u8* fcram = mem.getFCRAM();
-			u32 index = paddr - PhysicalAddrs::FCRAM;
-
-			return *(T*)&fcram[index];
-		} else {
-			Helpers::panic("[PICA] Read unimplemented paddr %08X", paddr);
-		}
+		return *getPointerPhys<T>(paddr);
 	}
 
 	// Get a pointer of type T* to the data starting from physical address paddr
+	// If size is non-zero, the whole [paddr, paddr + size) range is checked to be backed by contiguous memory, otherwise only the first element
 	template <typename T>
 	T* getPointerPhys(u32 paddr, u32 size = 0) {
-		if (paddr >= PhysicalAddrs::FCRAM && paddr + size <= PhysicalAddrs::FCRAMEnd) {
-			u8* fcram = mem.getFCRAM();
-			u32 index = paddr - PhysicalAddrs::FCRAM;
-
-			return (T*)&fcram[index];
-		} else if (paddr >= PhysicalAddrs::VRAM && paddr + size <= PhysicalAddrs::VRAMEnd) {
-			u32 index = paddr - PhysicalAddrs::VRAM;
-			return (T*)&vram[index];
-		} else [[unlikely]] {
+		const std::span<u8> span = mem.getPhysSpan(paddr, (size != 0) ? size : u32(sizeof(T)));
+
+		if (span.empty()) [[unlikely]] {
 			Helpers::panic("[GPU] Tried to access unknown physical address: %08X", paddr);
 		}
+		return (T*)span.data();
 	}
 
 	Renderer* getRenderer() { return renderer.get(); }
+	Memory& getMemory() { return mem; }
   private:
 	// GPU external registers
 	// We have them in the end of the struct for cache locality reasons. Tl;dr we want the more commonly used things to be packed in the start
@@ -186,6 +219,7 @@ class GPU {
 			// See which registers are actually enabled and ignore the disabled ones
 			for (int i = 0; i < 16; i++) {
 				if (val & 1) {
+					vsOutputIndices[count] = i;
 					vsOutputRegisters[count++] = &shaderUnit.vs.outputs[i][0];
 				}
 
@@ -194,6 +228,7 @@ class GPU {
 
 			// For the others, map the index to a vs output directly (TODO: What does hw actually do?)
 			for (; count < 16; count++) {
+				vsOutputIndices[count] = count;
 				vsOutputRegisters[count] = &shaderUnit.vs.outputs[count][0];
 			}
 		}
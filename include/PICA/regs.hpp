@@ -180,6 +180,43 @@ namespace PICA {
 		};
 	}
 
+	// Functional groups of the rasterizer, texturing, framebuffer and lighting registers ([0x40, 0x200)), which renderers derive their
+	// state from. The GPU marks a group as dirty whenever one of its registers changes, so renderers only rebuild the state that changed
+	namespace RegGroup {
+		enum : u32 {
+			Viewport = 1 << 0,     // Rasterizer registers: Viewport, clipping, depth mapping, shader output mapping
+			TexUnit0 = 1 << 1,
+			TexUnit1 = 1 << 2,
+			TexUnit2 = 1 << 3,
+			TexUnit3 = 1 << 4,     // Procedural texture unit
+			TexEnv = 1 << 5,       // Texture combiners, combiner buffer and fog
+			Blending = 1 << 6,     // Colour operation, blending, logic ops and alpha test
+			Depth = 1 << 7,        // Depth and stencil test, colour mask
+			Framebuffer = 1 << 8,  // Colour and depth buffer configuration
+			Lighting = 1 << 9,
+
+			TexUnits = TexUnit0 | TexUnit1 | TexUnit2 | TexUnit3,
+			All = (1 << 10) - 1,
+		};
+
+		// Returns the groups that a change to internal register "index" affects
+		constexpr u32 fromRegister(u32 index) {
+			if (index < 0x40 || index >= 0x200) return 0;
+			if (index < 0x80) return Viewport;
+			if (index == InternalRegs::TexUnitCfg) return TexUnits;  // Enables all texture units
+			if (index < 0x90) return TexUnit0;
+			if (index < 0x98) return TexUnit1;
+			if (index < 0xA0) return TexUnit2;
+			if (index < 0xC0) return TexUnit3;
+			if (index < 0x100) return TexEnv;
+			if (index < 0x105) return Blending;
+			if (index < 0x110) return Depth;
+			if (index == InternalRegs::DepthBufferWrite) return Depth | Framebuffer;
+			if (index < 0x140) return Framebuffer;
+			return Lighting;
+		}
+	}  // namespace RegGroup
+
 	namespace ExternalRegs {
 		enum : u32 {
 			MemFill1BufferStartPaddr = 0x3,
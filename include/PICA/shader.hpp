@@ -130,6 +130,7 @@ class PICAShader {
 	// Add these as friend classes for the JIT so it has access to all important state
 	friend class ShaderJIT;
 	friend class ShaderEmitter;
+	friend class PICAShaderBatch;
 
 	vec4f getSource(u32 source);
 	vec4f& getDest(u32 dest);
@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+
+#include "PICA/shader.hpp"
+
+// Vertex shader interpreter that runs the same program over several vertices at once
+// Registers are stored in structure-of-arrays form (One float per vertex for every register component), so every instruction
+// is a handful of loops over the lanes, which the compiler turns into SSE/AVX/NEON code
+// Uniform control flow (IFU, CALLU, LOOP, ...) is shared by all lanes, while conditional control flow (IFC, CALLC) that diverges
+// between lanes is handled by executing both paths with per-lane masks. Divergence that can't be expressed that way
+// (eg a JMPC that only some lanes take) makes us re-run the batch one vertex at a time on the scalar interpreter
+class PICAShaderBatch {
+  public:
+	static constexpr usize laneCount = 8;
+
+  private:
+	using f24 = Floats::f24;
+	using vec4f = std::array<f24, 4>;
+	using LaneMask = u32;  // Bit i is set if lane i is active
+
+	struct alignas(32) Lanes {
+		std::array<float, laneCount> v;
+		float& operator[](usize lane) { return v[lane]; }
+		const float& operator[](usize lane) const { return v[lane]; }
+	};
+
+	// A vec4 register for every lane. reg[component][lane]
+	using Register = std::array<Lanes, 4>;
+
+	struct ConditionalInfo {
+		u32 endingPC;        // PC at the end of the current block
+		u32 newPC;           // PC after the whole if/else is done executing
+		LaneMask restoreMask;  // Lanes to re-enable once the if/else is done
+		LaneMask elseMask;     // Lanes that still need to execute the else block, if the condition diverged
+	};
+
+	struct CallInfo {
+		u32 endingPC;
+		u32 returnPC;
+		LaneMask restoreMask;
+	};
+
+	PICAShader& shader;
+
+	std::array<Register, 16> inputs;
+	std::array<Register, 16> outputs;
+	std::array<Register, 16> tempRegisters;
+	std::array<std::array<s32, laneCount>, 2> addrRegister;
+	std::array<std::array<bool, laneCount>, 2> cmpRegister;
+	u32 loopCounter;
+
+	u32 pc;
+	LaneMask activeMask;
+	LaneMask allLanes;
+
+	u32 loopIndex, ifIndex, callIndex;
+	std::array<PICAShader::Loop, 4> loopInfo;
+	std::array<ConditionalInfo, 8> conditionalInfo;
+	std::array<CallInfo, 4> callInfo;
+
+	// Run the batch on the SIMD path. Returns false if the lanes diverged in a way we can't handle
+	bool runSIMD();
+	// Run every lane through the scalar interpreter
+	void runScalar(u32 count);
+
+	void fetchSource(Register& out, u32 source, u32 index);
+	template <int sourceIndex>
+	void getSourceSwizzled(Register& out, u32 source, u32 index, u32 opDescriptor);
+	Register& getDest(u32 dest);
+	void writeDest(Register& dest, const Register& value, u32 componentMask);
+	LaneMask getConditionMask(u32 instruction);
+
+	void arithmetic(u32 instruction, u32 opcode);
+	void mad(u32 instruction, bool inverted);
+	void cmp(u32 instruction);
+	void mova(u32 instruction);
+	void call(u32 instruction, LaneMask mask);
+	void ifBlock(u32 instruction, LaneMask mask);
+	void loop(u32 instruction);
+
+  public:
+	explicit PICAShaderBatch(PICAShader& shader) : shader(shader) {}
+
+	void setInput(u32 lane, u32 reg, const vec4f& value) {
+		for (int i = 0; i < 4; i++) {
+			inputs[reg][i][lane] = value[i].toFloat32();
+		}
+	}
+
+	vec4f getOutput(u32 lane, u32 reg) const {
+		const Register& out = outputs[reg];
+		return {f24::fromFloat32(out[0][lane]), f24::fromFloat32(out[1][lane]), f24::fromFloat32(out[2][lane]), f24::fromFloat32(out[3][lane])};
+	}
+
+	// Runs the loaded vertex shader for lanes [0, count), where 1 <= count <= laneCount
+	void run(u32 count);
+};
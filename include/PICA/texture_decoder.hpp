@@ -0,0 +1,21 @@
+#pragma once
+#include <span>
+#include <vector>
+
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+// Texture decoding shared by all renderers. PICA textures are stored as 8x8 tiles with their texels in Morton order, so whole
+// textures are decoded a tile at a time by converters specialized for every format, instead of looking up every texel separately
+// Decoded texels are in ABGR8888 format (ie RGBA8 in memory), and row v = 0 is the first row of the texture in memory
+namespace PICA::TextureDecoder {
+	// Size in bytes of a width x height texture in emulated memory
+	u64 sizeInBytes(TextureFmt format, u32 width, u32 height);
+
+	// Decode a whole texture into "output" in row-major order. The output buffer is resized to fit the texture, so callers can
+	// keep one around as scratch space and reuse it across textures to avoid allocating on every upload
+	void decodeTexture(TextureFmt format, u32 width, u32 height, std::span<const u8> data, std::vector<u32>& output);
+
+	// Decode the texel at (u, v), for renderers that sample textures straight from emulated memory
+	u32 decodeTexel(TextureFmt format, u32 u, u32 v, u32 width, std::span<const u8> data);
+}  // namespace PICA::TextureDecoder
@@ -34,12 +34,20 @@ namespace Audio {
 		Samples sampleBuffer;
 		bool audioEnabled = false;
 
+		// Scheduler event for running one audio frame, and the handle of the pending one
+		Scheduler::EventType runDSPEvent;
+		Scheduler::EventHandle runDSPHandle;
+
+		void scheduleAudioFrame(u64 cycles) { runDSPHandle = scheduler.schedule(runDSPEvent, scheduler.currentTimestamp + cycles); }
+		void cancelAudioFrame() { scheduler.cancel(runDSPHandle); }
+
 		MAKE_LOG_FUNCTION(log, dspLogger)
 
 	  public:
 		enum class Type { Null, Teakra, HLE };
-		DSPCore(Memory& mem, Scheduler& scheduler, DSPService& dspService)
-			: mem(mem), scheduler(scheduler), dspService(dspService) {}
+		DSPCore(Memory& mem, Scheduler& scheduler, DSPService& dspService) : mem(mem), scheduler(scheduler), dspService(dspService) {
+			runDSPEvent = scheduler.registerEventType("RunDSP", [this](u64 userdata, u64 cyclesLate) { runAudioFrame(); });
+		}
 		virtual ~DSPCore() {}
 
 		virtual void reset() = 0;
@@ -153,18 +153,13 @@ namespace Audio {
 		// Get a pointer of type T* to the data starting from physical address paddr
 		template <typename T>
 		T* getPointerPhys(u32 paddr, u32 size = 0) {
-			if (paddr >= PhysicalAddrs::FCRAM && paddr + size <= PhysicalAddrs::FCRAMEnd) {
-				u8* fcram = mem.getFCRAM();
-				u32 index = paddr - PhysicalAddrs::FCRAM;
-
-				return (T*)&fcram[index];
-			} else if (paddr >= PhysicalAddrs::DSP_RAM && paddr + size <= PhysicalAddrs::DSP_RAM_End) {
-				u32 index = paddr - PhysicalAddrs::DSP_RAM;
-				return (T*)&dspRam.rawMemory[index];
-			} else [[unlikely]] {
+			const std::span<u8> span = mem.getPhysSpan(paddr, (size != 0) ? size : u32(sizeof(T)));
+
+			if (span.empty()) [[unlikely]] {
 				Helpers::warn("[DSP] Tried to access unknown physical address: %08X", paddr);
 				return nullptr;
 			}
+			return (T*)span.data();
 		}
 
 		void handleAACRequest(const AAC::Message& request);
@@ -85,7 +85,7 @@ namespace Audio {
 		// Run 1 slice of DSP instructions and schedule the next audio frame
 		void runAudioFrame() override {
 			runSlice();
-			scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::lleSlice * 2);
+			scheduleAudioFrame(Audio::lleSlice * 2);
 		}
 
 		void setAudioEnabled(bool enable) override;
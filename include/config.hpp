@@ -14,7 +14,17 @@ struct EmulatorConfig {
 #endif
 
 	bool shaderJitEnabled = shaderJitDefault;
+	// Compile shaders on a background thread and run draws on the interpreter until they're ready, instead of stalling on compilation
+	bool shaderJitBackgroundCompilation = true;
+	// Max number of compiled shaders to keep around, each of which holds ~400KB of executable memory. 0 means unlimited
+	u32 shaderJitCacheLimit = 256;
+	// Bake the bool and int uniforms that a shader branches and loops on into its compiled code, compiling one variant per set of values
+	bool shaderJitUniformSpecialization = true;
 	bool discordRpcEnabled = false;
+	// Back guest memory with a host virtual memory arena, letting the CPU JIT access guest RAM directly (fastmem)
+	bool hostMemoryEnabled = false;
+	// Execute GSP commands on a dedicated GPU thread that runs alongside the emulated CPU. Only used with renderers that support it
+	bool gpuThreadEnabled = false;
 	RendererType rendererType = RendererType::OpenGL;
 	Audio::DSPCore::Type dspType = Audio::DSPCore::Type::Null;
 
@@ -40,17 +40,21 @@ enum class ROMType {
 
 class Emulator {
 	EmulatorConfig config;
+	Scheduler scheduler;
+	// Memory must be constructed before the CPU, as the CPU JIT is handed the memory's page table on construction
+	Memory memory;
 	CPU cpu;
 	GPU gpu;
-	Memory memory;
 	Kernel kernel;
 	std::unique_ptr<Audio::DSPCore> dsp;
-	Scheduler scheduler;
 
 	Crypto::AESEngine aesEngine;
 	MiniAudioDevice audioDevice;
 	Cheats cheats;
 
+	// Scheduler event for the end of a frame
+	Scheduler::EventType vblankEvent;
+
   public:
 	static constexpr u32 width = 400;
 	static constexpr u32 height = 240 * 2;  // * 2 because 2 screens
@@ -128,6 +132,7 @@ class Emulator {
 	RendererType getRendererType() const { return config.rendererType; }
 	Renderer* getRenderer() { return gpu.getRenderer(); }
 	u64 getTicks() { return cpu.getTicks(); }
+	const Kernel::IdleSkipStats& getIdleSkipStats() { return kernel.getIdleSkipStats(); }
 
 	std::filesystem::path getConfigPath();
 	std::filesystem::path getAndroidAppPath();
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+
+#include "helpers.hpp"
+
+// Backs the guest address space with host virtual memory.
+// All guest RAM (FCRAM & VRAM) lives in a single shared memory object, which can be mapped into a 4GB host reservation
+// as many times as we want. This way every alias of a physical page (linear heap, shared memory, mirrors) is a real host
+// mapping of the same memory, and a guest virtual address is just an offset from the start of the reservation.
+// Only supported on 64-bit Linux/Android hosts for now. On other hosts, isValid() returns false and Memory falls back to
+// its plain heap-allocated FCRAM.
+class HostMemory {
+	int fd = -1;
+	u8* backing = nullptr;  // Contiguous view of the whole backing memory, indexed by physical offset
+	u8* arena = nullptr;    // Start of the 4GB reservation the guest virtual address space is mapped into
+	usize backingSize = 0;
+
+  public:
+	static constexpr u64 arenaSize = 1ull << 32;
+
+	HostMemory(usize backingSize);
+	~HostMemory();
+
+	bool isValid() const { return arena != nullptr; }
+	u8* getBackingMemory() { return backing; }
+	u8* getArena() { return arena; }
+
+	// Map "size" bytes of backing memory starting at "backingOffset" to guest virtual address "vaddr".
+	// If neither read nor write permissions are requested, the range gets unmapped instead
+	void map(u32 vaddr, usize backingOffset, u32 size, bool read, bool write);
+	// Unmap "size" bytes starting at guest virtual address "vaddr". Accessing them will fault from now on
+	void unmap(u32 vaddr, u32 size);
+	// Unmap the whole guest virtual address space in one go
+	void reset();
+};
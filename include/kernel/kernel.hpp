@@ -2,6 +2,7 @@
 #include <array>
 #include <cassert>
 #include <limits>
+#include <queue>
 #include <span>
 #include <string>
 #include <vector>
@@ -36,11 +37,29 @@ class Kernel {
 	std::vector<KernelObject> objects;
 	std::vector<Handle> portHandles;
 	std::vector<Handle> mutexHandles;
-	std::vector<Handle> timerHandles;
 
-	// Thread indices, sorted by priority
+	// Indices of all the threads that have been created and are not dead yet, including the idle thread
 	std::vector<int> threadIndices;
 
+	// Ready queue, containing every thread that is able to run (ie its status is Ready or Running), except for the idle thread.
+	// For each priority level we keep a bitmask of the indices of the runnable threads with that priority, plus a bitmap of
+	// which priority levels have at least one runnable thread. This way picking the next thread is just 2 bit scans
+	std::array<u64, 64> readyThreads;
+	u64 readyPriorities;
+	static_assert(appResourceLimits.maxThreads <= 64, "The ready queue keeps thread indices in 64-bit bitmasks");
+
+	// Min-heap of (wakeup tick, thread index) pairs for threads that are sleeping or waiting with a timeout.
+	// The earliest wakeup is registered with the scheduler as a ThreadWakeup event.
+	// Entries aren't removed when a thread is woken up early. Instead, we skip stale entries when we pop them
+	using WakeupEntry = std::pair<u64, int>;
+	std::priority_queue<WakeupEntry, std::vector<WakeupEntry>, std::greater<WakeupEntry>> wakeupQueue;
+
+	// Scheduler event for waking up threads, along with the handle of the pending one
+	Scheduler::EventType wakeupEvent;
+	Scheduler::EventHandle wakeupEventHandle;
+	// Scheduler event for firing timers. Each running timer has its own pending event, with the timer handle as user data
+	Scheduler::EventType timerEvent;
+
 	Handle currentProcess;
 	Handle mainThread;
 	int currentThreadIndex;
@@ -58,6 +77,22 @@ class Kernel {
 	// Shows whether a reschedule will be need
 	bool needReschedule = false;
 
+  public:
+	// Statistics on how much emulated time we fast-forwarded through because no thread was able to run
+	struct IdleSkipStats {
+		u64 skippedCycles = 0;  // Total number of emulated cycles skipped
+		u64 skipCount = 0;      // How many times we skipped ahead to the next event
+	};
+
+  private:
+	IdleSkipStats idleSkipStats;
+	// How many times in a row the current thread has yielded via SleepThread(0) from the same PC while no other thread could run
+	// Past a certain threshold we treat this as a busy-wait loop and skip ahead to the next event, like we do for the idle thread
+	// Reschedules and non-zero sleeps mean the thread is doing something else, so they start the count over
+	u32 yieldSpinCount = 0;
+	u32 yieldSpinPC = 0;
+	static constexpr u32 maxYieldSpins = 8;
+
 	Handle makeArbiter();
 	Handle makeProcess(u32 id);
 	Handle makePort(const char* name);
@@ -73,7 +108,7 @@ public:
 	// Needs to be public to be accessible to the service manager port
 	Handle makeSemaphore(u32 initialCount, u32 maximumCount);
 	Handle makeTimer(ResetType resetType);
-	void pollTimers();
+	void fireTimer(Handle timerHandle);
 
 	// Signals an event, returns true on success or false if the event does not exist
 	bool signalEvent(Handle e);
@@ -92,16 +127,31 @@ public:
 	void sleepThread(s64 ns);
 	void sleepThreadOnArbiter(u32 waitingAddress);
 	void switchThread(int newThreadIndex);
-	void sortThreads();
 	std::optional<int> getNextThread();
 	void rescheduleThreads();
-	bool canThreadRun(const Thread& t);
+	void skipToNextEvent();
+
+	// All thread status and priority changes must go through these so that the ready & wakeup queues stay in sync
+	void setThreadStatus(Thread& t, ThreadStatus status);
+	void changeThreadPriority(Thread& t, u32 priority);
+	void addReadyThread(const Thread& t);
+	void removeReadyThread(const Thread& t);
+	void wakeupTimedOutThreads();
+	void updateWakeupEvent();
+
+	static bool isRunnable(ThreadStatus status) { return status == ThreadStatus::Ready || status == ThreadStatus::Running; }
+	static bool isTimedWait(ThreadStatus status) {
+		return status == ThreadStatus::WaitSleep || status == ThreadStatus::WaitSync1 || status == ThreadStatus::WaitSyncAny ||
+			   status == ThreadStatus::WaitSyncAll;
+	}
 	bool shouldWaitOnObject(KernelObject* object);
 	void releaseMutex(Mutex* moo);
 	void cancelTimer(Timer* timer);
 	void signalTimer(Handle timerHandle, Timer* timer);
 	u64 getWakeupTick(s64 ns);
 
+	// Returns the index of the thread with the highest priority out of all threads in the bitmask. Must not be called with an empty mask
+	int getHighestPriorityThread(u64 mask);
 	// Wake up the thread with the highest priority out of all threads in the waitlist
 	// Returns the index of the woken up thread
 	// Do not call this function with an empty waitlist!!!
@@ -201,6 +251,9 @@ public:
 	void reset();
 
 	void requireReschedule() { needReschedule = true; }
+	// Called by the scheduler when a sleeping thread or a thread waiting with a timeout is due to wake up
+	void handleThreadWakeup();
+	const IdleSkipStats& getIdleSkipStats() const { return idleSkipStats; }
 
 	void evalReschedule() {
 		if (needReschedule) {
@@ -243,6 +296,7 @@ public:
 	}
 
 	ServiceManager& getServiceManager() { return serviceManager; }
+	Scheduler& getScheduler();
 
 	void sendGPUInterrupt(GPUInterrupt type) { serviceManager.sendGPUInterrupt(type); }
 	void clearInstructionCache();
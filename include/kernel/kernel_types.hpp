@@ -5,6 +5,7 @@
 #include "handles.hpp"
 #include "helpers.hpp"
 #include "result/result.hpp"
+#include "scheduler.hpp"
 
 enum class KernelObjectType : u8 {
     AddressArbiter, Archive, Directory, File, MemoryBlock, Process, ResourceLimit, Session, Dummy,
@@ -186,6 +187,7 @@ struct Timer {
 	u64 interval;      // Number of ns until the timer fires for the second and future times
 	bool fired;        // Has this timer been signalled?
 	bool running;      // Is this timer running or stopped?
+	Scheduler::EventHandle event;  // Scheduler event for the next time this timer fires, if it's running
 
 	Timer(ResetType type) : resetType(type), fireTick(0), interval(0), waitlist(0), fired(false), running(false) {}
 };
@@ -1,15 +1,21 @@
 #pragma once
 #include <array>
 #include <bitset>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
 #include "config.hpp"
 #include "crypto/aes_engine.hpp"
 #include "handles.hpp"
 #include "helpers.hpp"
+#include "host_memory.hpp"
 #include "loader/ncsd.hpp"
 #include "loader/3dsx.hpp"
 #include "services/region_codes.hpp"
@@ -111,6 +117,15 @@ class Memory {
 
 	// Our dynarmic core uses page tables for reads and writes with 4096 byte pages
 	std::vector<uintptr_t> readTable, writeTable;
+	// Page table for the physical address space, used by the GPU, the DSP and DMA. Contains FCRAM, VRAM and DSP RAM
+	// Everything else (IO registers and unmapped holes) is 0. Physical memory never gets remapped, so this is only filled in once per region
+	std::vector<uintptr_t> physTable;
+	void mapPhysicalRegion(u32 paddr, u8* pointer, u32 size);
+	// Optional host virtual memory backend. If enabled, FCRAM and VRAM are allocated from it and every guest mapping
+	// is mirrored into its 4GB arena, which the CPU JIT can then access directly as fastmem. nullptr if disabled
+	std::unique_ptr<HostMemory> hostMemory;
+	// Mirror the mapping of a page from our page tables to the host memory arena, if the backend is enabled
+	void updateHostPage(u32 page);
 
 	// This tracks our OS' memory allocations
 	std::vector<KernelMemoryTypes::MemoryInfo> memoryInfo;
@@ -138,7 +153,79 @@ public:
 	static constexpr u32 DSP_CODE_MEMORY_OFFSET = u32(0_KB);
 	static constexpr u32 DSP_DATA_MEMORY_OFFSET = u32(256_KB);
 
+	// Page table that gets handed to the CPU JIT so that it can emit guest loads/stores as direct host memory accesses.
+	// A page only has an entry here if it's mapped as both readable and writable to the same host memory.
+	// Everything else (config memory, VRAM, read-only & unmapped pages) is nullptr and goes through our read/write callbacks
+	using PageTable = std::array<u8*, totalPageCount>;
+
 private:
+	std::unique_ptr<PageTable> jitPageTable;
+	// Refresh the JIT page table entry for a page after its read or write mapping has been changed
+	void updateJITPage(u32 page) {
+		const uintptr_t pointer = readTable[page];
+		const bool direct = pointer != 0 && pointer == writeTable[page] && !isPointerWatched(pointer) && !isPointerGPUPending(pointer);
+		(*jitPageTable)[page] = direct ? reinterpret_cast<u8*>(pointer) : nullptr;
+	}
+
+	// Write tracking for guest memory that the renderer caches, like textures. Pages are identified by their physical address and only
+	// FCRAM and VRAM pages can be watched. Watched pages are taken out of the JIT page table and write-protected in the host arena,
+	// so the first write to one of them goes through our write handlers. That write stamps the page and unwatches it, which gives it
+	// its fast path back. Anything that writes guest memory through host pointers has to call markPhysicalRangeWritten instead
+	static constexpr u32 VRAM_PAGE_COUNT = VirtualAddrs::VramSize / pageSize;
+	static constexpr u32 invalidWatchIndex = ~0u;
+
+	std::vector<u8> watchedPages;      // Indexed by watch index, which is the FCRAM page, or FCRAM_PAGE_COUNT + the VRAM page
+	std::vector<u64> pageWriteStamps;  // Value of writeStamp the last time each page was seen being written
+	std::unordered_multimap<u32, u32> fcramPageMappings;  // FCRAM page -> Virtual pages that it has been mapped as writeable to
+	u32 watchedPageCount = 0;
+	u64 writeStamp = 0;
+
+	u32 getWatchIndex(uintptr_t pointer) const;
+	u32 getPhysicalWatchIndex(u32 paddr) const;
+	bool isPointerWatched(uintptr_t pointer) const {
+		const u32 index = (watchedPageCount != 0) ? getWatchIndex(pointer) : invalidWatchIndex;
+		return index != invalidWatchIndex && watchedPages[index] != 0;
+	}
+
+	void setPageWatched(u32 index, bool watched);
+	void pageWritten(u32 index);
+	// Remember that virtual page "page" can write to the FCRAM page it's mapped to, so that it can be protected if it gets watched
+	void recordPageMapping(u32 page);
+	// Called by our write handlers with the host pointer of the page being written
+	void notifyWrite(uintptr_t pointer) {
+		if (watchedPageCount != 0) {
+			const u32 index = getWatchIndex(pointer);
+			if (index != invalidWatchIndex && watchedPages[index] != 0) {
+				pageWritten(index);
+			}
+		}
+	}
+
+	// Writes that the GPU thread has yet to do. GPU commands that write guest memory mark their destination pages as pending when they
+	// get submitted. Like watched pages, pending pages are taken out of the JIT page table, and they're also unmapped from the host arena,
+	// so that CPU reads of them go through our handlers. Those wait for the GPU thread before reading a pending page.
+	// As with watching, this only covers virtual pages that can write to the pending page, read-only aliases keep reading it directly
+	std::vector<u8> gpuPendingPages;  // Indexed by watch index, like watchedPages
+	std::vector<u32> gpuPendingIndices;
+	std::function<void()> waitForGPU;
+
+	bool isPointerGPUPending(uintptr_t pointer) const {
+		const u32 index = !gpuPendingIndices.empty() ? getWatchIndex(pointer) : invalidWatchIndex;
+		return index != invalidWatchIndex && gpuPendingPages[index] != 0;
+	}
+
+	// Refresh the fast paths of every virtual page that can write to FCRAM page "index", after it got (un)watched or marked as pending
+	void updateFCRAMPageMappings(u32 index);
+	void waitForPendingGPUWrites(u32 vaddr, usize size);
+	// Called by our read handlers before reading "size" bytes at vaddr
+	void syncPendingGPUWrites(u32 vaddr, usize size) {
+		if (!gpuPendingIndices.empty()) [[unlikely]] {
+			waitForPendingGPUWrites(vaddr, size);
+		}
+	}
+
+	std::span<u8> getContiguousSpan(const std::vector<uintptr_t>& table, u32 vaddr, u32 size);
+
 	std::bitset<FCRAM_PAGE_COUNT> usedFCRAMPages;
 	std::optional<u32> findPaddr(u32 size);
 	u64 timeSince3DSEpoch();
@@ -193,8 +280,44 @@ private:
 	void write32(u32 vaddr, u32 value);
 	void write64(u32 vaddr, u64 value);
 
+	// Bulk transfers between guest memory and the host. The range is split at page boundaries and every chunk is memcpy'd directly
+	// Pages that aren't directly mapped (eg VRAM or config memory) fall back to the 8-bit accessors, so they behave like a read8/write8 loop
+	void readBlock(u32 vaddr, void* dest, usize size);
+	void writeBlock(u32 vaddr, const void* src, usize size);
+	void copyBlock(u32 destAddr, u32 sourceAddr, usize size);
+	void fillBlock(u32 vaddr, u8 value, usize size);
+
+	// Returns a span over "size" bytes of guest memory starting at vaddr if the whole range is readable/writeable and backed by contiguous
+	// host memory, which lets callers operate on it in-place. Otherwise returns an empty span, and callers should use the block functions above
+	std::span<u8> getReadSpan(u32 vaddr, u32 size) {
+		syncPendingGPUWrites(vaddr, size);
+		return getContiguousSpan(readTable, vaddr, size);
+	}
+	std::span<u8> getWriteSpan(u32 vaddr, u32 size) { return getContiguousSpan(writeTable, vaddr, size); }
+
+	// Start watching the physical range [paddr, paddr + size) for writes. Returns a stamp to pass to isPhysicalRangeWritten later
+	u64 watchPhysicalRange(u32 paddr, u32 size);
+	// Returns true if [paddr, paddr + size) might have been written since "stamp" was returned by watchPhysicalRange
+	// Ranges outside of FCRAM and VRAM can't be tracked, so they always count as written
+	bool isPhysicalRangeWritten(u32 paddr, u32 size, u64 stamp) const;
+	// Report a write to physical memory that didn't go through our write handlers, eg a GPU DMA or a DSP write
+	void markPhysicalRangeWritten(u32 paddr, u32 size);
+
+	// Set by the GPU service when GPU commands run on their own thread. Blocks until every submitted command has been executed
+	void setGPUWaitCallback(std::function<void()> callback) { waitForGPU = std::move(callback); }
+	// Report that a submitted GPU command is going to write to the physical range [paddr, paddr + size). Until the GPU thread is done
+	// with it, CPU reads from the range wait for the GPU
+	void addPendingGPUWrite(u32 paddr, u32 size);
+	// Give pending pages their fast paths back. Must be called on the emulation thread once the GPU thread has gone idle
+	void clearPendingGPUWrites();
+
 	u32 getLinearHeapVaddr();
 	u8* getFCRAM() { return fcram; }
+	PageTable* getJITPageTable() { return jitPageTable.get(); }
+	// Returns the base of the host memory arena the guest address space is mapped to, or nullptr if the backend is disabled
+	u8* getFastmemArena() { return hostMemory ? hostMemory->getArena() : nullptr; }
+	// If the host memory backend is enabled, VRAM is allocated by us instead of the GPU, so that it lives in the shared backing memory
+	u8* getHostBackedVRAM() { return hostMemory ? vram : nullptr; }
 
 	// Total amount of OS-only FCRAM available (Can vary depending on how much FCRAM the app requests via the cart exheader)
 	u32 totalSysFCRAM() {
@@ -285,8 +408,50 @@ private:
 	u8* getDSPCodeMem() { return &dspRam[DSP_CODE_MEMORY_OFFSET]; }
 	u32 getUsedUserMem() { return usedUserMemory; }
 
-	void setVRAM(u8* pointer) { vram = pointer; }
-	void setDSPMem(u8* pointer) { dspRam = pointer; }
+	void setVRAM(u8* pointer) {
+		vram = pointer;
+		mapPhysicalRegion(PhysicalAddrs::VRAM, pointer, VirtualAddrs::VramSize);
+	}
+
+	void setDSPMem(u8* pointer) {
+		dspRam = pointer;
+		mapPhysicalRegion(PhysicalAddrs::DSP_RAM, pointer, DSP_RAM_SIZE);
+	}
+
+	// Returns a pointer to the data at physical address paddr, or nullptr if it's not in FCRAM, VRAM or DSP RAM
+	u8* getPhysPointer(u32 paddr) {
+		const uintptr_t pointer = physTable[paddr >> pageShift];
+		return (pointer != 0) ? (u8*)(pointer + (paddr & pageMask)) : nullptr;
+	}
+
+	// Returns a span over "size" bytes of physical memory starting at paddr, or an empty span if any part of the range is not backed by memory
+	std::span<u8> getPhysSpan(u32 paddr, u32 size) { return getContiguousSpan(physTable, paddr, size); }
+
+	// Read/write a value of type T from/to physical address paddr. Accesses to unbacked addresses read 0 and drop writes
+	template <typename T>
+	T readPhysical(u32 paddr) {
+		T value = T(0);
+		std::span<u8> span = getPhysSpan(paddr, sizeof(T));
+
+		if (!span.empty()) [[likely]] {
+			std::memcpy(&value, span.data(), sizeof(T));
+		} else {
+			Helpers::warn("Read from unbacked physical address %08X", paddr);
+		}
+		return value;
+	}
+
+	template <typename T>
+	void writePhysical(u32 paddr, T value) {
+		std::span<u8> span = getPhysSpan(paddr, sizeof(T));
+
+		if (!span.empty()) [[likely]] {
+			std::memcpy(span.data(), &value, sizeof(T));
+			markPhysicalRangeWritten(paddr, sizeof(T));
+		} else {
+			Helpers::warn("Write to unbacked physical address %08X", paddr);
+		}
+	}
 
 	bool allocateMainThreadStack(u32 size);
 	Regions getConsoleRegion();
@@ -2,6 +2,7 @@
 #include <array>
 #include <span>
 #include <optional>
+#include <vector>
 
 #include "PICA/pica_vertex.hpp"
 #include "PICA/regs.hpp"
@@ -45,6 +46,11 @@ class Renderer {
 	u32 outputWindowWidth = 400;
 	u32 outputWindowHeight = 240 * 2;
 
+	// Scratch buffer for expanding indexed draws in renderers that don't implement drawIndexedVertices
+	std::vector<PICA::Vertex> expandedVertices;
+	// Scratch buffer the GPU shades vertices into, for renderers that don't provide memory of their own via getVertexBuffer
+	std::vector<PICA::Vertex> vertexScratch;
+
   public:
 	Renderer(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs);
 	virtual ~Renderer();
@@ -60,12 +66,26 @@ class Renderer {
 	virtual void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) = 0;  // Perform display transfer
 	virtual void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) = 0;
 	virtual void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) = 0;  // Draw the given vertices
+	// Draw an indexed primitive stream, where every vertex is only shaded once and "indices" refer to entries of "vertices"
+	// The default implementation expands the indices and calls drawVertices
+	virtual void drawIndexedVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices);
+	// Get room for the GPU to shade "vertexCount" vertices into, for a draw that uses "indexCount" indices (0 for non-indexed draws)
+	// The GPU passes the shaded vertices straight to drawVertices/drawIndexedVertices afterwards, so renderers can hand out memory
+	// their graphics API reads from directly and skip copying the vertices. The default implementation uses a scratch buffer
+	virtual std::span<PICA::Vertex> getVertexBuffer(u32 vertexCount, u32 indexCount);
+	// Submit any draws the renderer has queued up instead of issuing them immediately. Called at the end of every command list,
+	// as the CPU might modify textures and other memory that queued draws depend on before the next one starts
+	virtual void flush() {}
 
 	virtual void screenshot(const std::string& name) = 0;
 	// Some frontends and platforms may require that we delete our GL or misc context and obtain a new one for things like exclusive fullscreen
 	// This function does things like write back or cache necessary state before we delete our context
 	virtual void deinitGraphicsContext() = 0;
 
+	// Whether the GX command functions (clears, transfers, draws) may be called from a thread other than the one that owns the
+	// graphics context. Renderers that need a context bound to the calling thread (OpenGL, Vulkan) can't be driven by the GPU thread
+	virtual bool supportsGPUThread() const { return false; }
+
 	// Functions for initializing the graphics context for the Qt frontend, where we don't have the convenience of SDL_Window
 #ifdef PANDA3DS_FRONTEND_QT
 	virtual void initGraphicsContext(GL::Context* context) { Helpers::panic("Tried to initialize incompatible renderer with GL context"); }
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <span>
+#include <vector>
 
 #include "PICA/float_types.hpp"
 #include "PICA/pica_vertex.hpp"
@@ -17,6 +18,14 @@
 class GPU;
 
 class RendererGL final : public Renderer {
+  public:
+	struct TextureCacheStats {
+		u64 hits = 0;       // Lookups that found a cached texture whose data hadn't changed
+		u64 misses = 0;     // Lookups that didn't find a texture and had to decode a new one
+		u64 reuploads = 0;  // Lookups that found a cached texture whose data changed, so it was decoded and uploaded again
+	};
+
+  private:
 	GLStateManager gl = {};
 
 	OpenGL::Program triangleProgram;
@@ -24,6 +33,24 @@ class RendererGL final : public Renderer {
 
 	OpenGL::VertexArray vao;
 	OpenGL::VertexBuffer vbo;
+	GLuint indexBuffer = 0;  // 32-bit index buffer for indexed draws. Its binding is part of the VAO state
+
+	// Vertices and indices are streamed through ring buffers split into segments of vertexBufferSize entries. With buffer storage,
+	// the rings are persistently mapped and the GPU shades vertices straight into them. Each segment gets a fence when we move on from
+	// it, which we wait on before writing to it again. Without buffer storage, the rings live in CPU memory and batches are uploaded
+	// with glBufferSubData when they're flushed
+	static constexpr u32 streamSegmentCount = 3;
+	static constexpr u32 streamRingSize = streamSegmentCount * vertexBufferSize;
+
+	bool persistentStreaming = false;
+	PICA::Vertex* streamVertices = nullptr;
+	u32* streamIndices = nullptr;  // Indices are absolute positions in the vertex ring, so batches don't need a base vertex
+	std::vector<PICA::Vertex> vertexShadow;
+	std::vector<u32> indexShadow;
+	std::array<GLsync, streamSegmentCount> segmentFences = {};
+	u32 streamSegment = 0;
+	u32 vertexCursor = 0;  // Ring position of the next vertex to be written
+	u32 indexCursor = 0;   // Ring position of the next index to be written
 
 	// TEV configuration uniform locations
 	GLint textureEnvSourceLoc = -1;
@@ -47,6 +74,28 @@ class RendererGL final : public Renderer {
 	SurfaceCache<DepthBuffer, 16, true> depthBufferCache;
 	SurfaceCache<ColourBuffer, 16, true> colourBufferCache;
 	SurfaceCache<Texture, 256, true> textureCache;
+	std::vector<u32> textureDecodeBuffer;  // Scratch space for decoding textures before uploading them
+	TextureCacheStats textureCacheStats;
+
+	// Consecutive triangle list draws with the same render state are appended to this batch and submitted as one draw call
+	// The GL state for the batch is set up when its first draw is queued, so nothing may touch GL state before it's flushed
+	// A batch is a contiguous range of the streaming rings, and never crosses into another segment
+	struct DrawBatch {
+		u64 stateHash = 0;
+		bool indexed = false;
+		OpenGL::Primitives topology = OpenGL::Triangle;
+		u32 firstVertex = 0;
+		u32 vertexCount = 0;
+		u32 firstIndex = 0;
+		u32 indexCount = 0;
+
+		bool empty() const { return vertexCount == 0; }
+	};
+	DrawBatch drawBatch;
+
+	// Register groups whose GL state has to be rebuilt by the next draw, on top of the ones the GPU reports as changed
+	// Set by releaseDrawState when we're about to overwrite the GL state that setupDraw configures, and when creating surfaces
+	u32 dirtyRegGroups = PICA::RegGroup::All;
 
 	// Dummy VAO/VBO for blitting the final output
 	OpenGL::VertexArray dummyVAO;
@@ -61,11 +110,25 @@ class RendererGL final : public Renderer {
 	OpenGL::Texture getTexture(Texture& tex);
 
 	MAKE_LOG_FUNCTION(log, rendererLogger)
+	// Set up all the state needed to draw a primitive of the given type and return the matching GL topology
+	OpenGL::Primitives setupDraw(PICA::PrimType primType);
+	// Hash of all the state that setupDraw depends on, to find out whether 2 draws can go in the same batch
+	u64 getDrawStateHash();
+	void queueDraw(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices, bool indexed);
+	void createStreamBuffers();
+	// Submit the current draw batch
+	void flushDraws();
+	// Every path that touches GL state outside of setupDraw (Displaying, clears, transfers, screenshots...) has to call this first
+	// It submits the queued draws, which were set up for the state that's about to be overwritten, and makes the next draw set up everything again
+	void releaseDrawState();
+	// Make sure the current ring segment has room for the given number of vertices and indices, moving on to the next one if not
+	void reserveStream(u32 vertexCount, u32 indexCount);
 	void setupBlending();
 	void setupStencilTest(bool stencilEnable);
 	void bindDepthBuffer();
 	void setupTextureEnvState();
-	void bindTexturesToSlots();
+	// Bind the textures of the enabled texture units out of the ones in "dirtyGroups"
+	void bindTexturesToSlots(u32 dirtyGroups);
 	void updateLightingLUT();
 	void initGraphicsContextInternal();
 
@@ -81,6 +144,9 @@ class RendererGL final : public Renderer {
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) override;  // Perform display transfer
 	void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) override;
 	void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) override;             // Draw the given vertices
+	void drawIndexedVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices) override;
+	void flush() override;
+	std::span<PICA::Vertex> getVertexBuffer(u32 vertexCount, u32 indexCount) override;
 	void deinitGraphicsContext() override;
 	
 	std::optional<ColourBuffer> getColourBuffer(u32 addr, PICA::ColorFmt format, u32 width, u32 height, bool createIfnotFound = true);
@@ -88,6 +154,7 @@ class RendererGL final : public Renderer {
 	// Note: The caller is responsible for deleting the currently bound FBO before calling this
 	void setFBO(uint handle) { screenFramebuffer.m_handle = handle; }
 	void resetStateManager() { gl.reset(); }
+	const TextureCacheStats& getTextureCacheStats() const { return textureCacheStats; }
 
 #ifdef PANDA3DS_FRONTEND_QT
 	virtual void initGraphicsContext([[maybe_unused]] GL::Context* context) override { initGraphicsContextInternal(); }
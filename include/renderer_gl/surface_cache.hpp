@@ -1,6 +1,9 @@
 #pragma once
 #include <functional>
+#include <map>
 #include <optional>
+#include <set>
+#include "boost/icl/interval_map.hpp"
 #include "surfaces.hpp"
 #include "textures.hpp"
 
@@ -15,6 +18,8 @@
 // Including equality of the allocated OpenGL resources, which we don't want
 // - A "valid" member that tells us whether the function is still valid or not
 // - A "location" member which tells us which location in 3DS memory this surface occupies
+// - A "range" member with the interval of 3DS memory the surface occupies
+// Valid surfaces are indexed by location and by memory range, so lookups don't have to scan the whole cache
 template <typename SurfaceType, size_t capacity, bool evictOnOverflow = false>
 class SurfaceCache {
     // Vanilla std::optional can't hold actual references
@@ -22,32 +27,103 @@ class SurfaceCache {
     static_assert(std::is_same<SurfaceType, ColourBuffer>() || std::is_same<SurfaceType, DepthBuffer>()  ||
         std::is_same<SurfaceType, Texture>(), "Invalid surface type");
 
-    size_t size;
-    size_t evictionIndex;
+    // Sets of slots in the buffer. Lookups return the lowest slot that matches, like a linear scan over the buffer would
+    using SlotSet = std::set<size_t>;
+    using AddressInterval = boost::icl::discrete_interval<u32>;
+
+    size_t size = 0; // Number of valid surfaces in the cache
+    size_t evictionIndex = 0;
     std::array<SurfaceType, capacity> buffer;
 
+    std::multimap<u32, size_t> locationIndex; // Location of each valid surface -> Its slot
+    boost::icl::interval_map<u32, SlotSet> rangeIndex; // Memory range -> Slots of the valid surfaces that overlap it
+    SlotSet freeSlots; // Slots without a valid surface
+
+    static AddressInterval getInterval(const SurfaceType& surface) {
+        return AddressInterval::right_open(surface.range.lower(), surface.range.upper());
+    }
+
+    void indexSurface(size_t slot) {
+        const SurfaceType& e = buffer[slot];
+        locationIndex.emplace(e.location, slot);
+        rangeIndex += std::make_pair(getInterval(e), SlotSet{slot});
+        freeSlots.erase(slot);
+        size++;
+    }
+
+    void unindexSurface(size_t slot) {
+        const SurfaceType& e = buffer[slot];
+        auto [begin, end] = locationIndex.equal_range(e.location);
+        for (auto it = begin; it != end; ++it) {
+            if (it->second == slot) {
+                locationIndex.erase(it);
+                break;
+            }
+        }
+
+        rangeIndex -= std::make_pair(getInterval(e), SlotSet{slot});
+        freeSlots.insert(slot);
+        size--;
+    }
+
+    // Free whatever surface is in the slot and put the new surface there
+    SurfaceType& replace(size_t slot, const SurfaceType& surface) {
+        auto& e = buffer[slot];
+        if (e.valid) {
+            unindexSurface(slot);
+        }
+
+        e.free();
+        e = surface;
+        e.allocate();
+
+        if (e.valid) {
+            indexSurface(slot);
+        }
+        return e;
+    }
+
 public:
+    SurfaceCache() {
+        for (size_t i = 0; i < capacity; i++) {
+            freeSlots.insert(i);
+        }
+    }
+
     void reset() {
         size = 0;
         evictionIndex = 0;
         for (auto& e : buffer) { // Free the VRAM of all surfaces
             e.free();
         }
+
+        locationIndex.clear();
+        rangeIndex.clear();
+        for (size_t i = 0; i < capacity; i++) {
+            freeSlots.insert(i);
+        }
     }
 
     OptionalRef find(SurfaceType& other) {
-        for (auto& e : buffer) {
-            if (e.matches(other) && e.valid)
-                return e;
+        size_t slot = capacity;
+        auto [begin, end] = locationIndex.equal_range(other.location);
+
+        for (auto it = begin; it != end; ++it) {
+            if (it->second < slot && buffer[it->second].matches(other)) {
+                slot = it->second;
+            }
         }
 
+        if (slot != capacity) {
+            return buffer[slot];
+        }
         return std::nullopt;
     }
 
     OptionalRef findFromAddress(u32 address) {
-        for (auto& e : buffer) {
-            if (e.location <= address && e.location + e.sizeInBytes() > address && e.valid)
-                return e;
+        auto it = rangeIndex.find(address);
+        if (it != rangeIndex.end()) {
+            return buffer[*it->second.begin()];
         }
 
         return std::nullopt;
@@ -61,40 +137,40 @@ public:
 					Helpers::panicDev("Colour/Depth buffer cache overflowed, currently stubbed to do a ring-buffer. This might snap in half");
 				}
 
-				auto& e = buffer[evictionIndex];
+				const size_t slot = evictionIndex;
 				evictionIndex = (evictionIndex + 1) % capacity;
-
-				e.valid = false;
-				e.free();
-				e = surface;
-				e.allocate();
-				return e;
+				return replace(slot, surface);
 			} else {
 				Helpers::panic("Surface cache full! Add emptying!");
 			}
 		}
 
-		size++;
-
 		// Find an existing surface we completely invalidate and overwrite it with the new surface
-		for (auto& e : buffer) {
-			if (e.valid && e.range.lower() >= surface.range.lower() && e.range.upper() <= surface.range.upper()) {
-				e.free();
-				e = surface;
-				e.allocate();
-				return e;
+		// Only surfaces that overlap the new one can be inside it, so only look at those
+		const AddressInterval interval = getInterval(surface);
+		if (!boost::icl::is_empty(interval)) {
+			size_t coveredSlot = capacity;
+			auto [begin, end] = rangeIndex.equal_range(interval);
+
+			for (auto it = begin; it != end; ++it) {
+				for (size_t slot : it->second) {
+					const auto& e = buffer[slot];
+					if (slot < coveredSlot && e.range.lower() >= surface.range.lower() && e.range.upper() <= surface.range.upper()) {
+						coveredSlot = slot;
+					}
+				}
 			}
-		}
 
-		// Find an invalid entry in the cache and overwrite it with the new surface
-		for (auto& e : buffer) {
-			if (!e.valid) {
-				e = surface;
-				e.allocate();
-				return e;
+			if (coveredSlot != capacity) {
+				return replace(coveredSlot, surface);
 			}
 		}
 
+		// Overwrite the first invalid entry in the cache with the new surface
+		if (!freeSlots.empty()) {
+			return replace(*freeSlots.begin(), surface);
+		}
+
 		// This should be unreachable but helps to panic anyways
 		Helpers::panic("Couldn't add surface to cache\n");
 	}
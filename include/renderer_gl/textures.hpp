@@ -1,6 +1,8 @@
 #pragma once
 #include <array>
+#include <span>
 #include <string>
+#include <vector>
 #include "PICA/regs.hpp"
 #include "boost/icl/interval.hpp"
 #include "helpers.hpp"
@@ -22,6 +24,11 @@ struct Texture {
     // OpenGL resources allocated to buffer
     OpenGL::Texture texture;
 
+    // Hash of the texture data the last time we decoded it, and the memory write stamp from when we last checked it
+    // Used to tell whether the data in 3DS memory has actually changed when the pages backing the texture get written
+    u64 contentHash = 0;
+    u64 writeStamp = 0;
+
     Texture() : valid(false) {}
 
     Texture(u32 loc, PICA::TextureFmt format, u32 x, u32 y, u32 config, bool valid = true)
@@ -41,25 +48,13 @@ struct Texture {
 
     void allocate();
     void setNewConfig(u32 newConfig);
-    void decodeTexture(std::span<const u8> data);
+    // Decode the texture from "data" and upload it. "decodeBuffer" is scratch space for the decoded texels, which is reused between uploads
+    void decodeTexture(std::span<const u8> data, std::vector<u32>& decodeBuffer);
     void free();
     u64 sizeInBytes();
 
-    u32 decodeTexel(u32 u, u32 v, PICA::TextureFmt fmt, std::span<const u8> data);
-
-    // Get the morton interleave offset of a texel based on its U and V values
-    static u32 mortonInterleave(u32 u, u32 v);
-    // Get the byte offset of texel (u, v) in the texture
-    static u32 getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel);
-    static u32 getSwizzledOffset_4bpp(u32 u, u32 v, u32 width);
-
     // Returns the format of this texture as a string
     std::string_view formatToString() {
         return PICA::textureFormatToString(format);
     }
-
-    // Returns the texel at coordinates (u, v) of an ETC1(A4) texture
-    // TODO: Make hasAlpha a template parameter
-    u32 getTexelETC(bool hasAlpha, u32 u, u32 v, u32 width, std::span<const u8> data);
-    u32 decodeETC(u32 alpha, u32 u, u32 v, u64 colourData);
 };
@@ -14,8 +14,10 @@ class RendererNull final : public Renderer {
 	void displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) override;
 	void textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) override;
 	void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) override;
+	void drawIndexedVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices) override;
 	void screenshot(const std::string& name) override;
 	void deinitGraphicsContext() override;
+	bool supportsGPUThread() const override { return true; }
 
 #ifdef PANDA3DS_FRONTEND_QT
 	virtual void initGraphicsContext([[maybe_unused]] GL::Context* context) override {}
@@ -1,8 +1,148 @@
+#pragma once
+#include <array>
+#include <vector>
+
+#include "PICA/regs.hpp"
 #include "renderer.hpp"
+#include "renderer_sw/textures.hpp"
+#include "thread_pool.hpp"
 
 class GPU;
+class Memory;
 
+// CPU rasterizer that renders straight into emulated VRAM, for running without any GPU driver (eg for automated testing)
+// Triangles are clipped and set up on the calling thread, then the framebuffer is split into horizontal bands which get rasterized
+// in parallel by a small pool of worker threads. Each band is owned by a single worker, so per-pixel ordering is preserved
 class RendererSw final : public Renderer {
+	// Attributes interpolated across a triangle. Normal/tangent/bitangent are derived from the vertex quaternion before rasterization
+	enum Attrib : u32 {
+		ColourR, ColourG, ColourB, ColourA,
+		Tex0U, Tex0V, Tex0W,
+		Tex1U, Tex1V,
+		Tex2U, Tex2V,
+		NormalX, NormalY, NormalZ,
+		TangentX, TangentY, TangentZ,
+		BitangentX, BitangentY, BitangentZ,
+		ViewX, ViewY, ViewZ,
+		AttribCount,
+	};
+
+	struct ClipVertex {
+		std::array<float, 4> position;
+		std::array<float, AttribCount> attribs;
+	};
+
+	// A triangle after viewport transform, ready to be rasterized
+	struct TriangleSetup {
+		// Vertex positions in 28.4 fixed point framebuffer coordinates
+		std::array<s32, 3> x, y;
+		// Bounding box in pixels, clamped to the framebuffer
+		s32 minX, minY, maxX, maxY;
+		float invArea;
+
+		std::array<float, 3> zOverW;
+		std::array<float, 3> invW;
+		// Attributes pre-divided by w for perspective-correct interpolation
+		std::array<std::array<float, AttribCount>, 3> attribsOverW;
+	};
+
+	// Per-light fragment lighting parameters, decoded from the light registers once per draw
+	struct LightState {
+		u32 id;
+		u32 config;
+		std::array<float, 3> specular0, specular1, diffuse, ambient;
+		std::array<float, 3> vector;
+		std::array<float, 3> spotDirection;
+	};
+
+	// Snapshot of the register state that affects rasterization & fragment processing, captured once per draw
+	struct DrawState {
+		u8* colourBuffer;
+		u8* depthBuffer;
+		PICA::ColorFmt colourFormat;
+		PICA::DepthFmt depthFormat;
+		u32 width, height;
+
+		float viewportHalfWidth, viewportHalfHeight;
+		s32 viewportX, viewportY;
+		bool userClipEnable;
+		std::array<float, 4> userClipPlane;
+
+		float depthScale, depthOffset;
+		bool depthMapEnable;
+
+		bool depthTest;
+		u32 depthFunc;
+		bool depthWrite;
+		std::array<bool, 4> colourMask;
+
+		bool stencilTest;
+		u32 stencilFunc;
+		u8 stencilRef, stencilRefMask, stencilWriteMask;
+		u32 stencilFailOp, depthFailOp, passOp;
+
+		bool alphaTest;
+		u32 alphaFunc;
+		u8 alphaRef;
+
+		bool blendEnable;
+		u32 rgbEquation, alphaEquation;
+		u32 rgbSourceFunc, rgbDestFunc, alphaSourceFunc, alphaDestFunc;
+		std::array<float, 4> blendColour;
+		u32 logicOp;
+
+		std::array<SwTexture, 3> textures;
+		std::array<bool, 3> textureEnabled;
+		bool tex2UsesTexcoord1;
+
+		std::array<u32, 6> tevSource, tevOperand, tevCombiner, tevScale;
+		std::array<std::array<float, 4>, 6> tevColour;
+		std::array<float, 4> tevBufferColour;
+		u32 tevUpdateBuffer;
+
+		bool lightingEnable;
+		std::array<float, 3> lightingAmbient;
+		u32 lutInputAbs, lutInputSelect, lutInputScale;
+		u32 lightingConfig0, lightingConfig1;
+		u32 lightCount;
+		std::array<LightState, 8> lights;
+	};
+
+	Memory& mem;
+	DrawState state;
+	std::vector<TriangleSetup> triangles;
+
+	// Framebuffer rows are split into bands of this many rows, which are distributed across workers round-robin
+	static constexpr s32 bandHeight = 16;
+	// Draws covering fewer pixels than this are rasterized on the calling thread, as waking up the workers would cost more than it saves
+	static constexpr u64 parallelPixelThreshold = 4096;
+
+	// Bands are rasterized in parallel on this pool. Job i handles every band b with b % threadCount == i
+	ThreadPool threadPool;
+
+	// Our composited output image, 400x480 RGBA8 with the top screen above the bottom one
+	static constexpr u32 screenWidth = 400;
+	static constexpr u32 screenHeight = 240 * 2;
+	std::vector<u8> screenPixels;
+	void composeScreen(u32 addr, u32 format, u32 stride, u32 width, u32 xOffset, u32 yOffset);
+
+	void captureDrawState();
+	void clipAndSetupTriangle(const PICA::Vertex& v0, const PICA::Vertex& v1, const PICA::Vertex& v2);
+	void setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+	void rasterizeTriangle(const TriangleSetup& tri, s32 bandMinY, s32 bandMaxY);
+	void shadeFragment(const TriangleSetup& tri, s32 x, s32 y, const std::array<float, 3>& barycentrics);
+
+	std::array<float, 4> runTextureEnvironment(const std::array<float, AttribCount>& attribs);
+	void calculateLighting(const std::array<float, AttribCount>& attribs, std::array<float, 4>& primary, std::array<float, 4>& secondary);
+	float lookupLightingLUT(u32 lut, u32 light, float value);
+
+	bool stencilAndDepthTest(u8* depthPixel, float depth);
+	void writeColour(u8* pixel, std::array<float, 4> colour);
+
+	// Read/write a pixel of a colour buffer in the given format, as RGBA8
+	static std::array<u8, 4> decodeColour(const u8* pixel, PICA::ColorFmt format);
+	static void encodeColour(u8* pixel, PICA::ColorFmt format, const std::array<u8, 4>& colour);
+
   public:
 	RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs);
 	~RendererSw() override;
@@ -16,6 +156,7 @@ class RendererSw final : public Renderer {
 	void drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) override;
 	void screenshot(const std::string& name) override;
 	void deinitGraphicsContext() override;
+	bool supportsGPUThread() const override { return true; }
 
 #ifdef PANDA3DS_FRONTEND_QT
 	virtual void initGraphicsContext([[maybe_unused]] GL::Context* context) override {}
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <span>
+
+#include "PICA/regs.hpp"
+#include "helpers.hpp"
+
+// A texture as seen by the software renderer. Texels are decoded straight from emulated memory every time they're sampled,
+// so there's no texture cache that needs to be kept in sync with writes from the CPU or the GPU
+struct SwTexture {
+	std::span<const u8> data;
+	u32 width = 0;
+	u32 height = 0;
+	u32 config = 0;  // Magnification/minification filter, wrapping configs, etc
+	PICA::TextureFmt format = PICA::TextureFmt::RGBA8;
+	std::array<float, 4> borderColour = {};
+	bool valid = false;
+
+	// Sample the texture at texture coordinates (s, t) using the filtering & wrapping modes in the texture config
+	// Returns a colour with RGBA components in the [0, 1] range. Invalid textures read as transparent black
+	std::array<float, 4> sample(float s, float t) const;
+
+	// Get the texel at position (u, v) in ABGR8888 format. Like textures are laid out in memory, v = 0 is the top row
+	// (ie the one sampled at t = 1), as the PICA stores textures from bottom to top
+	u32 decodeTexel(u32 u, u32 v) const;
+
+	static u64 sizeInBytes(PICA::TextureFmt format, u32 width, u32 height);
+	// Get the byte offset of texel (u, v) in an 8x8 tiled image
+	static u32 getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel);
+
+  private:
+	// Fetch texel (u, v) in sampling space (v = 0 is the bottom row) after applying the wrapping modes, as floats
+	std::array<float, 4> fetch(s32 u, s32 v) const;
+};
@@ -1,61 +1,85 @@
 #pragma once
-#include <boost/container/flat_map.hpp>
-#include <boost/container/static_vector.hpp>
+#include <functional>
 #include <limits>
+#include <string>
+#include <vector>
 
 #include "helpers.hpp"
-#include "logger.hpp"
 
+// Our timing subsystem. Components register the kinds of events they want to schedule along with a callback when they're constructed,
+// and can then schedule any number of instances of them at a given timestamp. Every scheduled event gets a handle, which can be used
+// to cancel it in O(1). Pending events are kept in a binary min-heap, cancelled events are lazily dropped when they reach the top.
 struct Scheduler {
-	enum class EventType {
-		VBlank = 0,          // End of frame event
-		UpdateTimers = 1,    // Update kernel timer objects
-		RunDSP = 2,          // Make the emulated DSP run for one audio frame
-		Panic = 3,           // Dummy event that is always pending and should never be triggered (Timestamp = UINT64_MAX)
-		TotalNumberOfEvents  // How many event types do we have in total?
-	};
-	static constexpr usize totalNumberOfEvents = static_cast<usize>(EventType::TotalNumberOfEvents);
 	static constexpr u64 arm11Clock = 268111856;
 
-	template <typename Key, typename Val, usize size>
-	using EventMap = boost::container::flat_multimap<Key, Val, std::less<Key>, boost::container::static_vector<std::pair<Key, Val>, size>>;
+	// Callback invoked when an event fires. "userdata" is the value passed when the event was scheduled and
+	// "cyclesLate" is how many cycles past its timestamp the event got handled
+	using Callback = std::function<void(u64 userdata, u64 cyclesLate)>;
+	// ID of a registered event type
+	using EventType = u32;
+
+	// Handle to a scheduled event. Default-constructed handles don't refer to any event
+	struct EventHandle {
+		u32 slot = std::numeric_limits<u32>::max();
+		u32 generation = 0;
+	};
 
-	EventMap<u64, EventType, totalNumberOfEvents> events;
 	u64 currentTimestamp = 0;
-	u64 nextTimestamp = 0;
+	u64 nextTimestamp = std::numeric_limits<u64>::max();
 
-	// Set nextTimestamp to the timestamp of the next event
-	void updateNextTimestamp() { nextTimestamp = events.cbegin()->first; }
+	// Register a new kind of event and return its ID. Must be done at construction time, not from inside an event callback
+	EventType registerEventType(std::string name, Callback callback);
 
-	void addEvent(EventType type, u64 timestamp) {
-		events.emplace(timestamp, type);
-		updateNextTimestamp();
+	// Schedule an event of type "type" to fire at "timestamp" with the given user data, and return a handle to it
+	EventHandle schedule(EventType type, u64 timestamp, u64 userdata = 0);
+	// Cancel a pending event and invalidate its handle. Returns false if the event already fired or was cancelled
+	bool cancel(EventHandle& handle);
+	bool isScheduled(const EventHandle& handle) const {
+		return handle.slot < slots.size() && slots[handle.slot].active && slots[handle.slot].generation == handle.generation;
 	}
 
-	void removeEvent(EventType type) {
-		for (auto it = events.begin(); it != events.end(); it++) {
-			// Find first event of type "type" and remove it.
-			// Our scheduler shouldn't have duplicate events, so it's safe to exit when an event is found
-			if (it->second == type) {
-				events.erase(it);
-				updateNextTimestamp();
-				break;
-			}
-		}
+	// Run the callbacks of every event whose timestamp has been reached, in timestamp order
+	void runEvents();
+	// Cancel every pending event. Registered event types are kept
+	void reset();
+
+  private:
+	struct EventTypeInfo {
+		std::string name;
+		Callback callback;
 	};
 
-	void reset() {
-		currentTimestamp = 0;
+	// Scheduled events are stored in slots which get recycled. The generation counter is bumped whenever a slot is freed,
+	// which invalidates outstanding handles and heap entries that refer to the old event
+	struct Slot {
+		EventType type = 0;
+		u32 generation = 0;
+		u64 userdata = 0;
+		bool active = false;
+	};
 
-		// Clear any pending events
-		events.clear();
-		addEvent(Scheduler::EventType::VBlank, arm11Clock / 60);
+	struct QueueEntry {
+		u64 timestamp;
+		u64 sequence;  // Used to run events with the same timestamp in the order they were scheduled
+		u32 slot;
+		u32 generation;
+	};
 
-		// Add a dummy event to always keep the scheduler non-empty
-		addEvent(EventType::Panic, std::numeric_limits<u64>::max());
-	}
+	std::vector<EventTypeInfo> eventTypes;
+	std::vector<Slot> slots;
+	std::vector<u32> freeSlots;
+	std::vector<QueueEntry> queue;  // Min-heap ordered by (timestamp, sequence)
+	u64 sequence = 0;
+	usize staleEntries = 0;  // How many entries in the queue belong to cancelled events
+
+	static bool isLater(const QueueEntry& a, const QueueEntry& b);
+	bool isStale(const QueueEntry& entry) const { return slots[entry.slot].generation != entry.generation; }
+	void releaseSlot(u32 slot);
+	// Drop cancelled events from the top of the queue and set nextTimestamp to the timestamp of the next event
+	void updateNextTimestamp();
+	// Rebuild the queue without cancelled events, so that it doesn't grow forever when events get rescheduled often
+	void compact();
 
-  private:
 	static constexpr u64 MAX_VALUE_TO_MULTIPLY = std::numeric_limits<s64>::max() / arm11Clock;
 
   public:
@@ -87,4 +111,4 @@ struct Scheduler {
 
 		return (arm11Clock * s64(ns)) / 1000000000;
 	}
-};
\ No newline at end of file
+};
@@ -1,12 +1,17 @@
 #pragma once
+#include <atomic>
 #include <cstring>
 #include <optional>
+#include <thread>
 #include "PICA/gpu.hpp"
+#include "config.hpp"
 #include "helpers.hpp"
 #include "kernel_types.hpp"
 #include "logger.hpp"
 #include "memory.hpp"
 #include "result/result.hpp"
+#include "ring_buffer.hpp"
+#include "scheduler.hpp"
 
 enum class GPUInterrupt : u8 {
 	PSC0 = 0, // Memory fill completed
@@ -40,6 +45,46 @@ class GPUService {
 	MAKE_LOG_FUNCTION(log, gspGPULogger)
 	void processCommandBuffer();
 
+	// Dual-core mode: GX commands are copied into a lock-free queue and executed on a dedicated GPU thread, so the emulated CPU
+	// can keep running while the GPU works. Interrupts raised by finished commands are queued back and only delivered on the
+	// emulation thread at sync points, as they touch GSP shared memory and kernel state. A command's results are thus always
+	// visible by the time the game sees its completion interrupt. Anything that goes through guest virtual addresses is resolved when
+	// the command is submitted, as the emulation thread might remap memory while the command is waiting in the queue
+	struct GXCommand {
+		std::array<u32, 8> words;
+		u32* commandList;  // Host pointer to the command list of ProcessCommandList commands, nullptr for anything else
+	};
+
+	GXCommand readCommand(const u32* cmd);
+	void executeCommand(GXCommand& command);
+
+	// How long the emulated CPU may run ahead of the GPU thread after submitting commands before it waits for them to finish
+	static constexpr u64 gpuSyncDelay = Scheduler::nsToCycles(100'000);
+
+	bool gpuThreadEnabled = false;
+	std::thread gpuThread;
+	Common::RingBuffer<GXCommand, 64> commandQueue;  // Emulation thread -> GPU thread
+	// GPU thread -> emulation thread. A command raises at most 2 interrupts and finished interrupts are drained before every
+	// submission, so this can never overflow
+	Common::RingBuffer<GPUInterrupt, 256> finishedInterrupts;
+	std::atomic<u64> submittedCommands = 0;
+	std::atomic<u64> completedCommands = 0;
+	std::atomic<bool> stopGPUThread = false;
+
+	Scheduler& scheduler;
+	Scheduler::EventType syncEvent;
+	Scheduler::EventHandle syncEventHandle;
+
+	void gpuThreadLoop();
+	void submitCommand(GXCommand& command);
+	// Tell memory which physical ranges a submitted command is going to write, so that CPU reads from them wait for the GPU thread
+	void markPendingWrites(const GXCommand& command);
+	// Raise the interrupt for a finished GX command, or queue it for the emulation thread if we're running on the GPU thread
+	void commandFinished(GPUInterrupt type);
+	void deliverFinishedInterrupts();
+	// Block until the GPU thread has executed every submitted command
+	void waitForGPU();
+
 	struct FramebufferInfo {
 		u32 activeFb;
 		u32 leftFramebufferVaddr;
@@ -88,7 +133,7 @@ class GPUService {
 	void writeHwRegsWithMask(u32 messagePointer);
 
 	// GSP commands processed via TriggerCmdReqQueue
-	void processCommandList(u32* cmd);
+	void processCommandList(u32* cmd, u32* commandList);
 	void memoryFill(u32* cmd);
 	void triggerDisplayTransfer(u32* cmd);
 	void triggerDMARequest(u32* cmd);
@@ -107,11 +152,15 @@ class GPUService {
 	FramebufferUpdate* getBottomFramebufferInfo() { return getFramebufferInfo(1); }
 
 public:
-	GPUService(Memory& mem, GPU& gpu, Kernel& kernel, u32& currentPID) : mem(mem), gpu(gpu),
-		kernel(kernel), currentPID(currentPID) {}
+	GPUService(Memory& mem, GPU& gpu, Kernel& kernel, u32& currentPID, const EmulatorConfig& config);
+	~GPUService();
 	void reset();
 	void handleSyncRequest(u32 messagePointer);
 	void requestInterrupt(GPUInterrupt type);
+
+	// Wait for the GPU thread to go idle and deliver the interrupts of every finished command. Needs to happen before anything
+	// outside the GPU thread observes GPU state, such as presenting the framebuffers. Does nothing in single-threaded mode
+	void syncGPU();
 	void setSharedMem(u8* ptr) {
 		sharedMem = ptr;
 		if (ptr != nullptr) { // Zero-fill shared memory in case the process tries to read stale service data or vice versa
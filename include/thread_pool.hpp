@@ -0,0 +1,32 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "helpers.hpp"
+
+// A small pool of worker threads for splitting a job in pieces and running them in parallel.
+// The calling thread always takes part in the job, so a pool with N threads only spawns N - 1 workers
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::condition_variable jobStart, jobDone;
+	std::function<void(u32, u32)> job;
+	u64 jobGeneration = 0;
+	u32 busyWorkers = 0;
+	bool stopWorkers = false;
+
+	void workerLoop(u32 index);
+
+  public:
+	// A thread count of 0 picks one thread per host core, up to maxThreads
+	explicit ThreadPool(u32 threadCount = 0, u32 maxThreads = 8);
+	~ThreadPool();
+
+	u32 getThreadCount() const { return u32(workers.size()) + 1; }
+
+	// Runs func(index, count) for every index in [0, count) in parallel, where count is the thread count, and waits for all of them to finish
+	void run(const std::function<void(u32, u32)>& func);
+};
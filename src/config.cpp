@@ -40,6 +40,7 @@ void EmulatorConfig::load() {
 
 			discordRpcEnabled = toml::find_or<toml::boolean>(general, "EnableDiscordRPC", false);
 			usePortableBuild = toml::find_or<toml::boolean>(general, "UsePortableBuild", false);
+			hostMemoryEnabled = toml::find_or<toml::boolean>(general, "EnableHostMemory", false);
 			defaultRomPath = toml::find_or<std::string>(general, "DefaultRomPath", "");
 		}
 	}
@@ -61,7 +62,12 @@ void EmulatorConfig::load() {
 			}
 
 			shaderJitEnabled = toml::find_or<toml::boolean>(gpu, "EnableShaderJIT", shaderJitDefault);
+			shaderJitBackgroundCompilation = toml::find_or<toml::boolean>(gpu, "ShaderJITBackgroundCompilation", true);
+			// Negative limits don't make sense, treat them as unlimited
+			shaderJitCacheLimit = u32(std::max<toml::integer>(toml::find_or<toml::integer>(gpu, "ShaderJITCacheLimit", 256), 0));
+			shaderJitUniformSpecialization = toml::find_or<toml::boolean>(gpu, "ShaderJITUniformSpecialization", true);
 			vsyncEnabled = toml::find_or<toml::boolean>(gpu, "EnableVSync", true);
+			gpuThreadEnabled = toml::find_or<toml::boolean>(gpu, "EnableGPUThread", false);
 		}
 	}
 
@@ -121,10 +127,15 @@ void EmulatorConfig::save() {
 
 	data["General"]["EnableDiscordRPC"] = discordRpcEnabled;
 	data["General"]["UsePortableBuild"] = usePortableBuild;
+	data["General"]["EnableHostMemory"] = hostMemoryEnabled;
 	data["General"]["DefaultRomPath"] = defaultRomPath.string();
 	data["GPU"]["EnableShaderJIT"] = shaderJitEnabled;
+	data["GPU"]["ShaderJITBackgroundCompilation"] = shaderJitBackgroundCompilation;
+	data["GPU"]["ShaderJITCacheLimit"] = shaderJitCacheLimit;
+	data["GPU"]["ShaderJITUniformSpecialization"] = shaderJitUniformSpecialization;
 	data["GPU"]["Renderer"] = std::string(Renderer::typeToString(rendererType));
 	data["GPU"]["EnableVSync"] = vsyncEnabled;
+	data["GPU"]["EnableGPUThread"] = gpuThreadEnabled;
 	data["Audio"]["DSPEmulation"] = std::string(Audio::DSPCore::typeToString(dspType));
 	data["Audio"]["EnableAudio"] = audioEnabled;
 
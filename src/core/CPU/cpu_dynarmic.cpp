@@ -15,6 +15,22 @@ CPU::CPU(Memory& mem, Kernel& kernel, Emulator& emu) : mem(mem), emu(emu), sched
 	config.global_monitor = &exclusiveMonitor;
 	config.processor_id = 0;
 
+	// Let the JIT access plain RAM pages directly through our page table instead of calling into MyEnvironment for every load and store.
+	// Accesses to pages with no page table entry (config memory, VRAM, read-only and unmapped pages) still go through the callbacks.
+	// Misaligned accesses that cross a page boundary also fall back to the callbacks, as the next page might not be mapped contiguously.
+	static_assert(sizeof(Memory::PageTable) == sizeof(*config.page_table), "Memory page table doesn't match dynarmic's page table layout");
+	config.page_table = reinterpret_cast<decltype(config.page_table)>(mem.getJITPageTable());
+	config.absolute_offset_page_table = false;
+	config.detect_misaligned_access_via_page_table = 16 | 32 | 64;
+	config.only_detect_misalignment_via_page_table_on_page_boundary = true;
+
+	// If guest memory is backed by host virtual memory, guest addresses can be accessed directly relative to the arena.
+	// Accesses to unmapped parts of the arena fault, and dynarmic then recompiles the offending code to use the page table instead
+	if (u8* arena = mem.getFastmemArena(); arena != nullptr) {
+		config.fastmem_pointer = reinterpret_cast<uintptr_t>(arena);
+		config.recompile_on_fastmem_failure = true;
+	}
+
 	jit = std::make_unique<Dynarmic::A32::Jit>(config);
 }
 
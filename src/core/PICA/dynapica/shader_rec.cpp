@@ -1,32 +1,367 @@
 #include "PICA/dynapica/shader_rec.hpp"
+#include <algorithm>
+#include <array>
 #include <bit>
+#include <cstring>
 
 #ifdef PANDA3DS_SHADER_JIT_SUPPORTED
+#include "io_file.hpp"
+#include "thread_pool.hpp"
+
+// Shader cache file layout: A header, followed by one record per program. Every record is the code length in words,
+// the code itself without trailing zeroes, all 128 operand descriptors, then the bool uniform and the 4 int uniforms
+// The uniforms only matter for uniform specialization, where programs get recorded once per set of uniform values they're used with
+namespace ShaderDiskCache {
+	static constexpr u32 magic = 0x43485350;  // "PSHC"
+	static constexpr u32 version = 2;
+	static constexpr u32 opdescCount = 128;
+	static constexpr u32 intUniformSize = 4 * 4 * sizeof(u8);
+}
+
+ShaderJIT::~ShaderJIT() { setBackgroundCompilation(false); }
+
 void ShaderJIT::reset() {
 	cache.clear();
+	uniformUsage.clear();
+	codeBytes = 0;
+	diskCachePath = std::nullopt;
+	recordedShaders.clear();
+
+	// Shaders that are currently being compiled will still land in the cache, which is fine as it's keyed by the shader contents
+	std::unique_lock lock(compilerMutex);
+	compileQueue.clear();
+	finishedShaders.clear();
+	pendingShaders.clear();
 }
 
-void ShaderJIT::prepare(PICAShader& shaderUnit) {
-	shaderUnit.pc = shaderUnit.entrypoint;
+void ShaderJIT::setBackgroundCompilation(bool enable) {
+	if (enable == backgroundCompilation) {
+		return;
+	}
+
+	backgroundCompilation = enable;
+	if (enable) {
+		stopCompiler = false;
+		compilerThread = std::thread(&ShaderJIT::compilerLoop, this);
+	} else {
+		{
+			std::unique_lock lock(compilerMutex);
+			stopCompiler = true;
+		}
+
+		compilerWakeup.notify_one();
+		compilerThread.join();
+
+		// Hand over the shaders that made it, anything still queued will get compiled synchronously when it's next used
+		collectFinishedShaders();
+		compileQueue.clear();
+		pendingShaders.clear();
+	}
+}
+
+void ShaderJIT::compilerLoop() {
+	while (true) {
+		std::unique_lock lock(compilerMutex);
+		compilerWakeup.wait(lock, [this] { return stopCompiler || !compileQueue.empty(); });
+		if (stopCompiler) {
+			return;
+		}
+
+		CompileJob job = std::move(compileQueue.front());
+		compileQueue.pop_front();
+		lock.unlock();
+
+		auto emitter = allocateEmitter();
+		emitter->compile(*job.shader, job.specializeUniforms);
+
+		lock.lock();
+		finishedShaders.emplace_back(job.hash, std::move(emitter));
+	}
+}
+
+void ShaderJIT::collectFinishedShaders() {
+	std::unique_lock lock(compilerMutex);
+
+	for (auto& [hash, emitter] : finishedShaders) {
+		pendingShaders.erase(hash);
+		insertShader(hash, std::move(emitter));
+		frameStats.compiledShaders++;
+	}
+
+	finishedShaders.clear();
+}
+
+void ShaderJIT::insertShader(Hash hash, std::unique_ptr<ShaderEmitter> emitter) {
+	auto [it, inserted] = cache.try_emplace(hash, CacheEntry{std::move(emitter), currentFrame});
+	if (inserted) {
+		codeBytes += ShaderEmitter::getCodeBufferSize();
+	}
+}
+
+std::unique_ptr<ShaderEmitter> ShaderJIT::allocateEmitter() {
+#ifdef PANDA3DS_X64_HOST
+	{
+		std::unique_lock lock(compilerMutex);
+		if (!spareEmitters.empty()) {
+			auto emitter = std::move(spareEmitters.back());
+			spareEmitters.pop_back();
+			lock.unlock();
+
+			emitter->reset();
+			return emitter;
+		}
+	}
+#endif
+
+	return std::make_unique<ShaderEmitter>();
+}
+
+void ShaderJIT::evictShaders() {
+	if (cacheLimit == 0 || cache.size() <= cacheLimit) {
+		return;
+	}
+
+	// Evict the least recently used shaders first, but only ones that have been unused for a while so that we don't thrash
+	std::vector<std::pair<u64, Hash>> candidates;
+	for (const auto& [hash, entry] : cache) {
+		if (currentFrame - entry.lastUsedFrame >= evictionAge) {
+			candidates.emplace_back(entry.lastUsedFrame, hash);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+	for (const auto& [lastUsedFrame, hash] : candidates) {
+		if (cache.size() <= cacheLimit) {
+			break;
+		}
+
+		auto node = cache.extract(hash);
+		codeBytes -= ShaderEmitter::getCodeBufferSize();
+		frameStats.evictions++;
+
+		// The arm64 emitter can't be rewound yet, so evicted arm64 shaders simply get freed
+#ifdef PANDA3DS_X64_HOST
+		std::unique_lock lock(compilerMutex);
+		if (spareEmitters.size() < maxSpareEmitters) {
+			spareEmitters.push_back(std::move(node.mapped().emitter));
+		}
+#endif
+	}
+}
+
+void ShaderJIT::endFrame() {
+	evictShaders();
+	frameStats.codeBytes = codeBytes;
+
+	if (frameStats.interpretedDraws != 0 || frameStats.compiledShaders != 0 || frameStats.evictions != 0) {
+		log("%u draws ran on the interpreter while waiting for shaders, %u shaders compiled, %u evicted. Cache: %u hits, %u misses, %zu KB\n",
+			frameStats.interpretedDraws, frameStats.compiledShaders, frameStats.evictions, frameStats.cacheHits, frameStats.cacheMisses,
+			codeBytes / 1024);
+	}
+
+	lastFrameStats = frameStats;
+	frameStats = {};
+	currentFrame++;
+}
+
+ShaderJIT::UniformUsage ShaderJIT::scanUniformUsage(const PICAShader& shaderUnit) {
+	UniformUsage usage;
+
+	for (u32 instruction : shaderUnit.loadedShader) {
+		switch (instruction >> 26) {
+			case ShaderOpcodes::CALLU:
+			case ShaderOpcodes::IFU:
+			case ShaderOpcodes::JMPU: usage.boolMask |= 1u << Helpers::getBits<22, 4>(instruction); break;
+			case ShaderOpcodes::LOOP: usage.intMask |= 1u << Helpers::getBits<22, 2>(instruction); break;
+			default: break;
+		}
+	}
+
+	return usage;
+}
+
+ShaderJIT::Hash ShaderJIT::getShaderHash(PICAShader& shaderUnit) {
 	// We combine the code and operand descriptor hashes into a single hash
 	// This is so that if only one of them changes, we still properly recompile the shader
 	// The combine does rotl(x, 1) ^ y for the merging instead of x ^ y because xor is commutative, hence creating possible collisions
 	// re: https://github.com/wheremyfoodat/Panda3DS/pull/15#discussion_r1229925372
-	Hash hash = std::rotl(shaderUnit.getCodeHash(), 1) ^ shaderUnit.getOpdescHash();
+	const Hash programHash = std::rotl(shaderUnit.getCodeHash(), 1) ^ shaderUnit.getOpdescHash();
+	if (!specializeUniforms) {
+		return programHash;
+	}
+
+	auto [it, inserted] = uniformUsage.try_emplace(programHash);
+	if (inserted) {
+		it->second = scanUniformUsage(shaderUnit);
+	}
+
+	const UniformUsage usage = it->second;
+	if (usage.boolMask == 0 && usage.intMask == 0) {
+		return programHash;
+	}
+
+	// Only the uniforms the program actually reads go in the key, so that unrelated uniform changes don't cause recompilations
+	std::array<u32, 5> uniforms = {};
+	uniforms[0] = shaderUnit.boolUniform & usage.boolMask;
+	for (u32 i = 0; i < 4; i++) {
+		if (usage.intMask & (1u << i)) {
+			std::memcpy(&uniforms[i + 1], shaderUnit.intUniforms[i].data(), sizeof(u32));
+		}
+	}
+
+	return std::rotl(programHash, 2) ^ PICAHash::computeHash(reinterpret_cast<const char*>(uniforms.data()), sizeof(uniforms));
+}
+
+bool ShaderJIT::prepare(PICAShader& shaderUnit) {
+	shaderUnit.pc = shaderUnit.entrypoint;
+	const Hash hash = getShaderHash(shaderUnit);
+
+	if (backgroundCompilation) {
+		collectFinishedShaders();
+	}
+
 	auto it = cache.find(hash);
+	if (it != cache.end()) { // Block has been compiled and found, use it
+		it->second.lastUsedFrame = currentFrame;
+		setActiveShader(it->second.emitter.get(), shaderUnit.entrypoint);
+		frameStats.cacheHits++;
+		return true;
+	}
+
+	frameStats.cacheMisses++;
+	recordShader(hash, shaderUnit);
+
+	if (!backgroundCompilation) { // Block has not been compiled yet, compile it right away
+		auto emitter = allocateEmitter();
+		emitter->compile(shaderUnit, specializeUniforms);
+		setActiveShader(emitter.get(), shaderUnit.entrypoint);
+
+		insertShader(hash, std::move(emitter));
+		return true;
+	}
+
+	// Queue the shader for compilation unless it's already on its way. The compiler thread gets its own copy of the shader unit, as the
+	// uploaded code and operand descriptors may change before it gets to it
+	if (pendingShaders.insert(hash).second) {
+		{
+			std::unique_lock lock(compilerMutex);
+			compileQueue.push_back({hash, std::make_unique<PICAShader>(shaderUnit), specializeUniforms});
+		}
+
+		compilerWakeup.notify_one();
+	}
+
+	frameStats.interpretedDraws++;
+	return false;
+}
 
-	if (it == cache.end()) { // Block has not been compiled yet
-		auto emitter = std::make_unique<ShaderEmitter>();
-		emitter->compile(shaderUnit);
-		// Get pointer to callbacks
-		entrypointCallback = emitter->getInstructionCallback(shaderUnit.entrypoint);
-		prologueCallback = emitter->getPrologueCallback();
+void ShaderJIT::recordShader(Hash hash, const PICAShader& shaderUnit) {
+	if (!diskCachePath.has_value() || !recordedShaders.insert(hash).second) {
+		return;
+	}
+
+	u32 codeLength = PICAShader::maxInstructionCount;
+	while (codeLength > 0 && shaderUnit.loadedShader[codeLength - 1] == 0) {
+		codeLength--;
+	}
 
-		cache.emplace_hint(it, hash, std::move(emitter));
-	} else { // Block has been compiled and found, use it
-		auto emitter = it->second.get();
-		entrypointCallback = emitter->getInstructionCallback(shaderUnit.entrypoint);
-		prologueCallback = emitter->getPrologueCallback();
+	IOFile file(diskCachePath.value(), "ab");
+	if (!file.isOpen()) {
+		Helpers::warn("Failed to append to shader cache %s", diskCachePath->string().c_str());
+		return;
 	}
+
+	file.writeBytes(&codeLength, sizeof(u32));
+	file.writeBytes(shaderUnit.loadedShader.data(), codeLength * sizeof(u32));
+	file.writeBytes(shaderUnit.operandDescriptors.data(), ShaderDiskCache::opdescCount * sizeof(u32));
+	file.writeBytes(&shaderUnit.boolUniform, sizeof(u32));
+	file.writeBytes(shaderUnit.intUniforms.data(), ShaderDiskCache::intUniformSize);
+	file.close();
+}
+
+void ShaderJIT::loadDiskCache(const std::filesystem::path& path) {
+	std::vector<std::unique_ptr<PICAShader>> programs;
+	IOFile file(path, "rb");
+
+	if (file.isOpen()) {
+		u32 header[2] = {0, 0};
+		const bool validHeader =
+			file.readBytes(header, sizeof(header)).first && header[0] == ShaderDiskCache::magic && header[1] == ShaderDiskCache::version;
+
+		u32 codeLength;
+		while (validHeader && file.readBytes(&codeLength, sizeof(u32)).second == sizeof(u32)) {
+			if (codeLength > PICAShader::maxInstructionCount) {
+				Helpers::warn("Shader cache %s is corrupted, ignoring the rest of it", path.string().c_str());
+				break;
+			}
+
+			auto shader = std::make_unique<PICAShader>(ShaderType::Vertex);
+			shader->reset();
+
+			const bool success = file.readBytes(shader->loadedShader.data(), codeLength * sizeof(u32)).second == codeLength * sizeof(u32) &&
+				file.readBytes(shader->operandDescriptors.data(), ShaderDiskCache::opdescCount * sizeof(u32)).second ==
+					ShaderDiskCache::opdescCount * sizeof(u32) &&
+				file.readBytes(&shader->boolUniform, sizeof(u32)).second == sizeof(u32) &&
+				file.readBytes(shader->intUniforms.data(), ShaderDiskCache::intUniformSize).second == ShaderDiskCache::intUniformSize;
+			if (!success) {  // Truncated record, eg from a crash while writing it
+				break;
+			}
+
+			programs.push_back(std::move(shader));
+		}
+
+		file.close();
+
+		if (!validHeader) {
+			Helpers::warn("Shader cache %s has an unknown format, starting a new one", path.string().c_str());
+		}
+	}
+
+	// Rewrite the file with only the valid records, which also creates it if it didn't exist and drops truncated records
+	diskCachePath = std::nullopt;
+	if (file.open(path, "wb")) {
+		const u32 header[2] = {ShaderDiskCache::magic, ShaderDiskCache::version};
+		file.writeBytes(header, sizeof(header));
+		file.close();
+		diskCachePath = path;
+	} else {
+		Helpers::warn("Failed to create shader cache %s", path.string().c_str());
+	}
+
+	// Records that end up with the same cache key, eg a program recorded with different uniforms while specialization was on, are
+	// only kept and compiled once
+	std::vector<Hash> hashes;
+	std::unordered_set<Hash> seenHashes;
+	usize uniqueCount = 0;
+	for (usize i = 0; i < programs.size(); i++) {
+		const Hash hash = getShaderHash(*programs[i]);
+		if (!seenHashes.insert(hash).second) {
+			continue;
+		}
+
+		recordShader(hash, *programs[i]);
+		hashes.push_back(hash);
+		programs[uniqueCount++] = std::move(programs[i]);
+	}
+	programs.resize(uniqueCount);
+
+	// Compile every program ahead of time, spread across all available cores
+	std::vector<std::unique_ptr<ShaderEmitter>> emitters(programs.size());
+	for (auto& emitter : emitters) {
+		emitter = allocateEmitter();
+	}
+
+	ThreadPool compilerPool;
+	compilerPool.run([&](u32 index, u32 threadCount) {
+		for (usize i = index; i < programs.size(); i += threadCount) {
+			emitters[i]->compile(*programs[i], specializeUniforms);
+		}
+	});
+
+	for (usize i = 0; i < programs.size(); i++) {
+		insertShader(hashes[i], std::move(emitters[i]));
+	}
+
+	log("Precompiled %zu shaders from %s\n", programs.size(), path.string().c_str());
 }
-#endif // PANDA3DS_SHADER_JIT_SUPPORTED
\ No newline at end of file
+#endif // PANDA3DS_SHADER_JIT_SUPPORTED
@@ -26,7 +26,9 @@ static constexpr XReg scratch1 = X9;
 static constexpr XReg scratch2 = X10;
 static constexpr XReg statePointer = X15;
 
-void ShaderEmitter::compile(const PICAShader& shaderUnit) {
+void ShaderEmitter::compile(const PICAShader& shaderUnit, bool specializeUniforms) {
+	this->specializeUniforms = specializeUniforms;
+
 	oaknut::CodeBlock::unprotect();  // Unprotect the memory before writing to it
 
 	// Constants
@@ -1043,6 +1045,13 @@ void ShaderEmitter::recCALLC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recCALLU(const PICAShader& shader, u32 instruction) {
+	if (specializeUniforms) {
+		if (getBoolUniform(shader, instruction)) {
+			recCALL(shader, instruction);
+		}
+		return;
+	}
+
 	Label skipCall;
 
 	// z is 0 if the call should be taken, 1 otherwise
@@ -1079,8 +1088,6 @@ void ShaderEmitter::recIFC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
-	// z is 0 if true, else 1
-	checkBoolUniform(shader, instruction);
 	const u32 num = instruction & 0xff;
 	const u32 dest = getBits<10, 12>(instruction);
 
@@ -1089,8 +1096,19 @@ void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
 	}
 	Label elseBlock, endIf;
 
-	// Jump to else block if z is 1
-	B(EQ, elseBlock);
+	// With a known uniform, the untaken block is jumped over unconditionally. It still gets compiled, as other jumps or the
+	// entrypoint may point inside it
+	if (specializeUniforms) {
+		if (!getBoolUniform(shader, instruction)) {
+			B(elseBlock);
+		}
+	} else {
+		// z is 0 if true, else 1
+		checkBoolUniform(shader, instruction);
+		// Jump to else block if z is 1
+		B(EQ, elseBlock);
+	}
+
 	compileUntil(shader, dest);
 
 	if (num == 0) {  // Else block is empty,
@@ -1117,6 +1135,13 @@ void ShaderEmitter::recJMPU(const PICAShader& shader, u32 instruction) {
 	const u32 dest = getBits<10, 12>(instruction);
 
 	Label& l = instructionLabels[dest];
+	if (specializeUniforms) {
+		if (getBoolUniform(shader, instruction) != jumpIfFalse) {
+			B(l);
+		}
+		return;
+	}
+
 	// Z is 0 if the uniform is true
 	checkBoolUniform(shader, instruction);
 
@@ -1160,11 +1185,17 @@ void ShaderEmitter::recLOOP(const PICAShader& shader, u32 instruction) {
 	// Offset of the loop register
 	const uintptr_t loopRegOffset = uintptr_t(&shader.loopCounter) - uintptr_t(&shader);
 
-	LDRB(W0, statePointer, uniformOffset);                   // W0 = loop iteration count
-	LDRB(W1, statePointer, uniformOffset + sizeof(u8));      // W1 = initial loop counter value
-	LDRB(W2, statePointer, uniformOffset + 2 * sizeof(u8));  // W2 = Loop increment
+	if (specializeUniforms) {
+		MOV(W0, u32(uniform[0]) + 1);  // The iteration count is actually uniform.x + 1
+		MOV(W1, u32(uniform[1]));      // W1 = initial loop counter value
+		MOV(W2, u32(uniform[2]));      // W2 = Loop increment
+	} else {
+		LDRB(W0, statePointer, uniformOffset);                   // W0 = loop iteration count
+		LDRB(W1, statePointer, uniformOffset + sizeof(u8));      // W1 = initial loop counter value
+		LDRB(W2, statePointer, uniformOffset + 2 * sizeof(u8));  // W2 = Loop increment
+		ADD(W0, W0, 1);                                          // The iteration count is actually uniform.x + 1
+	}
 
-	ADD(W0, W0, 1);                        // The iteration count is actually uniform.x + 1
 	STR(W1, statePointer, loopRegOffset);  // Set loop counter
 
 	// Push loop iteration counter & loop increment
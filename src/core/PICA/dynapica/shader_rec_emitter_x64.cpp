@@ -37,7 +37,9 @@ static constexpr Reg64 statePointer = rdi;
 #error Unknown ABI for x86-64 shader JIT
 #endif
 
-void ShaderEmitter::compile(const PICAShader& shaderUnit) {
+void ShaderEmitter::compile(const PICAShader& shaderUnit, bool specializeUniforms) {
+	this->specializeUniforms = specializeUniforms;
+
 	// Constants
 	align(16);
 	L(negateVector);
@@ -818,8 +820,6 @@ void ShaderEmitter::recIFC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
-	// z is 0 if true, else 1
-	checkBoolUniform(shader, instruction);
 	const u32 num = instruction & 0xff;
 	const u32 dest = getBits<10, 12>(instruction);
 
@@ -828,8 +828,19 @@ void ShaderEmitter::recIFU(const PICAShader& shader, u32 instruction) {
 	}
 	Label elseBlock, endIf;
 
-	// Jump to else block if z is 1
-	jz(elseBlock, T_NEAR);
+	// With a known uniform, the untaken block is jumped over unconditionally. It still gets compiled, as other jumps or the
+	// entrypoint may point inside it
+	if (specializeUniforms) {
+		if (!getBoolUniform(shader, instruction)) {
+			jmp(elseBlock, T_NEAR);
+		}
+	} else {
+		// z is 0 if true, else 1
+		checkBoolUniform(shader, instruction);
+		// Jump to else block if z is 1
+		jz(elseBlock, T_NEAR);
+	}
+
 	compileUntil(shader, dest);
 
 	if (num == 0) { // Else block is empty,
@@ -868,6 +879,13 @@ void ShaderEmitter::recCALLC(const PICAShader& shader, u32 instruction) {
 }
 
 void ShaderEmitter::recCALLU(const PICAShader& shader, u32 instruction) {
+	if (specializeUniforms) {
+		if (getBoolUniform(shader, instruction)) {
+			recCALL(shader, instruction);
+		}
+		return;
+	}
+
 	Label skipCall;
 
 	// z is 0 if the call should be taken, 1 otherwise
@@ -892,6 +910,13 @@ void ShaderEmitter::recJMPU(const PICAShader& shader, u32 instruction) {
 	const u32 dest = getBits<10, 12>(instruction);
 
 	Label& l = instructionLabels[dest];
+	if (specializeUniforms) {
+		if (getBoolUniform(shader, instruction) != jumpIfFalse) {
+			jmp(l, T_NEAR);
+		}
+		return;
+	}
+
 	// Z is 0 if the uniform is true
 	checkBoolUniform(shader, instruction);
 
@@ -922,12 +947,18 @@ void ShaderEmitter::recLOOP(const PICAShader& shader, u32 instruction) {
 	// Offset of the loop register
 	const uintptr_t loopRegOffset = uintptr_t(&shader.loopCounter) - uintptr_t(&shader);
 
-	movzx(eax, byte[statePointer + uniformOffset]); // eax = loop iteration count
-	movzx(ecx, byte[statePointer + uniformOffset + sizeof(u8)]); // ecx = initial loop counter value
-	movzx(edx, byte[statePointer + uniformOffset + 2 * sizeof(u8)]); // edx = loop increment
+	if (specializeUniforms) {
+		mov(eax, u32(uniform[0]) + 1); // The iteration count is actually uniform.x + 1
+		mov(edx, u32(uniform[2]));     // edx = loop increment
+		mov(dword[statePointer + loopRegOffset], u32(uniform[1])); // Set loop counter
+	} else {
+		movzx(eax, byte[statePointer + uniformOffset]); // eax = loop iteration count
+		movzx(ecx, byte[statePointer + uniformOffset + sizeof(u8)]); // ecx = initial loop counter value
+		movzx(edx, byte[statePointer + uniformOffset + 2 * sizeof(u8)]); // edx = loop increment
 
-	add(eax, 1); // The iteration count is actually uniform.x + 1
-	mov(dword[statePointer + loopRegOffset], ecx); // Set loop counter
+		add(eax, 1); // The iteration count is actually uniform.x + 1
+		mov(dword[statePointer + loopRegOffset], ecx); // Set loop counter
+	}
 	
 	// TODO: This might break if an instruction in a loop decides to yield...
 	push(rax);  // Push loop iteration counter
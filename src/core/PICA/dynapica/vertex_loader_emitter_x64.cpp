@@ -0,0 +1,133 @@
+#if defined(PANDA3DS_DYNAPICA_SUPPORTED) && defined(PANDA3DS_X64_HOST)
+#include "PICA/dynapica/vertex_loader_emitter_x64.hpp"
+
+#include <cstddef>
+
+using namespace Xbyak;
+using namespace Xbyak::util;
+
+// The loader keeps all of its state in registers that are callee-saved on both the SysV and the MS ABI, so it only needs to
+// preserve them once in the prologue. Scratch work happens in rax, rdx, r11 and xmm0, which are volatile everywhere
+static constexpr Reg64 contextPointer = r12;
+static constexpr Reg64 indexPointer = r13;
+static constexpr Reg32 vertexCount = r14d;
+static constexpr Reg64 outputPointer = r15;
+static constexpr Reg64 vertexIndex = rbx;
+static constexpr Reg64 vertexPointer = r11;
+
+using Context = VertexLoaderJIT::Context;
+using InputRegisters = VertexLoaderJIT::InputRegisters;
+using vec4f = VertexLoaderJIT::vec4f;
+
+void VertexLoaderEmitter::compile(const Layout& layout) {
+	align(16);
+	callback = getCurr<VertexLoaderJIT::Callback>();
+
+	push(rbx);
+	push(r12);
+	push(r13);
+	push(r14);
+	push(r15);
+
+	mov(contextPointer, arg1.cvt64());
+	mov(indexPointer, arg2.cvt64());
+	mov(vertexCount, arg3);
+	mov(outputPointer, arg4.cvt64());
+
+	Label loop, end;
+	test(vertexCount, vertexCount);
+	jz(end);
+
+	L(loop);
+	mov(vertexIndex.cvt32(), dword[indexPointer]);  // Zero-extends the index to 64 bits
+
+	// Fetches from the same buffer are next to each other, so only recompute the vertex pointer when the buffer changes
+	u32 currentBuffer = ~0u;
+	for (u32 i = 0; i < layout.fetchCount; i++) {
+		const AttributeFetch& fetch = layout.fetches[i];
+
+		if (fetch.type != AttributeFetch::Type::Fixed && fetch.source != currentBuffer) {
+			currentBuffer = fetch.source;
+
+			mov(vertexPointer, qword[contextPointer + offsetof(Context, buffers) + currentBuffer * sizeof(u8*)]);
+			imul(rdx, vertexIndex, layout.strides[currentBuffer]);
+			add(vertexPointer, rdx);
+		}
+
+		emitFetch(fetch);
+	}
+
+	add(indexPointer, sizeof(u32));
+	add(outputPointer, sizeof(InputRegisters));
+	dec(vertexCount);
+	jnz(loop);
+
+	L(end);
+	pop(r15);
+	pop(r14);
+	pop(r13);
+	pop(r12);
+	pop(rbx);
+	ret();
+}
+
+void VertexLoaderEmitter::emitFetch(const AttributeFetch& fetch) {
+	using Type = AttributeFetch::Type;
+	const u32 outputOffset = fetch.inputRegister * sizeof(vec4f);
+
+	if (fetch.type == Type::Fixed) {
+		mov(rdx, qword[contextPointer + offsetof(Context, fixedAttributes)]);
+		movups(xmm0, xword[rdx + fetch.source * sizeof(vec4f)]);
+		movups(xword[outputPointer + outputOffset], xmm0);
+		return;
+	}
+
+	const RegExp source = vertexPointer + fetch.offset;
+
+	// Full vec4 attributes can be loaded and converted in one go
+	if (fetch.componentCount == 4) {
+		if (fetch.type == Type::Float) {
+			movups(xmm0, xword[source]);
+			movups(xword[outputPointer + outputOffset], xmm0);
+			return;
+		}
+
+		if (haveSSE4_1) {
+			switch (fetch.type) {
+				case Type::S8: pmovsxbd(xmm0, dword[source]); break;
+				case Type::U8: pmovzxbd(xmm0, dword[source]); break;
+				default: pmovsxwd(xmm0, qword[source]); break;
+			}
+
+			cvtdq2ps(xmm0, xmm0);
+			movups(xword[outputPointer + outputOffset], xmm0);
+			return;
+		}
+	}
+
+	for (u32 component = 0; component < 4; component++) {
+		const Address dest = dword[outputPointer + outputOffset + component * sizeof(float)];
+
+		// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0) for everything else
+		if (component >= fetch.componentCount) {
+			mov(dest, (component == 3) ? 0x3f800000 : 0);
+			continue;
+		}
+
+		switch (fetch.type) {
+			case Type::S8: movsx(eax, byte[source + component]); break;
+			case Type::U8: movzx(eax, byte[source + component]); break;
+			case Type::S16: movsx(eax, word[source + component * sizeof(s16)]); break;
+
+			default:  // Float, copy it over as-is
+				mov(eax, dword[source + component * sizeof(float)]);
+				mov(dest, eax);
+				continue;
+		}
+
+		cvtsi2ss(xmm0, eax);
+		movss(dest, xmm0);
+	}
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "PICA/dynapica/vertex_loader_rec.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+#include "PICA/dynapica/vertex_loader_emitter_x64.hpp"
+#endif
+
+using namespace Helpers;
+
+namespace {
+	using f24 = Floats::f24;
+	using vec4f = VertexLoaderJIT::vec4f;
+	using FetchFunction = void (*)(vec4f& out, const u8* source);
+
+	// Read "componentCount" components of type T and fill the remaining ones with 0.0 for x/y/z and 1.0 for w
+	template <typename T, u32 componentCount>
+	void fetchAttribute(vec4f& out, const u8* source) {
+		for (u32 i = 0; i < 4; i++) {
+			if (i < componentCount) {
+				T value;
+				std::memcpy(&value, source + i * sizeof(T), sizeof(T));
+				out[i] = f24::fromFloat32(static_cast<float>(value));
+			} else {
+				out[i] = f24::fromFloat32(i == 3 ? 1.0f : 0.0f);
+			}
+		}
+	}
+
+	template <typename T>
+	constexpr std::array<FetchFunction, 4> fetchFunctionsFor = {
+		&fetchAttribute<T, 1>,
+		&fetchAttribute<T, 2>,
+		&fetchAttribute<T, 3>,
+		&fetchAttribute<T, 4>,
+	};
+
+	// Indexed by [attribute type][component count - 1]
+	constexpr std::array<std::array<FetchFunction, 4>, 4> fetchFunctions = {
+		fetchFunctionsFor<s8>,
+		fetchFunctionsFor<u8>,
+		fetchFunctionsFor<s16>,
+		fetchFunctionsFor<float>,
+	};
+
+	constexpr std::array<u32, 4> attributeTypeSizes = {sizeof(s8), sizeof(u8), sizeof(s16), sizeof(float)};
+}  // namespace
+
+VertexLoaderJIT::VertexLoaderJIT() = default;
+VertexLoaderJIT::~VertexLoaderJIT() = default;
+
+void VertexLoaderJIT::reset() {
+	cache.clear();
+	activeLoader = nullptr;
+}
+
+void VertexLoaderJIT::prepare(const Config& config) {
+	const Hash hash = PICAHash::computeHash(reinterpret_cast<const char*>(&config), sizeof(Config));
+	auto it = cache.find(hash);
+
+	// Loader has been compiled and found, use it
+	if (it != cache.end() && it->second->config == config) [[likely]] {
+		activeLoader = it->second.get();
+		return;
+	}
+
+	auto loader = std::make_unique<Loader>();
+	loader->config = config;
+	loader->layout = decodeLayout(config);
+
+#ifdef PANDA3DS_VERTEX_LOADER_JIT_SUPPORTED
+	loader->emitter = std::make_unique<VertexLoaderEmitter>();
+	loader->emitter->compile(loader->layout);
+	loader->callback = loader->emitter->getCallback();
+#endif
+
+	activeLoader = loader.get();
+	cache[hash] = std::move(loader);
+}
+
+VertexLoaderJIT::Layout VertexLoaderJIT::decodeLayout(const Config& config) {
+	Layout layout;
+	// Where each attribute comes from, before applying the input register permutation
+	std::array<AttributeFetch, 16> attributes;
+	const u32 totalAttribCount = std::min<u32>(config.totalAttribCount, 16);
+	u32 attrCount = 0;
+	u32 buffer = 0;  // Vertex buffer index for non-fixed attributes
+
+	while (attrCount < totalAttribCount && buffer < maxAttribCount) {
+		// Check if attribute is fixed or not
+		if (config.fixedAttribMask & (1 << attrCount)) {
+			attributes[attrCount] = {AttributeFetch::Type::Fixed, 4, 0, u8(attrCount), 0};
+			attrCount++;
+			continue;
+		}
+
+		const u64 bufferConfig = config.bufferConfigs[buffer];
+		const u32 config2 = u32(bufferConfig >> 32);
+		const u32 componentCount = config2 >> 28;
+		u32 offset = 0;  // Offset of the current attribute from the start of the vertex
+
+		layout.strides[buffer] = getBits<16, 8>(config2);
+		for (u32 j = 0; j < componentCount && attrCount < 16; j++) {
+			const u32 index = (bufferConfig >> (j * 4)) & 0xf;  // Get index of attribute in vertexCfg
+
+			// Vertex attributes used as padding
+			// 12, 13, 14 and 15 are equivalent to 4, 8, 12 and 16 bytes of padding respectively
+			if (index >= 12) [[unlikely]] {
+				// Align attribute offset up to a 4 byte boundary
+				offset = (offset + 3) & ~3u;
+				offset += (index - 11) << 2;
+				continue;
+			}
+
+			const u32 attribInfo = (config.vertexCfg >> (index * 4)) & 0xf;
+			const u32 attribType = attribInfo & 0x3;  //  Type of attribute(sbyte/ubyte/short/float)
+			const u32 size = (attribInfo >> 2) + 1;   // Total number of components
+
+			attributes[attrCount++] = {AttributeFetch::Type(attribType), u8(size), 0, u8(buffer), offset};
+			offset += size * attributeTypeSizes[attribType];
+		}
+
+		buffer++;
+	}
+
+	// The PICA maps the fetched attributes from the attribute registers to the shader input registers
+	// Based on the SH_ATTRIBUTES_PERMUTATION registers. Ie it might attribute #0 to v2, #1 to v7, etc
+	// If several attributes go to the same register, the last one wins, so the fetches are kept in attribute order
+	for (u32 j = 0; j < attrCount; j++) {
+		AttributeFetch fetch = attributes[j];
+		fetch.inputRegister = u8((config.inputAttrCfg >> (j * 4)) & 0xf);
+		layout.fetches[layout.fetchCount++] = fetch;
+
+		if (fetch.type != AttributeFetch::Type::Fixed) {
+			const u32 end = fetch.offset + fetch.componentCount * attributeTypeSizes[u32(fetch.type)];
+			layout.vertexSizes[fetch.source] = std::max(layout.vertexSizes[fetch.source], end);
+		}
+	}
+
+	return layout;
+}
+
+void VertexLoaderJIT::interpretLayout(const Layout& layout, const Context& context, const u32* indices, u32 count, InputRegisters* output) {
+	for (u32 vertex = 0; vertex < count; vertex++) {
+		InputRegisters& inputs = output[vertex];
+		const u32 index = indices[vertex];
+
+		for (u32 i = 0; i < layout.fetchCount; i++) {
+			const AttributeFetch& fetch = layout.fetches[i];
+
+			if (fetch.type == AttributeFetch::Type::Fixed) {
+				inputs[fetch.inputRegister] = context.fixedAttributes[fetch.source];
+			} else {
+				const u8* source = context.buffers[fetch.source] + index * layout.strides[fetch.source] + fetch.offset;
+				fetchFunctions[u32(fetch.type)][fetch.componentCount - 1](inputs[fetch.inputRegister], source);
+			}
+		}
+	}
+}
@@ -1,7 +1,7 @@
 #include "PICA/gpu.hpp"
 
+#include <algorithm>
 #include <array>
-#include <bitset>
 #include <cstddef>
 #include <cstdio>
 
@@ -27,8 +27,22 @@ using namespace Floats;
 // Note: For when we have multiple backends, the GL state manager can stay here and have the constructor for the Vulkan-or-whatever renderer ignore it
 // Thus, our GLStateManager being here does not negatively impact renderer-agnosticness
 GPU::GPU(Memory& mem, EmulatorConfig& config) : mem(mem), config(config) {
-	vram = new u8[vramSize];
-	mem.setVRAM(vram);  // Give the bus a pointer to our VRAM
+	shaderJIT.setBackgroundCompilation(config.shaderJitBackgroundCompilation);
+	shaderJIT.setCacheLimit(config.shaderJitCacheLimit);
+	shaderJIT.setUniformSpecialization(config.shaderJitUniformSpecialization);
+
+	for (u32 i = 1; i < vertexThreadPool.getThreadCount(); i++) {
+		auto& worker = vertexWorkers.emplace_back();
+		worker.shader = std::make_unique<PICAShader>(ShaderType::Vertex);
+		worker.batch = std::make_unique<PICAShaderBatch>(*worker.shader);
+	}
+
+	// If guest memory is backed by host virtual memory, VRAM has already been allocated in the shared backing memory
+	vram = mem.getHostBackedVRAM();
+	if (vram == nullptr) {
+		vram = new u8[vramSize];
+		mem.setVRAM(vram);  // Give the bus a pointer to our VRAM
+	}
 
 	switch (config.rendererType) {
 		case RendererType::Null: {
@@ -64,9 +78,12 @@ void GPU::reset() {
 	regs.fill(0);
 	shaderUnit.reset();
 	shaderJIT.reset();
+	vertexLoader.reset();
+	vertexLoaderDirty = true;
 	std::memset(vram, 0, vramSize);
 	lightingLUT.fill(0);
 	lightingLUTDirty = true;
+	dirtyRegGroups = PICA::RegGroup::All;
 
 	totalAttribCount = 0;
 	fixedAttribMask = 0;
@@ -114,7 +131,8 @@ void GPU::reset() {
 // Call the correct version of drawArrays based on whether this is an indexed draw (first template parameter)
 // And whether we are going to use the shader JIT (second template parameter)
 void GPU::drawArrays(bool indexed) {
-	const bool shaderJITEnabled = ShaderJIT::isAvailable() && config.shaderJitEnabled;
+	// If the shader JIT is still compiling this shader in the background, the draw runs on the interpreter instead
+	const bool shaderJITEnabled = ShaderJIT::isAvailable() && config.shaderJitEnabled && shaderJIT.prepare(shaderUnit.vs);
 
 	if (indexed) {
 		if (shaderJITEnabled)
@@ -129,14 +147,20 @@ void GPU::drawArrays(bool indexed) {
 	}
 }
 
-static std::array<PICA::Vertex, Renderer::vertexBufferSize> vertices;
+// Indices into the shaded vertices for indexed draws, which is what gets sent to the renderer
+static std::array<u16, Renderer::vertexBufferSize> drawIndices;
+// Vertex indices (relative to the smallest index of the draw) of the vertices that need shading. Vertex #i of this array ends up as shaded vertex #i
+static std::array<u32, Renderer::vertexBufferSize> shadeIndices;
+
+// Post-transform vertex cache for indexed draws, covering the whole range of 16-bit indices and indexed by (index - minIndex)
+// An entry holds the position of the already shaded vertex in the draw's vertex buffer, and is only valid if its stamp matches the stamp of the current draw
+// This way the cache never needs to be cleared between draws
+static std::array<u32, 0x10000> vertexCacheStamps{};
+static std::array<u16, 0x10000> vertexCachePositions;
+static u32 vertexCacheStamp = 0;
 
 template <bool indexed, bool useShaderJIT>
 void GPU::drawArrays() {
-	if constexpr (useShaderJIT) {
-		shaderJIT.prepare(shaderUnit.vs);
-	}
-
 	setVsOutputMask(regs[PICA::InternalRegs::VertexShaderOutputMask]);
 
 	// Base address for vertex attributes
@@ -159,10 +183,6 @@ void GPU::drawArrays() {
 	u32 indexBufferPointer = vertexBase + (indexBufferConfig & 0xfffffff);
 	bool shortIndex = Helpers::getBit<31>(indexBufferConfig);  // Indicates whether vert indices are 16-bit or 8-bit
 
-	// Stuff the global attribute config registers in one u64 to make attr parsing easier
-	// TODO: Cache this when the vertex attribute format registers are written to
-	u64 vertexCfg = u64(regs[PICA::InternalRegs::AttribFormatLow]) | (u64(regs[PICA::InternalRegs::AttribFormatHigh]) << 32);
-
 	if constexpr (!indexed) {
 		u32 offset = regs[PICA::InternalRegs::VertexOffsetReg];
 		log("PICA::DrawArrays(vertex count = %d, vertexOffset = %d)\n", vertexCount, offset);
@@ -170,176 +190,194 @@ void GPU::drawArrays() {
 		log("PICA::DrawElements(vertex count = %d, index buffer config = %08X)\n", vertexCount, indexBufferConfig);
 	}
 
-	// Total number of input attributes to shader. Differs between GS and VS. Currently stubbed to the VS one, as we don't have geometry shaders.
-	const u32 inputAttrCount = (regs[PICA::InternalRegs::VertexShaderInputBufferCfg] & 0xf) + 1;
-	const u64 inputAttrCfg = getVertexShaderInputConfig();
-
-	// When doing indexed rendering, we have a cache of vertices to avoid processing attributes and shaders for a single vertex many times
-	constexpr bool vertexCacheEnabled = true;
-	constexpr size_t vertexCacheSize = 64;
-
-	struct {
-		std::bitset<vertexCacheSize> validBits{0};         // Shows which tags are valid. If the corresponding bit is 1, then there's an entry
-		std::array<u32, vertexCacheSize> ids;              // IDs (ie indices of the cached vertices in the 3DS vertex buffer)
-		std::array<u32, vertexCacheSize> bufferPositions;  // Positions of the cached vertices in our own vertex buffer
-	} vertexCache;
+	// The attribute fetch plan only needs to be looked up again if one of the attribute format registers changed since the last draw
+	if (vertexLoaderDirty) {
+		updateVertexLoader();
+	}
 
-	for (u32 i = 0; i < vertexCount; i++) {
-		u32 vertexIndex;  // Index of the vertex in the VBO for indexed rendering
+	// Find the range of vertices the draw reads, so that we can check it's backed by memory once instead of doing it for every vertex
+	const u8* indexBuffer8 = nullptr;
+	const u16* indexBuffer16 = nullptr;
+	u32 minIndex = 0;
+	u32 maxIndex = 0;
 
-		if constexpr (!indexed) {
-			vertexIndex = i + regs[PICA::InternalRegs::VertexOffsetReg];
+	const auto getIndex = [&](u32 i) -> u32 {
+		if constexpr (indexed) {
+			return shortIndex ? indexBuffer16[i] : indexBuffer8[i];
 		} else {
+			return i + regs[PICA::InternalRegs::VertexOffsetReg];
+		}
+	};
+
+	if (vertexCount != 0) {
+		if constexpr (indexed) {
 			if (shortIndex) {
-				auto ptr = getPointerPhys<u16>(indexBufferPointer);
-				vertexIndex = *ptr;  // TODO: This is very unsafe
-				indexBufferPointer += 2;
+				indexBuffer16 = getPointerPhys<u16>(indexBufferPointer, vertexCount * sizeof(u16));
 			} else {
-				auto ptr = getPointerPhys<u8>(indexBufferPointer);
-				vertexIndex = *ptr;  // TODO: This is also very unsafe
-				indexBufferPointer += 1;
+				indexBuffer8 = getPointerPhys<u8>(indexBufferPointer, vertexCount * sizeof(u8));
 			}
 		}
 
-		// Check if the vertex corresponding to the index is in cache
-		if constexpr (indexed && vertexCacheEnabled) {
-			auto& cache = vertexCache;
-			size_t tag = vertexIndex % vertexCacheSize;
-			// Cache hit
-			if (cache.validBits[tag] && cache.ids[tag] == vertexIndex) {
-				vertices[i] = vertices[cache.bufferPositions[tag]];
-				continue;
-			}
+		minIndex = maxIndex = getIndex(0);
+		for (u32 i = 1; i < vertexCount; i++) {
+			const u32 index = getIndex(i);
+			minIndex = std::min(minIndex, index);
+			maxIndex = std::max(maxIndex, index);
+		}
+	}
 
-			// Cache miss. Set cache entry, fetch attributes and run shaders as normal
-			else {
-				cache.validBits[tag] = true;
-				cache.ids[tag] = vertexIndex;
-				cache.bufferPositions[tag] = i;
-			}
+	VertexLoaderJIT::Context loaderContext;
+	loaderContext.fixedAttributes = shaderUnit.vs.fixedAttributes.data();
+	const VertexLoaderJIT::Layout& loaderLayout = vertexLoader.getLayout();
+
+	for (u32 buffer = 0; buffer < maxAttribCount; buffer++) {
+		const u32 vertexSize = loaderLayout.vertexSizes[buffer];
+		loaderContext.buffers[buffer] = nullptr;
+
+		if (vertexSize != 0 && vertexCount != 0) {
+			// The loader gets vertex indices relative to minIndex, so point it at vertex #minIndex
+			const u32 stride = loaderLayout.strides[buffer];
+			const u32 start = vertexBase + attributeInfo[buffer].offset + minIndex * stride;
+			loaderContext.buffers[buffer] = getPointerPhys<u8>(start, (maxIndex - minIndex) * stride + vertexSize);
 		}
+	}
 
-		int attrCount = 0;
-		int buffer = 0;  // Vertex buffer index for non-fixed attributes
-
-		while (attrCount < totalAttribCount) {
-			// Check if attribute is fixed or not
-			if (fixedAttribMask & (1 << attrCount)) {                         // Fixed attribute
-				vec4f& fixedAttr = shaderUnit.vs.fixedAttributes[attrCount];  // TODO: Is this how it works?
-				vec4f& inputAttr = currentAttributes[attrCount];
-				std::memcpy(&inputAttr, &fixedAttr, sizeof(vec4f));  // Copy fixed attr to input attr
-				attrCount++;
-			} else {                                 // Non-fixed attribute
-				auto& attr = attributeInfo[buffer];  // Get information for this attribute
-				u64 attrCfg = attr.getConfigFull();  // Get config1 | (config2 << 32)
-				u32 attrAddress = vertexBase + attr.offset + (vertexIndex * attr.size);
-
-				for (int j = 0; j < attr.componentCount; j++) {
-					uint index = (attrCfg >> (j * 4)) & 0xf;  // Get index of attribute in vertexCfg
-
-					// Vertex attributes used as padding
-					// 12, 13, 14 and 15 are equivalent to 4, 8, 12 and 16 bytes of padding respectively
-					if (index >= 12) [[unlikely]] {
-						// Align attribute address up to a 4 byte boundary
-						attrAddress = (attrAddress + 3) & -4;
-						attrAddress += (index - 11) << 2;
-						continue;
-					}
+	// Find out which vertices actually need to be shaded. For indexed draws, every vertex index is only shaded once
+	// and the draw is sent to the renderer as unique vertices + a 16-bit index buffer
+	u32 shadeCount = 0;
 
-					u32 attribInfo = (vertexCfg >> (index * 4)) & 0xf;
-					u32 attribType = attribInfo & 0x3;  //  Type of attribute(sbyte/ubyte/short/float)
-					u32 size = (attribInfo >> 2) + 1;   // Total number of components
-
-					// printf("vertex_attribute_strides[%d] = %d\n", attrCount, attr.size);
-					vec4f& attribute = currentAttributes[attrCount];
-					uint component;  // Current component
-
-					switch (attribType) {
-						case 0: {  // Signed byte
-							s8* ptr = getPointerPhys<s8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s8);
-							break;
-						}
-
-						case 1: {  // Unsigned byte
-							u8* ptr = getPointerPhys<u8>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(u8);
-							break;
-						}
-
-						case 2: {  // Short
-							s16* ptr = getPointerPhys<s16>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = static_cast<float>(*ptr++);
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(s16);
-							break;
-						}
-
-						case 3: {  // Float
-							float* ptr = getPointerPhys<float>(attrAddress);
-							for (component = 0; component < size; component++) {
-								float val = *ptr++;
-								attribute[component] = f24::fromFloat32(val);
-							}
-							attrAddress += size * sizeof(float);
-							break;
-						}
-
-						default: Helpers::panic("[PICA] Unimplemented attribute type %d", attribType);
-					}
+	if constexpr (indexed) {
+		if (++vertexCacheStamp == 0) [[unlikely]] {  // Stamp wrapped around, invalidate every entry for real
+			vertexCacheStamps.fill(0);
+			vertexCacheStamp = 1;
+		}
 
-					// Fill the remaining attribute lanes with default parameters (1.0 for alpha/w, 0.0) for everything else
-					// Corgi does this although I'm not sure if it's actually needed for anything.
-					// TODO: Find out
-					while (component < 4) {
-						attribute[component] = (component == 3) ? f24::fromFloat32(1.0) : f24::fromFloat32(0.0);
-						component++;
-					}
+		for (u32 i = 0; i < vertexCount; i++) {
+			const u32 index = getIndex(i) - minIndex;
 
-					attrCount++;
-				}
-				buffer++;
+			// Cache miss, queue the vertex for shading
+			if (vertexCacheStamps[index] != vertexCacheStamp) {
+				vertexCacheStamps[index] = vertexCacheStamp;
+				vertexCachePositions[index] = u16(shadeCount);
+				shadeIndices[shadeCount++] = index;
 			}
+
+			drawIndices[i] = vertexCachePositions[index];
+		}
+	} else {
+		for (u32 i = 0; i < vertexCount; i++) {
+			shadeIndices[i] = i;
 		}
 
-		// Before running the shader, the PICA maps the fetched attributes from the attribute registers to the shader input registers
-		// Based on the SH_ATTRIBUTES_PERMUTATION registers.
-		// Ie it might attribute #0 to v2, #1 to v7, etc
-		for (int j = 0; j < totalAttribCount; j++) {
-			const u32 mapping = (inputAttrCfg >> (j * 4)) & 0xf;
-			std::memcpy(&shaderUnit.vs.inputs[mapping], &currentAttributes[j], sizeof(vec4f));
+		shadeCount = vertexCount;
+	}
+
+	// Shade straight into the memory the renderer is going to draw from, which might be a buffer mapped by the graphics API
+	const std::span<PICA::Vertex> vertices = renderer->getVertexBuffer(shadeCount, indexed ? vertexCount : 0);
+
+	if (shadeCount < parallelVertexThreshold || vertexWorkers.empty()) {
+		shadeVertices<useShaderJIT>(shaderUnit.vs, shaderBatch, loaderContext, shadeIndices.data(), vertices.data(), shadeCount);
+	} else {
+		// Every worker gets its own copy of the vertex shader state. Uniforms and the compiled JIT code are the same for all of them
+		for (auto& worker : vertexWorkers) {
+			*worker.shader = shaderUnit.vs;
 		}
 
+		vertexThreadPool.run([&](u32 index, u32 threadCount) {
+			// Keep chunks a multiple of the batch size so that only the very last batch is partially filled
+			constexpr u32 laneCount = PICAShaderBatch::laneCount;
+			const u32 chunkSize = ((shadeCount + threadCount - 1) / threadCount + laneCount - 1) / laneCount * laneCount;
+			const u32 start = std::min(index * chunkSize, shadeCount);
+			const u32 count = std::min(chunkSize, shadeCount - start);
+
+			PICAShader& shader = (index == 0) ? shaderUnit.vs : *vertexWorkers[index - 1].shader;
+			PICAShaderBatch& batch = (index == 0) ? shaderBatch : *vertexWorkers[index - 1].batch;
+			shadeVertices<useShaderJIT>(shader, batch, loaderContext, &shadeIndices[start], vertices.data() + start, count);
+		});
+	}
+
+	if constexpr (indexed) {
+		renderer->drawIndexedVertices(primType, vertices, std::span(drawIndices).first(vertexCount));
+	} else {
+		renderer->drawVertices(primType, vertices);
+	}
+}
+
+// Find the vertex loader for the current attribute layout, or compile it if this is the first time we see it
+void GPU::updateVertexLoader() {
+	VertexLoaderJIT::Config loaderConfig;
+	// Stuff the global attribute config registers in one u64 to make attr parsing easier
+	loaderConfig.vertexCfg = u64(regs[PICA::InternalRegs::AttribFormatLow]) | (u64(regs[PICA::InternalRegs::AttribFormatHigh]) << 32);
+	loaderConfig.inputAttrCfg = getVertexShaderInputConfig();
+	loaderConfig.totalAttribCount = totalAttribCount;
+	loaderConfig.fixedAttribMask = fixedAttribMask;
+	for (u32 i = 0; i < maxAttribCount; i++) {
+		loaderConfig.bufferConfigs[i] = attributeInfo[i].getConfigFull();
+	}
+
+	vertexLoader.prepare(loaderConfig);
+	vertexLoaderDirty = false;
+}
+
+// Fetch and shade the vertices with the given indices and write them to output[0, count), using the given shader state
+// This may run on several threads at once, each with its own shader and its own output range
+template <bool useShaderJIT>
+void GPU::shadeVertices(
+	PICAShader& shader, PICAShaderBatch& batch, const VertexLoaderJIT::Context& context, const u32* indices, PICA::Vertex* output, u32 count
+) {
+	constexpr u32 batchCapacity = PICAShaderBatch::laneCount;
+	const u32 totalShaderOutputs = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
+
+	// Input registers the loader doesn't write keep their old value, same as when loading straight into the shader unit
+	std::array<VertexLoaderJIT::InputRegisters, batchCapacity> batchInputs;
+	batchInputs.fill(shader.inputs);
+
+	for (u32 first = 0; first < count; first += batchCapacity) {
+		const u32 batchSize = std::min(batchCapacity, count - first);
+		vertexLoader.load(context, &indices[first], batchSize, batchInputs.data());
+
 		if constexpr (useShaderJIT) {
-			shaderJIT.run(shaderUnit.vs);
+			for (u32 lane = 0; lane < batchSize; lane++) {
+				shader.inputs = batchInputs[lane];
+				shaderJIT.run(shader);
+
+				PICA::Vertex& out = output[first + lane];
+				// Map shader outputs to fixed function properties
+				for (int i = 0; i < totalShaderOutputs; i++) {
+					const u32 config = regs[PICA::InternalRegs::ShaderOutmap0 + i];
+					const vec4f& output = shader.outputs[vsOutputIndices[i]];
+
+					for (int j = 0; j < 4; j++) {  // pls unroll
+						const u32 mapping = (config >> (j * 8)) & 0x1F;
+						out.raw[mapping] = output[j];
+					}
+				}
+			}
 		} else {
-			shaderUnit.vs.run();
-		}
+			for (u32 lane = 0; lane < batchSize; lane++) {
+				for (u32 reg = 0; reg < 16; reg++) {
+					batch.setInput(lane, reg, batchInputs[lane][reg]);
+				}
+			}
+
+			batch.run(batchSize);
 
-		PICA::Vertex& out = vertices[i];
-		// Map shader outputs to fixed function properties
-		const u32 totalShaderOutputs = regs[PICA::InternalRegs::ShaderOutputCount] & 7;
-		for (int i = 0; i < totalShaderOutputs; i++) {
-			const u32 config = regs[PICA::InternalRegs::ShaderOutmap0 + i];
+			// Map shader outputs to fixed function properties
+			for (u32 lane = 0; lane < batchSize; lane++) {
+				PICA::Vertex& out = output[first + lane];
 
-			for (int j = 0; j < 4; j++) {  // pls unroll
-				const u32 mapping = (config >> (j * 8)) & 0x1F;
-				out.raw[mapping] = vsOutputRegisters[i][j];
+				for (int i = 0; i < totalShaderOutputs; i++) {
+					const u32 config = regs[PICA::InternalRegs::ShaderOutmap0 + i];
+					const vec4f output = batch.getOutput(lane, vsOutputIndices[i]);
+
+					for (int j = 0; j < 4; j++) {
+						const u32 mapping = (config >> (j * 8)) & 0x1F;
+						out.raw[mapping] = output[j];
+					}
+				}
 			}
 		}
 	}
-
-	renderer->drawVertices(primType, std::span(vertices).first(vertexCount));
 }
 
 PICA::Vertex GPU::getImmediateModeVertex() {
@@ -370,36 +408,26 @@ PICA::Vertex GPU::getImmediateModeVertex() {
 	return v;
 }
 
-void GPU::fireDMA(u32 dest, u32 source, u32 size) {
-	log("[GPU] DMA of %08X bytes from %08X to %08X\n", size, source, dest);
+void GPU::fireDMA(u32 dest, u32 sourceAddr, u32 size) {
+	log("[GPU] DMA of %08X bytes from %08X to %08X\n", size, sourceAddr, dest);
 	constexpr u32 vramStart = VirtualAddrs::VramStart;
 	constexpr u32 vramSize = VirtualAddrs::VramSize;
 
-	const u32 fcramStart = mem.getLinearHeapVaddr();
-	constexpr u32 fcramSize = VirtualAddrs::FcramTotalSize;
-
-	// Shows whether this transfer is an FCRAM->VRAM transfer that's trivially optimizable
-	bool cpuToVRAM = true;
-
 	if (dest - vramStart >= vramSize || size > (vramSize - (dest - vramStart))) [[unlikely]] {
-		cpuToVRAM = false;
 		Helpers::panic("GPU DMA does not target VRAM");
 	}
 
-	if (source - fcramStart >= fcramSize || size > (fcramSize - (dest - fcramStart))) [[unlikely]] {
-		cpuToVRAM = false;
-		// Helpers::panic("GPU DMA does not have FCRAM as its source");
-	}
+	// The source is a virtual address. If it's backed by contiguous host memory (eg the linear heap) we can copy it in one go.
+	// Otherwise, readBlock walks the page table and copies page by page. TODO: Is VRAM->VRAM DMA allowed?
+	u8* destPointer = &vram[dest - vramStart];
+	const std::span<u8> source = mem.getReadSpan(sourceAddr, size);
 
-	if (cpuToVRAM) [[likely]] {
-		// Valid, optimized FCRAM->VRAM DMA. TODO: Is VRAM->VRAM DMA allowed?
-		u8* fcram = mem.getFCRAM();
-		std::memcpy(&vram[dest - vramStart], &fcram[source - fcramStart], size);
+	if (!source.empty()) [[likely]] {
+		std::memcpy(destPointer, source.data(), size);
 	} else {
-		printf("Non-trivially optimizable GPU DMA. Falling back to byte-by-byte transfer\n");
-
-		for (u32 i = 0; i < size; i++) {
-			mem.write8(dest + i, mem.read8(source + i));
-		}
+		mem.readBlock(sourceAddr, destPointer, size);
 	}
+
+	// We wrote VRAM directly rather than through the memory write handlers, so let anything caching it know
+	mem.markPhysicalRangeWritten(PhysicalAddrs::VRAM + (dest - vramStart), size);
 }
@@ -76,6 +76,15 @@ u32 GPU::readInternalReg(u32 index) {
 	return regs[index];
 }
 
+// Register groups affected by each internal register, see PICA::RegGroup
+static constexpr std::array<u16, 0x200> regGroupTable = [] {
+	std::array<u16, 0x200> table{};
+	for (u32 i = 0; i < table.size(); i++) {
+		table[i] = u16(PICA::RegGroup::fromRegister(i));
+	}
+	return table;
+}();
+
 void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 	using namespace PICA::InternalRegs;
 
@@ -88,6 +97,10 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 	u32 newValue = (currentValue & ~mask) | (value & mask);  // Only overwrite the bits specified by "mask"
 	regs[index] = newValue;
 
+	if (newValue != currentValue && index < regGroupTable.size()) {
+		dirtyRegGroups |= regGroupTable[index];
+	}
+
 	// TODO: Figure out if things like the shader index use the unmasked value or the masked one
 	// We currently use the unmasked value like Citra does
 	switch (index) {
@@ -100,10 +113,16 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 			break;
 
 		case AttribFormatHigh:
-			totalAttribCount = (value >> 28) + 1;      // Total number of vertex attributes
-			fixedAttribMask = getBits<16, 12>(value);  // Determines which vertex attributes are fixed for all vertices
+			// Use the masked value here, as the vertex loader is built from and compared against the register contents
+			totalAttribCount = (newValue >> 28) + 1;      // Total number of vertex attributes
+			fixedAttribMask = getBits<16, 12>(newValue);  // Determines which vertex attributes are fixed for all vertices
+			vertexLoaderDirty |= newValue != currentValue;
 			break;
 
+		case AttribFormatLow:
+		case VertexShaderInputCfgLow:
+		case VertexShaderInputCfgHigh: vertexLoaderDirty |= newValue != currentValue; break;
+
 		case ColourBufferLoc: {
 			u32 loc = (value & 0x0fffffff) << 3;
 			renderer->setColourBufferLoc(loc);
@@ -346,8 +365,12 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 
 				switch (reg) {
 					case 0: attr.offset = value & 0xfffffff; break;  // Attribute offset
-					case 1: attr.config1 = value; break;
+					case 1:
+						vertexLoaderDirty |= attr.config1 != value;
+						attr.config1 = value;
+						break;
 					case 2:
+						vertexLoaderDirty |= attr.config2 != value;
 						attr.config2 = value;
 						attr.size = getBits<16, 8>(value);
 						attr.componentCount = value >> 28;
@@ -360,8 +383,8 @@ void GPU::writeInternalReg(u32 index, u32 value, u32 mask) {
 	}
 }
 
-void GPU::startCommandList(u32 addr, u32 size) {
-	cmdBuffStart = static_cast<u32*>(mem.getReadPointer(addr));
+void GPU::startCommandList(u32* buffer, u32 size) {
+	cmdBuffStart = buffer;
 	if (!cmdBuffStart) Helpers::panic("Couldn't get buffer for command list");
 	// TODO: This is very memory unsafe. We get a pointer to FCRAM and just keep writing without checking if we're gonna go OoB
 
@@ -409,4 +432,6 @@ void GPU::startCommandList(u32 addr, u32 size) {
 			writeInternalReg(id, param, mask);
 		}
 	}
+
+	renderer->flush();
 }
@@ -0,0 +1,594 @@
+#include "PICA/shader_batch.hpp"
+
+#include <cmath>
+
+using namespace Helpers;
+
+namespace {
+	// PICA gives 0 instead of NaN when multiplying by inf, same as f24::operator*
+	inline float picaMul(float a, float b) {
+		const float result = a * b;
+		return (result != result && a == a && b == b) ? 0.0f : result;
+	}
+}  // namespace
+
+void PICAShaderBatch::run(u32 count) {
+	allLanes = (count >= 32) ? ~0u : ((1u << count) - 1);
+
+	// The scalar interpreter doesn't reset registers between vertices, so start from whatever state it was left in
+	for (int reg = 0; reg < 16; reg++) {
+		for (int comp = 0; comp < 4; comp++) {
+			tempRegisters[reg][comp].v.fill(shader.tempRegisters[reg][comp].toFloat32());
+			outputs[reg][comp].v.fill(shader.outputs[reg][comp].toFloat32());
+		}
+	}
+
+	for (int i = 0; i < 2; i++) {
+		addrRegister[i].fill(shader.addrRegister[i]);
+		cmpRegister[i].fill(shader.cmpRegister[i]);
+	}
+	loopCounter = shader.loopCounter;
+
+	if (!runSIMD()) [[unlikely]] {
+		runScalar(count);
+		return;
+	}
+
+	// Leave the scalar state as if the last vertex of the batch had gone through PICAShader::run
+	const usize last = count - 1;
+	for (int reg = 0; reg < 16; reg++) {
+		for (int comp = 0; comp < 4; comp++) {
+			shader.tempRegisters[reg][comp] = f24::fromFloat32(tempRegisters[reg][comp][last]);
+			shader.outputs[reg][comp] = f24::fromFloat32(outputs[reg][comp][last]);
+		}
+	}
+
+	for (int i = 0; i < 2; i++) {
+		shader.addrRegister[i] = addrRegister[i][last];
+		shader.cmpRegister[i] = cmpRegister[i][last];
+	}
+	shader.loopCounter = loopCounter;
+}
+
+void PICAShaderBatch::runScalar(u32 count) {
+	for (u32 lane = 0; lane < count; lane++) {
+		for (int reg = 0; reg < 16; reg++) {
+			for (int comp = 0; comp < 4; comp++) {
+				shader.inputs[reg][comp] = f24::fromFloat32(inputs[reg][comp][lane]);
+			}
+		}
+
+		shader.run();
+
+		for (int reg = 0; reg < 16; reg++) {
+			for (int comp = 0; comp < 4; comp++) {
+				outputs[reg][comp][lane] = shader.outputs[reg][comp].toFloat32();
+			}
+		}
+	}
+}
+
+bool PICAShaderBatch::runSIMD() {
+	pc = shader.entrypoint;
+	activeMask = allLanes;
+	loopIndex = 0;
+	ifIndex = 0;
+	callIndex = 0;
+
+	while (true) {
+		const u32 instruction = shader.loadedShader[pc++];
+		const u32 opcode = instruction >> 26;  // Top 6 bits are the opcode
+
+		switch (opcode) {
+			// An END reached by only some of the lanes would need those lanes to be retired while the others keep going
+			case ShaderOpcodes::END: return activeMask == allLanes;
+			case ShaderOpcodes::NOP: break;
+
+			case ShaderOpcodes::CALL: call(instruction, activeMask); break;
+			case ShaderOpcodes::CALLC: {
+				const LaneMask mask = getConditionMask(instruction) & activeMask;
+				if (mask != 0) {
+					call(instruction, mask);
+				}
+				break;
+			}
+
+			case ShaderOpcodes::CALLU:
+				if (shader.boolUniform & (1 << getBits<22, 4>(instruction))) {
+					call(instruction, activeMask);
+				}
+				break;
+
+			case ShaderOpcodes::IFC: ifBlock(instruction, getConditionMask(instruction) & activeMask); break;
+			case ShaderOpcodes::IFU: ifBlock(instruction, (shader.boolUniform & (1 << getBits<22, 4>(instruction))) ? activeMask : 0); break;
+			case ShaderOpcodes::LOOP: loop(instruction); break;
+
+			// Jumps can leave the if/call block that masked-off lanes are waiting on, so only take them when no lanes are masked off
+			case ShaderOpcodes::JMPC: {
+				const LaneMask mask = getConditionMask(instruction) & activeMask;
+				if (mask != 0) {
+					if (mask != allLanes) {
+						return false;
+					}
+					pc = getBits<10, 12>(instruction);
+				}
+				break;
+			}
+
+			case ShaderOpcodes::JMPU: {
+				const u32 test = (instruction & 1) ^ 1;  // If the LSB is 0 we want to compare to true, otherwise compare to false
+				const u32 bit = getBits<22, 4>(instruction);
+
+				if (((shader.boolUniform >> bit) & 1) == test) {
+					if (activeMask != allLanes) {
+						return false;
+					}
+					pc = getBits<10, 12>(instruction);
+				}
+				break;
+			}
+
+			case ShaderOpcodes::CMP1:
+			case ShaderOpcodes::CMP2: cmp(instruction); break;
+			case ShaderOpcodes::MOVA: mova(instruction); break;
+
+			case 0x30:
+			case 0x31:
+			case 0x32:
+			case 0x33:
+			case 0x34:
+			case 0x35:
+			case 0x36:
+			case 0x37: mad(instruction, true); break;
+
+			case 0x38:
+			case 0x39:
+			case 0x3A:
+			case 0x3B:
+			case 0x3C:
+			case 0x3D:
+			case 0x3E:
+			case 0x3F: mad(instruction, false); break;
+
+			default: arithmetic(instruction, opcode); break;
+		}
+
+		// Handle control flow statements. The ordering is important as the priority goes: LOOP > IF > CALL
+		// Nested loops can end on the same instruction, so once a loop is over, the one it's nested in gets checked too
+		while (loopIndex != 0) {
+			auto& loop = loopInfo[loopIndex - 1];
+			if (pc != loop.endingPC) {  // Check if the loop needs to start over
+				break;
+			}
+
+			loopCounter += loop.increment;
+			loop.iterations -= 1;
+			if (loop.iterations != 0) {
+				pc = loop.startingPC;
+				break;
+			}
+
+			loopIndex -= 1;  // The loop ended, go one level down on the loop stack and carry on after it
+		}
+
+		if (ifIndex != 0) {
+			auto& info = conditionalInfo[ifIndex - 1];
+			if (pc == info.endingPC) {
+				if (info.elseMask != 0) {
+					// The lanes that took the if block are done, so run the else block (Which starts right here) for the others
+					activeMask = info.elseMask;
+					info.elseMask = 0;
+					info.endingPC = info.newPC;
+				}
+
+				if (pc == info.endingPC && info.elseMask == 0) {
+					pc = info.newPC;
+					activeMask = info.restoreMask;
+					ifIndex -= 1;
+				}
+			}
+		}
+
+		if (callIndex != 0) {
+			auto& info = callInfo[callIndex - 1];
+			if (pc == info.endingPC) {  // Check if the CALL block ended
+				pc = info.returnPC;
+				activeMask = info.restoreMask;
+				callIndex -= 1;
+			}
+		}
+	}
+}
+
+PICAShaderBatch::LaneMask PICAShaderBatch::getConditionMask(u32 instruction) {
+	const u32 condition = getBits<22, 2>(instruction);
+	const bool refY = getBit<24>(instruction) != 0;
+	const bool refX = getBit<25>(instruction) != 0;
+	LaneMask mask = 0;
+
+	for (usize lane = 0; lane < laneCount; lane++) {
+		const bool x = cmpRegister[0][lane] == refX;
+		const bool y = cmpRegister[1][lane] == refY;
+		bool result;
+
+		switch (condition) {
+			case 0: result = x || y; break;  // Either cmp register matches
+			case 1: result = x && y; break;  // Both cmp registers match
+			case 2: result = x; break;       // At least cmp.x matches
+			default: result = y; break;      // At least cmp.y matches
+		}
+
+		mask |= LaneMask(result) << lane;
+	}
+
+	return mask & allLanes;
+}
+
+void PICAShaderBatch::call(u32 instruction, LaneMask mask) {
+	if (callIndex >= 4) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed CALL stack");
+
+	const u32 num = instruction & 0xff;
+	const u32 dest = getBits<10, 12>(instruction);
+
+	auto& block = callInfo[callIndex++];
+	block.endingPC = dest + num;
+	block.returnPC = pc;
+	block.restoreMask = activeMask;
+
+	activeMask = mask;
+	pc = dest;
+}
+
+void PICAShaderBatch::ifBlock(u32 instruction, LaneMask mask) {
+	const u32 dest = getBits<10, 12>(instruction);
+
+	// No lane takes the if block, so everyone goes straight to the else block
+	if (mask == 0) {
+		pc = dest;
+		return;
+	}
+
+	if (ifIndex >= 8) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed IF stack");
+
+	const u32 num = instruction & 0xff;
+	auto& block = conditionalInfo[ifIndex++];
+	block.endingPC = dest;
+	block.newPC = dest + num;
+	block.restoreMask = activeMask;
+	block.elseMask = activeMask & ~mask;
+
+	activeMask = mask;
+}
+
+void PICAShaderBatch::loop(u32 instruction) {
+	if (loopIndex >= 4) [[unlikely]]
+		Helpers::panic("[PICA] Overflowed loop stack");
+
+	const u32 dest = getBits<10, 12>(instruction);
+	auto& uniform = shader.intUniforms[getBits<22, 2>(instruction)];  // The uniform we'll get loop info from
+	loopCounter = uniform[1];
+	auto& loop = loopInfo[loopIndex++];
+
+	loop.startingPC = pc;
+	loop.endingPC = dest + 1;  // Loop is inclusive so we need + 1 here
+	loop.iterations = uniform[0] + 1;
+	loop.increment = uniform[2];
+}
+
+void PICAShaderBatch::fetchSource(Register& out, u32 source, u32 index) {
+	// Read register "reg" for a single lane, the same way as PICAShader::getSource
+	const auto readLane = [&](u8 reg, usize lane) {
+		if (reg < 0x10) {
+			for (int comp = 0; comp < 4; comp++) out[comp][lane] = inputs[reg][comp][lane];
+		} else if (reg < 0x20) {
+			for (int comp = 0; comp < 4; comp++) out[comp][lane] = tempRegisters[reg - 0x10][comp][lane];
+		} else {
+			const usize floatIndex = (reg - 0x20) & 0x7f;
+			for (int comp = 0; comp < 4; comp++) {
+				out[comp][lane] = (floatIndex >= 96) ? 1.0f : shader.floatUniforms[floatIndex][comp].toFloat32();
+			}
+		}
+	};
+
+	// Relative addressing only applies to uniforms. With the address registers, every lane might read a different uniform
+	if (source >= 0x20 && (index == 1 || index == 2)) {
+		for (usize lane = 0; lane < laneCount; lane++) {
+			const s32 offset = addrRegister[index - 1][lane];
+			readLane((offset < -128 || offset > 127) ? u8(source) : u8(source + offset), lane);
+		}
+		return;
+	}
+
+	u8 reg = u8(source);
+	if (source >= 0x20 && index == 3) {
+		reg = u8(source + loopCounter);
+	}
+
+	if (reg < 0x10) {
+		out = inputs[reg];
+	} else if (reg < 0x20) {
+		out = tempRegisters[reg - 0x10];
+	} else {
+		const usize floatIndex = (reg - 0x20) & 0x7f;
+		for (int comp = 0; comp < 4; comp++) {
+			out[comp].v.fill((floatIndex >= 96) ? 1.0f : shader.floatUniforms[floatIndex][comp].toFloat32());
+		}
+	}
+}
+
+template <int sourceIndex>
+void PICAShaderBatch::getSourceSwizzled(Register& out, u32 source, u32 index, u32 opDescriptor) {
+	u32 compSwizzle;
+	bool negate;
+
+	if constexpr (sourceIndex == 1) {  // SRC1
+		negate = (getBit<4>(opDescriptor)) != 0;
+		compSwizzle = getBits<5, 8>(opDescriptor);
+	} else if constexpr (sourceIndex == 2) {  // SRC2
+		negate = (getBit<13>(opDescriptor)) != 0;
+		compSwizzle = getBits<14, 8>(opDescriptor);
+	} else if constexpr (sourceIndex == 3) {  // SRC3
+		negate = (getBit<22>(opDescriptor)) != 0;
+		compSwizzle = getBits<23, 8>(opDescriptor);
+	}
+
+	Register fetched;
+	fetchSource(fetched, source, index);
+
+	// Swizzling whole component arrays, so this is just a permutation of 4 copies
+	for (int comp = 0; comp < 4; comp++) {
+		out[3 - comp] = fetched[compSwizzle & 3];
+		compSwizzle >>= 2;
+	}
+
+	if (negate) {
+		for (int comp = 0; comp < 4; comp++) {
+			for (usize lane = 0; lane < laneCount; lane++) {
+				out[comp][lane] = -out[comp][lane];
+			}
+		}
+	}
+}
+
+PICAShaderBatch::Register& PICAShaderBatch::getDest(u32 dest) {
+	if (dest < 0x10) {
+		return outputs[dest];
+	} else if (dest < 0x20) {
+		return tempRegisters[dest - 0x10];
+	}
+	Helpers::panic("[PICA] Unimplemented dest: %X", dest);
+}
+
+void PICAShaderBatch::writeDest(Register& dest, const Register& value, u32 componentMask) {
+	std::array<bool, laneCount> active;
+	for (usize lane = 0; lane < laneCount; lane++) {
+		active[lane] = (activeMask >> lane) & 1;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		if (componentMask & (1 << i)) {
+			const int comp = 3 - i;
+			for (usize lane = 0; lane < laneCount; lane++) {
+				dest[comp][lane] = active[lane] ? value[comp][lane] : dest[comp][lane];
+			}
+		}
+	}
+}
+
+void PICAShaderBatch::arithmetic(u32 instruction, u32 opcode) {
+	using namespace ShaderOpcodes;
+
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	const u32 idx = getBits<19, 2>(instruction);
+	const u32 dest = getBits<21, 5>(instruction);
+	const bool inverted = opcode == DPHI || opcode == SGEI || opcode == SLTI;
+
+	switch (opcode) {
+		case ADD:
+		case DP3:
+		case DP4:
+		case DPHI:
+		case EX2:
+		case FLR:
+		case LG2:
+		case MAX:
+		case MIN:
+		case MOV:
+		case MUL:
+		case RCP:
+		case RSQ:
+		case SGE:
+		case SGEI:
+		case SLT:
+		case SLTI: break;
+
+		default: Helpers::panic("Unimplemented PICA instruction %08X (Opcode = %02X)", instruction, opcode);
+	}
+
+	if (idx && (opcode == MAX || opcode == MIN || opcode == RCP || opcode == RSQ)) {
+		Helpers::panic("[PICA] Batched shader: idx != 0 for opcode %02X", opcode);
+	}
+
+	// Inverted instructions take the indexed 7-bit source as src2 instead of src1
+	Register a, b, result;
+	if (inverted) {
+		getSourceSwizzled<1>(a, getBits<14, 5>(instruction), 0, operandDescriptor);
+		getSourceSwizzled<2>(b, getBits<7, 7>(instruction), idx, operandDescriptor);
+	} else {
+		getSourceSwizzled<1>(a, getBits<12, 7>(instruction), idx, operandDescriptor);
+		getSourceSwizzled<2>(b, getBits<7, 5>(instruction), 0, operandDescriptor);
+	}
+
+	switch (opcode) {
+		case ADD:
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = a[c][l] + b[c][l];
+			break;
+
+		case MUL:
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = picaMul(a[c][l], b[c][l]);
+			break;
+
+		case DP3:
+		case DP4:
+		case DPHI:
+			for (usize l = 0; l < laneCount; l++) {
+				float dot = picaMul(a[0][l], b[0][l]) + picaMul(a[1][l], b[1][l]) + picaMul(a[2][l], b[2][l]);
+				if (opcode == DP4) {
+					dot += picaMul(a[3][l], b[3][l]);
+				} else if (opcode == DPHI) {
+					// srcVec1[3] is supposed to be replaced with 1.0 in the dot product, so we just add b.w without multiplying it
+					dot += b[3][l];
+				}
+
+				result[0][l] = result[1][l] = result[2][l] = result[3][l] = dot;
+			}
+			break;
+
+		case SGE:
+		case SGEI:
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = (a[c][l] >= b[c][l]) ? 1.0f : 0.0f;
+			break;
+
+		case SLT:
+		case SLTI:
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = (a[c][l] < b[c][l]) ? 1.0f : 0.0f;
+			break;
+
+		case FLR:
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = std::floor(a[c][l]);
+			break;
+
+		case MAX:
+			// max(NaN, 2.f) -> NaN, max(2.f, NaN) -> 2
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = std::isinf(b[c][l]) ? b[c][l] : (b[c][l] < a[c][l] ? a[c][l] : b[c][l]);
+			break;
+
+		case MIN:
+			// min(NaN, 2.f) -> NaN, min(2.f, NaN) -> 2
+			for (int c = 0; c < 4; c++)
+				for (usize l = 0; l < laneCount; l++) result[c][l] = (a[c][l] < b[c][l]) ? a[c][l] : b[c][l];
+			break;
+
+		case MOV: result = a; break;
+
+		// These only operate on the x component and broadcast the result
+		case RCP:
+		case RSQ:
+		case EX2:
+		case LG2:
+			for (usize l = 0; l < laneCount; l++) {
+				float input = a[0][l];
+				float value;
+
+				switch (opcode) {
+					case RCP:
+						if (input == -0.0f) input = 0.0f;
+						value = 1.0f / input;
+						break;
+
+					case RSQ:
+						if (input == -0.0f) input = 0.0f;
+						value = 1.0f / std::sqrt(input);
+						break;
+
+					case EX2: value = std::exp2(input); break;
+					default: value = std::log2(input); break;
+				}
+
+				result[0][l] = result[1][l] = result[2][l] = result[3][l] = value;
+			}
+			break;
+	}
+
+	writeDest(getDest(dest), result, operandDescriptor & 0xf);
+}
+
+void PICAShaderBatch::mad(u32 instruction, bool inverted) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x1f];
+	const u32 src1 = getBits<17, 5>(instruction);
+	const u32 idx = getBits<22, 2>(instruction);
+	const u32 dest = getBits<24, 5>(instruction);
+
+	// MADI has the indexed 7-bit source in src3 instead of src2
+	Register a, b, c;
+	getSourceSwizzled<1>(a, src1, 0, operandDescriptor);
+	if (inverted) {
+		getSourceSwizzled<2>(b, getBits<12, 5>(instruction), 0, operandDescriptor);
+		getSourceSwizzled<3>(c, getBits<5, 7>(instruction), idx, operandDescriptor);
+	} else {
+		getSourceSwizzled<2>(b, getBits<10, 7>(instruction), idx, operandDescriptor);
+		getSourceSwizzled<3>(c, getBits<5, 5>(instruction), 0, operandDescriptor);
+	}
+
+	Register result;
+	for (int comp = 0; comp < 4; comp++) {
+		for (usize lane = 0; lane < laneCount; lane++) {
+			result[comp][lane] = picaMul(a[comp][lane], b[comp][lane]) + c[comp][lane];
+		}
+	}
+
+	writeDest(getDest(dest), result, operandDescriptor & 0xf);
+}
+
+void PICAShaderBatch::cmp(u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	const u32 idx = getBits<19, 2>(instruction);
+	const u32 cmpOperations[2] = {getBits<24, 3>(instruction), getBits<21, 3>(instruction)};
+
+	if (idx) Helpers::panic("[PICA] CMP: idx != 0");
+	Register a, b;
+	getSourceSwizzled<1>(a, getBits<12, 7>(instruction), 0, operandDescriptor);
+	getSourceSwizzled<2>(b, getBits<7, 5>(instruction), 0, operandDescriptor);
+
+	for (int i = 0; i < 2; i++) {
+		for (usize lane = 0; lane < laneCount; lane++) {
+			if (((activeMask >> lane) & 1) == 0) {
+				continue;
+			}
+
+			const float x = a[i][lane];
+			const float y = b[i][lane];
+			bool result;
+
+			switch (cmpOperations[i]) {
+				case 0: result = x == y; break;  // Equal
+				case 1: result = x != y; break;  // Not equal
+				case 2: result = x < y; break;   // Less than
+				case 3: result = x <= y; break;  // Less than or equal
+				case 4: result = x > y; break;   // Greater than
+				case 5: result = x >= y; break;  // Greater than or equal
+				default: result = true; break;
+			}
+
+			cmpRegister[i][lane] = result;
+		}
+	}
+}
+
+void PICAShaderBatch::mova(u32 instruction) {
+	const u32 operandDescriptor = shader.operandDescriptors[instruction & 0x7f];
+	const u32 idx = getBits<19, 2>(instruction);
+	const u32 componentMask = operandDescriptor & 0xf;
+
+	Register source;
+	getSourceSwizzled<1>(source, getBits<12, 7>(instruction), idx, operandDescriptor);
+
+	for (usize lane = 0; lane < laneCount; lane++) {
+		if (((activeMask >> lane) & 1) == 0) {
+			continue;
+		}
+
+		if (componentMask & 0b1000)  // x component
+			addrRegister[0][lane] = static_cast<s32>(source[0][lane]);
+		if (componentMask & 0b0100)  // y component
+			addrRegister[1][lane] = static_cast<s32>(source[1][lane]);
+	}
+}
@@ -79,16 +79,21 @@ void PICAShader::run() {
 
 		// Handle control flow statements. The ordering is important as the priority goes: LOOP > IF > CALL
 		// Handle loop
-		if (loopIndex != 0) {
+		// Nested loops can end on the same instruction, so once a loop is over, the one it's nested in gets checked too
+		while (loopIndex != 0) {
 			auto& loop = loopInfo[loopIndex - 1];
-			if (pc == loop.endingPC) {  // Check if the loop needs to start over
-				loop.iterations -= 1;
-				if (loop.iterations == 0)  // If the loop ended, go one level down on the loop stack
-					loopIndex -= 1;
+			if (pc != loop.endingPC) {  // Check if the loop needs to start over
+				break;
+			}
 
-				loopCounter += loop.increment;
+			loopCounter += loop.increment;
+			loop.iterations -= 1;
+			if (loop.iterations != 0) {
 				pc = loop.startingPC;
+				break;
 			}
+
+			loopIndex -= 1;  // The loop ended, go one level down on the loop stack and carry on after it
 		}
 
 		// Handle ifs
@@ -31,6 +31,7 @@ void PICAShader::reset() {
 
 	addrRegister[0] = 0;
 	addrRegister[1] = 0;
+	cmpRegister[0] = cmpRegister[1] = false;
 	loopCounter = 0;
 
 	codeHashDirty = true;
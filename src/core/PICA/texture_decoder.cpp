@@ -0,0 +1,338 @@
+#include "PICA/texture_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "colour.hpp"
+
+using namespace Helpers;
+using PICA::TextureFmt;
+
+namespace {
+	// https://en.wikipedia.org/wiki/Z-order_curve
+	// Texels in an 8x8 tile are stored in Morton order, ie the bits of the in-tile index alternate between u and v:
+	// u is made of bits 0, 2 and 4, and v of bits 1, 3 and 5. This table maps texel indices back to their (u, v) in the tile
+	constexpr std::array<std::array<u8, 2>, 64> tilePositions = [] {
+		std::array<std::array<u8, 2>, 64> positions{};
+		for (u32 i = 0; i < 64; i++) {
+			const u32 u = (i & 1) | ((i >> 1) & 2) | ((i >> 2) & 4);
+			const u32 v = ((i >> 1) & 1) | ((i >> 2) & 2) | ((i >> 3) & 4);
+			positions[i] = {u8(u), u8(v)};
+		}
+		return positions;
+	}();
+
+	// Returns the index of texel (u, v) inside its 8x8 tile
+	u32 mortonInterleave(u32 u, u32 v) {
+		static constexpr u32 xOffsets[] = {0, 1, 4, 5, 16, 17, 20, 21};
+		static constexpr u32 yOffsets[] = {0, 2, 8, 10, 32, 34, 40, 42};
+
+		return xOffsets[u & 7] + yOffsets[v & 7];
+	}
+
+	constexpr u32 bitsPerTexel(TextureFmt format) {
+		switch (format) {
+			case TextureFmt::RGBA8: return 32;
+			case TextureFmt::RGB8: return 24;
+
+			case TextureFmt::RGBA5551:
+			case TextureFmt::RGB565:
+			case TextureFmt::RGBA4:
+			case TextureFmt::RG8:
+			case TextureFmt::IA8: return 16;
+
+			case TextureFmt::A8:
+			case TextureFmt::I8:
+			case TextureFmt::IA4:
+			case TextureFmt::ETC1A4: return 8;
+
+			case TextureFmt::I4:
+			case TextureFmt::A4:
+			case TextureFmt::ETC1: return 4;
+
+			default: return 0;
+		}
+	}
+
+	u16 read16(const u8* ptr) { return u16(ptr[0]) | (u16(ptr[1]) << 8); }
+
+	// Convert texel number "index" of the 8x8 tile at "tile" to ABGR8888
+	template <TextureFmt format>
+	u32 convertTexel(const u8* tile, u32 index) {
+		constexpr u32 bytesPerTexel = bitsPerTexel(format) / 8;
+		const u8* texel = tile + index * bytesPerTexel;
+
+		if constexpr (format == TextureFmt::RGBA8) {
+			return (u32(texel[0]) << 24) | (u32(texel[1]) << 16) | (u32(texel[2]) << 8) | u32(texel[3]);
+		} else if constexpr (format == TextureFmt::RGB8) {
+			return (0xffu << 24) | (u32(texel[0]) << 16) | (u32(texel[1]) << 8) | u32(texel[2]);
+		} else if constexpr (format == TextureFmt::RGBA5551) {
+			const u16 value = read16(texel);
+			const u32 alpha = getBit<0>(value) ? 0xff : 0;
+			const u32 b = Colour::convert5To8Bit(getBits<1, 5, u8>(value));
+			const u32 g = Colour::convert5To8Bit(getBits<6, 5, u8>(value));
+			const u32 r = Colour::convert5To8Bit(getBits<11, 5, u8>(value));
+
+			return (alpha << 24) | (b << 16) | (g << 8) | r;
+		} else if constexpr (format == TextureFmt::RGB565) {
+			const u16 value = read16(texel);
+			const u32 b = Colour::convert5To8Bit(getBits<0, 5, u8>(value));
+			const u32 g = Colour::convert6To8Bit(getBits<5, 6, u8>(value));
+			const u32 r = Colour::convert5To8Bit(getBits<11, 5, u8>(value));
+
+			return (0xffu << 24) | (b << 16) | (g << 8) | r;
+		} else if constexpr (format == TextureFmt::RGBA4) {
+			const u16 value = read16(texel);
+			const u32 alpha = Colour::convert4To8Bit(getBits<0, 4, u8>(value));
+			const u32 b = Colour::convert4To8Bit(getBits<4, 4, u8>(value));
+			const u32 g = Colour::convert4To8Bit(getBits<8, 4, u8>(value));
+			const u32 r = Colour::convert4To8Bit(getBits<12, 4, u8>(value));
+
+			return (alpha << 24) | (b << 16) | (g << 8) | r;
+		} else if constexpr (format == TextureFmt::RG8) {
+			// Blue is always 0
+			return (0xffu << 24) | (u32(texel[0]) << 8) | u32(texel[1]);
+		} else if constexpr (format == TextureFmt::IA8) {
+			// Intensity formats just copy the intensity value to every colour channel
+			const u32 intensity = texel[1];
+			return (u32(texel[0]) << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		} else if constexpr (format == TextureFmt::I8) {
+			const u32 intensity = texel[0];
+			return (0xffu << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		} else if constexpr (format == TextureFmt::A8) {
+			// Alpha formats set RGB to 0
+			return u32(texel[0]) << 24;
+		} else if constexpr (format == TextureFmt::IA4) {
+			const u32 alpha = Colour::convert4To8Bit(texel[0] & 0xf);
+			const u32 intensity = Colour::convert4To8Bit(texel[0] >> 4);
+			return (alpha << 24) | (intensity << 16) | (intensity << 8) | intensity;
+		} else {
+			static_assert(format == TextureFmt::I4 || format == TextureFmt::A4, "ETC textures are decoded a block at a time");
+			// 2 texels per byte, with odd texels (which have an odd u) in the top 4 bits
+			const u8 nibble = (tile[index / 2] >> ((index & 1) ? 4 : 0)) & 0xf;
+			const u32 value = Colour::convert4To8Bit(nibble);
+
+			if constexpr (format == TextureFmt::I4) {
+				return (0xffu << 24) | (value << 16) | (value << 8) | value;
+			} else {
+				return value << 24;
+			}
+		}
+	}
+
+	// ETC1(A4) splits every 8x8 tile into 4 4x4 blocks, each of which has a 64-bit colour word
+	// ETC1A4 blocks have an extra 64-bit word with 4 bits of alpha per texel before the colour data
+	// Everything the texels of a block share is parsed once, so that decoding a texel is a couple of table lookups and a clamp
+	struct ETCBlock {
+		u64 alphaData;
+		u32 subindices;
+		u32 negationFlags;
+		bool flip;
+		std::array<std::array<s32, 3>, 2> colours;  // Base RGB of both halves of the block
+		std::array<s32, 4> modifiers;               // Indexed by half * 2 + modifier index
+	};
+
+	constexpr u32 signExtend3To32(u32 val) { return (u32)(s32(val) << 29 >> 29); }
+
+	template <bool hasAlpha>
+	ETCBlock parseETCBlock(const u8* data) {
+		static constexpr s32 modifierTable[8][2] = {
+			{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183},
+		};
+
+		ETCBlock block;
+		block.alphaData = ~0ull;  // ETC1 without alpha uses 0xff for every texel
+
+		if constexpr (hasAlpha) {
+			std::memcpy(&block.alphaData, data, sizeof(u64));
+			data += sizeof(u64);
+		}
+
+		u64 colourData;
+		std::memcpy(&colourData, data, sizeof(u64));
+
+		block.subindices = getBits<0, 16, u32>(colourData);
+		block.negationFlags = getBits<16, 16, u32>(colourData);
+		block.flip = getBit<32>(colourData);
+
+		// Note: index1 is indeed stored on the higher bits, with index2 in the lower bits
+		const u32 tableIndex1 = getBits<37, 3, u32>(colourData);
+		const u32 tableIndex2 = getBits<34, 3, u32>(colourData);
+		block.modifiers = {modifierTable[tableIndex1][0], modifierTable[tableIndex1][1], modifierTable[tableIndex2][0], modifierTable[tableIndex2][1]};
+
+		if (getBit<33>(colourData)) {  // Differential mode: The second colour is stored as a delta from the first one
+			const s32 r = getBits<59, 5, s32>(colourData);
+			const s32 g = getBits<51, 5, s32>(colourData);
+			const s32 b = getBits<43, 5, s32>(colourData);
+			const s32 r2 = r + s32(signExtend3To32(getBits<56, 3, u32>(colourData)));
+			const s32 g2 = g + s32(signExtend3To32(getBits<48, 3, u32>(colourData)));
+			const s32 b2 = b + s32(signExtend3To32(getBits<40, 3, u32>(colourData)));
+
+			block.colours[0] = {Colour::convert5To8Bit(r), Colour::convert5To8Bit(g), Colour::convert5To8Bit(b)};
+			block.colours[1] = {Colour::convert5To8Bit(r2), Colour::convert5To8Bit(g2), Colour::convert5To8Bit(b2)};
+		} else {
+			block.colours[0] = {
+				Colour::convert4To8Bit(getBits<60, 4, u8>(colourData)),
+				Colour::convert4To8Bit(getBits<52, 4, u8>(colourData)),
+				Colour::convert4To8Bit(getBits<44, 4, u8>(colourData)),
+			};
+			block.colours[1] = {
+				Colour::convert4To8Bit(getBits<56, 4, u8>(colourData)),
+				Colour::convert4To8Bit(getBits<48, 4, u8>(colourData)),
+				Colour::convert4To8Bit(getBits<40, 4, u8>(colourData)),
+			};
+		}
+
+		return block;
+	}
+
+	// Decode texel (u, v) of a parsed block. Texels are numbered in column-major order, ie index = u * 4 + v
+	u32 getETCTexel(const ETCBlock& block, u32 u, u32 v) {
+		const u32 index = u * 4 + v;
+		// The block is split in 2 halves either vertically or horizontally (flipped), each with its own base colour and modifiers
+		const u32 half = (block.flip ? v : u) >> 1;
+		const s32 modifier = block.modifiers[half * 2 + ((block.subindices >> index) & 1)];
+		const s32 negate = -s32((block.negationFlags >> index) & 1);  // All ones if the modifier is negated, 0 otherwise
+		const s32 signedModifier = (modifier ^ negate) - negate;
+
+		const auto& colour = block.colours[half];
+		const u32 r = u32(std::clamp(colour[0] + signedModifier, 0, 255));
+		const u32 g = u32(std::clamp(colour[1] + signedModifier, 0, 255));
+		const u32 b = u32(std::clamp(colour[2] + signedModifier, 0, 255));
+		const u32 alpha = Colour::convert4To8Bit((block.alphaData >> (4 * index)) & 0xf);
+
+		return (alpha << 24) | (b << 16) | (g << 8) | r;
+	}
+
+	// Decode a whole 4x4 block. The per-texel work is branchless and goes through a fixed-size array, so the compiler can vectorize it
+	template <bool hasAlpha>
+	void decodeETCBlock(const u8* data, u32* output, u32 stride) {
+		const ETCBlock block = parseETCBlock<hasAlpha>(data);
+		std::array<u32, 16> texels;
+
+		for (u32 index = 0; index < 16; index++) {
+			texels[index] = getETCTexel(block, index / 4, index % 4);
+		}
+
+		for (u32 index = 0; index < 16; index++) {
+			output[(index % 4) * stride + index / 4] = texels[index];
+		}
+	}
+
+	template <TextureFmt format>
+	void decodeTiles(u32 width, u32 height, const u8* data, u32* output) {
+		constexpr bool isETC = format == TextureFmt::ETC1 || format == TextureFmt::ETC1A4;
+		constexpr u32 tileSize = 64 * bitsPerTexel(format) / 8;
+
+		for (u32 tileY = 0; tileY < height; tileY += 8) {
+			for (u32 tileX = 0; tileX < width; tileX += 8) {
+				u32* tileOutput = output + tileY * width + tileX;
+
+				if constexpr (isETC) {
+					// The 4 blocks of a tile are stored left to right, top to bottom
+					constexpr bool hasAlpha = format == TextureFmt::ETC1A4;
+					constexpr u32 blockSize = tileSize / 4;
+
+					for (u32 block = 0; block < 4; block++) {
+						u32* blockOutput = tileOutput + (block >> 1) * 4 * width + (block & 1) * 4;
+						decodeETCBlock<hasAlpha>(data + block * blockSize, blockOutput, width);
+					}
+				} else {
+					for (u32 i = 0; i < 64; i++) {
+						const auto [u, v] = tilePositions[i];
+						tileOutput[v * width + u] = convertTexel<format>(data, i);
+					}
+				}
+
+				data += tileSize;
+			}
+		}
+	}
+
+	using TileDecoder = void (*)(u32 width, u32 height, const u8* data, u32* output);
+	using TexelDecoder = u32 (*)(const u8* tile, u32 index);
+
+	TileDecoder getTileDecoder(TextureFmt format) {
+		switch (format) {
+			case TextureFmt::RGBA8: return &decodeTiles<TextureFmt::RGBA8>;
+			case TextureFmt::RGB8: return &decodeTiles<TextureFmt::RGB8>;
+			case TextureFmt::RGBA5551: return &decodeTiles<TextureFmt::RGBA5551>;
+			case TextureFmt::RGB565: return &decodeTiles<TextureFmt::RGB565>;
+			case TextureFmt::RGBA4: return &decodeTiles<TextureFmt::RGBA4>;
+			case TextureFmt::IA8: return &decodeTiles<TextureFmt::IA8>;
+			case TextureFmt::RG8: return &decodeTiles<TextureFmt::RG8>;
+			case TextureFmt::I8: return &decodeTiles<TextureFmt::I8>;
+			case TextureFmt::A8: return &decodeTiles<TextureFmt::A8>;
+			case TextureFmt::IA4: return &decodeTiles<TextureFmt::IA4>;
+			case TextureFmt::I4: return &decodeTiles<TextureFmt::I4>;
+			case TextureFmt::A4: return &decodeTiles<TextureFmt::A4>;
+			case TextureFmt::ETC1: return &decodeTiles<TextureFmt::ETC1>;
+			case TextureFmt::ETC1A4: return &decodeTiles<TextureFmt::ETC1A4>;
+			default: Helpers::panic("[TextureDecoder] Unimplemented format = %d", static_cast<int>(format));
+		}
+	}
+
+	TexelDecoder getTexelDecoder(TextureFmt format) {
+		switch (format) {
+			case TextureFmt::RGBA8: return &convertTexel<TextureFmt::RGBA8>;
+			case TextureFmt::RGB8: return &convertTexel<TextureFmt::RGB8>;
+			case TextureFmt::RGBA5551: return &convertTexel<TextureFmt::RGBA5551>;
+			case TextureFmt::RGB565: return &convertTexel<TextureFmt::RGB565>;
+			case TextureFmt::RGBA4: return &convertTexel<TextureFmt::RGBA4>;
+			case TextureFmt::IA8: return &convertTexel<TextureFmt::IA8>;
+			case TextureFmt::RG8: return &convertTexel<TextureFmt::RG8>;
+			case TextureFmt::I8: return &convertTexel<TextureFmt::I8>;
+			case TextureFmt::A8: return &convertTexel<TextureFmt::A8>;
+			case TextureFmt::IA4: return &convertTexel<TextureFmt::IA4>;
+			case TextureFmt::I4: return &convertTexel<TextureFmt::I4>;
+			case TextureFmt::A4: return &convertTexel<TextureFmt::A4>;
+			default: Helpers::panic("[TextureDecoder] Unimplemented format = %d", static_cast<int>(format));
+		}
+	}
+}  // namespace
+
+namespace PICA::TextureDecoder {
+	u64 sizeInBytes(TextureFmt format, u32 width, u32 height) {
+		const u32 bits = bitsPerTexel(format);
+		if (bits == 0) {
+			Helpers::panic("[TextureDecoder] Attempted to get size of invalid texture type");
+		}
+
+		return u64(width) * u64(height) * bits / 8;
+	}
+
+	void decodeTexture(TextureFmt format, u32 width, u32 height, std::span<const u8> data, std::vector<u32>& output) {
+		output.resize(usize(width) * usize(height));
+
+		// Textures are always made of whole tiles on hardware. Decode anything else texel by texel just in case
+		if ((width % 8) != 0 || (height % 8) != 0) [[unlikely]] {
+			for (u32 v = 0; v < height; v++) {
+				for (u32 u = 0; u < width; u++) {
+					output[v * width + u] = decodeTexel(format, u, v, width, data);
+				}
+			}
+			return;
+		}
+
+		getTileDecoder(format)(width, height, data.data(), output.data());
+	}
+
+	u32 decodeTexel(TextureFmt format, u32 u, u32 v, u32 width, std::span<const u8> data) {
+		// Offset of the 8x8 tile the texel belongs to, in texels
+		const u32 tileOffset = ((u & ~7) * 8) + ((v & ~7) * width);
+		const u8* tile = data.data() + tileOffset * bitsPerTexel(format) / 8;
+
+		if (format == TextureFmt::ETC1 || format == TextureFmt::ETC1A4) {
+			const bool hasAlpha = format == TextureFmt::ETC1A4;
+			// Which of the 4 blocks of the tile is this texel in?
+			const u32 blockIndex = ((u & 7) / 4) + 2 * ((v & 7) / 4);
+			const u8* blockData = tile + blockIndex * (hasAlpha ? 16 : 8);
+			const ETCBlock block = hasAlpha ? parseETCBlock<true>(blockData) : parseETCBlock<false>(blockData);
+
+			return getETCTexel(block, u & 3, v & 3);
+		}
+
+		return getTexelDecoder(format)(tile, mortonInterleave(u, v));
+	}
+}  // namespace PICA::TextureDecoder
@@ -82,7 +82,7 @@ namespace Audio {
 		}
 
 		loaded = true;
-		scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::cyclesPerFrame);
+		scheduleAudioFrame(Audio::cyclesPerFrame);
 	}
 
 	void HLE_DSP::unloadComponent() {
@@ -91,7 +91,7 @@ namespace Audio {
 		}
 
 		loaded = false;
-		scheduler.removeEvent(Scheduler::EventType::RunDSP);
+		cancelAudioFrame();
 	}
 
 	void HLE_DSP::runAudioFrame() {
@@ -102,7 +102,7 @@ namespace Audio {
 
 		// TODO: Should this be called if dspState != DSPState::On?
 		outputFrame();
-		scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::cyclesPerFrame);
+		scheduleAudioFrame(Audio::cyclesPerFrame);
 	}
 
 	u16 HLE_DSP::recvData(u32 regId) {
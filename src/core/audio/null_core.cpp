@@ -62,7 +62,7 @@ namespace Audio {
 		}
 
 		loaded = true;
-		scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::cyclesPerFrame);
+		scheduleAudioFrame(Audio::cyclesPerFrame);
 	}
 
 	void NullDSP::unloadComponent() {
@@ -71,7 +71,7 @@ namespace Audio {
 		}
 
 		loaded = false;
-		scheduler.removeEvent(Scheduler::EventType::RunDSP);
+		cancelAudioFrame();
 	}
 
 	void NullDSP::runAudioFrame() {
@@ -80,7 +80,7 @@ namespace Audio {
 			dspService.triggerPipeEvent(DSPPipeType::Audio);
 		}
 
-		scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::cyclesPerFrame);
+		scheduleAudioFrame(Audio::cyclesPerFrame);
 	}
 	
 	u16 NullDSP::recvData(u32 regId) {
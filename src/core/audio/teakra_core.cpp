@@ -41,16 +41,14 @@ TeakraDSP::TeakraDSP(Memory& mem, Scheduler& scheduler, DSPService& dspService)
 	// Set up callbacks for Teakra
 	Teakra::AHBMCallback ahbm;
 
-	// The AHBM read handlers read from paddrs rather than vaddrs which mem.read8 and the like use
-	// TODO: When we implement more efficient paddr accesses with a page table or similar, these handlers
-	// Should be made to properly use it, since this method is hacky and will segfault if given an invalid addr
-	ahbm.read8 = [&](u32 addr) -> u8 { return mem.getFCRAM()[addr - PhysicalAddrs::FCRAM]; };
-	ahbm.read16 = [&](u32 addr) -> u16 { return *(u16*)&mem.getFCRAM()[addr - PhysicalAddrs::FCRAM]; };
-	ahbm.read32 = [&](u32 addr) -> u32 { return *(u32*)&mem.getFCRAM()[addr - PhysicalAddrs::FCRAM]; };
+	// The AHBM read handlers read from paddrs rather than vaddrs which mem.read8 and the like use, so go through the physical page table
+	ahbm.read8 = [&](u32 addr) -> u8 { return mem.readPhysical<u8>(addr); };
+	ahbm.read16 = [&](u32 addr) -> u16 { return mem.readPhysical<u16>(addr); };
+	ahbm.read32 = [&](u32 addr) -> u32 { return mem.readPhysical<u32>(addr); };
 
-	ahbm.write8 = [&](u32 addr, u8 value) { mem.getFCRAM()[addr - PhysicalAddrs::FCRAM] = value; };
-	ahbm.write16 = [&](u32 addr, u16 value) { *(u16*)&mem.getFCRAM()[addr - PhysicalAddrs::FCRAM] = value; };
-	ahbm.write32 = [&](u32 addr, u32 value) { *(u32*)&mem.getFCRAM()[addr - PhysicalAddrs::FCRAM] = value; };
+	ahbm.write8 = [&](u32 addr, u8 value) { mem.writePhysical<u8>(addr, value); };
+	ahbm.write16 = [&](u32 addr, u16 value) { mem.writePhysical<u16>(addr, value); };
+	ahbm.write32 = [&](u32 addr, u32 value) { mem.writePhysical<u32>(addr, value); };
 
 	teakra.SetAHBMCallback(ahbm);
 	teakra.SetAudioCallback([](std::array<s16, 2> sample) { /* Do nothing */ });
@@ -314,7 +312,7 @@ void TeakraDSP::loadComponent(std::vector<u8>& data, u32 programMask, u32 dataMa
 	pipeBaseAddr = teakra.RecvData(2);
 	
 	// Schedule next DSP event
-	scheduler.addEvent(Scheduler::EventType::RunDSP, scheduler.currentTimestamp + Audio::lleSlice * 2);
+	scheduleAudioFrame(Audio::lleSlice * 2);
 	loaded = true;
 }
 
@@ -325,7 +323,7 @@ void TeakraDSP::unloadComponent() {
 	}
 	loaded = false;
 	// Stop scheduling DSP events
-	scheduler.removeEvent(Scheduler::EventType::RunDSP);
+	cancelAudioFrame();
 
 	// Wait for SEND2 to be ready, then send the shutdown command to the DSP
 	while (!teakra.SendDataIsEmpty(2)) {
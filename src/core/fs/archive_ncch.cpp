@@ -107,9 +107,7 @@ std::optional<u32> NCCHArchive::readFile(FileSession* file, u64 offset, u32 size
 
 		u32 availableBytes = u32(fileData.size() - offset); // How many bytes we can read from the file
 		u32 bytesRead = std::min<u32>(size, availableBytes); // Cap the amount of bytes to read if we're going to go out of bounds
-		for (u32 i = 0; i < bytesRead; i++) {
-			mem.write8(dataPointer + i, fileData[offset + i]);
-		}
+		mem.writeBlock(dataPointer, &fileData[offset], bytesRead);
 
 		return bytesRead;
 	} else {
@@ -161,9 +159,7 @@ std::optional<u32> NCCHArchive::readFile(FileSession* file, u64 offset, u32 size
 		Helpers::panic("Failed to read from NCCH archive");
 	}
 
-	for (u64 i = 0; i < bytesRead; i++) {
-		mem.write8(u32(dataPointer + i), data[i]);
-	}
+	mem.writeBlock(dataPointer, &data[0], bytesRead);
 
 	return u32(bytesRead);
 }
@@ -145,9 +145,7 @@ std::optional<u32> SelfNCCHArchive::readFile(FileSession* file, u64 offset, u32
 		Helpers::panic("Failed to read from SelfNCCH archive");
 	}
 
-	for (u64 i = 0; i < bytesRead; i++) {
-		mem.write8(u32(dataPointer + i), data[i]);
-	}
+	mem.writeBlock(dataPointer, &data[0], bytesRead);
 
 	return u32(bytesRead);
 }
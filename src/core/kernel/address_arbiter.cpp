@@ -95,15 +95,24 @@ void Kernel::signalArbiter(u32 waitingAddress, s32 threadCount) {
 	if (threadCount == 0) [[unlikely]] return;
 	s32 count = 0; // Number of threads we've woken up
 
-	// Wake threads with the highest priority threads being woken up first
+	// Gather all threads waiting on this address into a bitmask
+	u64 waitlist = 0;
 	for (auto index : threadIndices) {
-		Thread& t = threads[index];
+		const Thread& t = threads[index];
 		if (t.status == ThreadStatus::WaitArbiter && t.waitingAddress == waitingAddress) {
-			t.status = ThreadStatus::Ready;
-			count += 1;
-
-			// Check if we've reached the max number of. If count < 0 then all threads are released.
-			if (count == threadCount && threadCount > 0) break;
+			waitlist |= (1ull << index);
 		}
 	}
+
+	// Wake threads with the highest priority threads being woken up first
+	while (waitlist != 0) {
+		const int index = getHighestPriorityThread(waitlist);
+		waitlist &= ~(1ull << index);
+
+		setThreadStatus(threads[index], ThreadStatus::Ready);
+		count += 1;
+
+		// Check if we've reached the max number of. If count < 0 then all threads are released.
+		if (count == threadCount && threadCount > 0) break;
+	}
 }
\ No newline at end of file
@@ -130,8 +130,8 @@ void Kernel::waitSynchronization1() {
 
 		auto& t = threads[currentThreadIndex];
 		t.waitList.resize(1);
-		t.status = ThreadStatus::WaitSync1;
 		t.wakeupTick = getWakeupTick(ns);
+		setThreadStatus(t, ThreadStatus::WaitSync1);
 		t.waitList[0] = handle;
 
 		// Add the current thread to the object's wait list
@@ -222,9 +222,9 @@ void Kernel::waitSynchronizationN() {
 		// If the thread wakes up without timeout, this will be adjusted to the index of the handle that woke us up
 		regs[1] = 0xFFFFFFFF;
 		t.waitList.resize(handleCount);
-		t.status = ThreadStatus::WaitSyncAny;
 		t.outPointer = outPointer;
 		t.wakeupTick = getWakeupTick(ns);
+		setThreadStatus(t, ThreadStatus::WaitSyncAny);
 
 		for (s32 i = 0; i < handleCount; i++) {
 			t.waitList[i] = waitObjects[i].first; // Add object to this thread's waitlist
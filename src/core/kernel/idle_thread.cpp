@@ -53,7 +53,6 @@ void Kernel::setupIdleThread() {
 	t.priority = 0x40;
 	t.status = ThreadStatus::Ready;
 
-	// Add idle thread to the list of thread indices
+	// Add idle thread to the list of thread indices. It is never part of the ready queue, as we only switch to it if no other thread can run
 	threadIndices.push_back(idleThreadIndex);
-	sortThreads();
 }
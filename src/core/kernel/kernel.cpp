@@ -9,6 +9,8 @@ Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu, const EmulatorConfig& config)
 	mutexHandles.reserve(8);
 	portHandles.reserve(32);
 	threadIndices.reserve(appResourceLimits.maxThreads);
+	readyThreads.fill(0);
+	readyPriorities = 0;
 
 	for (int i = 0; i < threads.size(); i++) {
 		Thread& t = threads[i];
@@ -23,6 +25,10 @@ Kernel::Kernel(CPU& cpu, Memory& mem, GPU& gpu, const EmulatorConfig& config)
 		t.waitAll = false;
 	}
 
+	Scheduler& scheduler = cpu.getScheduler();
+	wakeupEvent = scheduler.registerEventType("ThreadWakeup", [this](u64 userdata, u64 cyclesLate) { handleThreadWakeup(); });
+	timerEvent = scheduler.registerEventType("FireTimer", [this](u64 userdata, u64 cyclesLate) { fireTimer(Handle(userdata)); });
+
 	setVersion(1, 69);
 }
 
@@ -150,12 +156,17 @@ void Kernel::reset() {
 	}
 	objects.clear();
 	mutexHandles.clear();
-	timerHandles.clear();
 	portHandles.clear();
 	threadIndices.clear();
+	readyThreads.fill(0);
+	readyPriorities = 0;
+	wakeupQueue = {};
 	serviceManager.reset();
 
 	needReschedule = false;
+	yieldSpinCount = 0;
+	yieldSpinPC = 0;
+	idleSkipStats = {};
 
 	// Allocate handle #0 to a dummy object and make a main process object
 	makeObject(KernelObjectType::Dummy);
@@ -173,6 +184,8 @@ void Kernel::reset() {
 	errorPortHandle = makePort("err:f"); // Error display port
 }
 
+Scheduler& Kernel::getScheduler() { return cpu.getScheduler(); }
+
 // Get pointer to thread-local storage
 u32 Kernel::getTLSPointer() {
 	return VirtualAddrs::TLSBase + currentThreadIndex * VirtualAddrs::TLSSize;
@@ -46,6 +46,9 @@ void Kernel::controlMemory() {
 	u32 size = regs[3];
 	u32 perms = regs[4];
 
+	// Commands on the GPU thread might still be using memory that this is about to remap, so let them finish first
+	serviceManager.syncGPU();
+
 	if (perms == MemoryPermissions::DontCare) {
 		perms = MemoryPermissions::ReadWrite; // We make "don't care" equivalent to read-write
 		Helpers::panic("Unimplemented allocation permission: DONTCARE");
@@ -117,6 +120,9 @@ void Kernel::mapMemoryBlock() {
 	const u32 otherPerms = regs[3];
 	logSVC("MapMemoryBlock(block = %X, addr = %08X, myPerms = %X, otherPerms = %X\n", block, addr, myPerms, otherPerms);
 
+	// Catch up with the GPU thread before it sees the new mapping
+	serviceManager.syncGPU();
+
 	if (!isAligned(addr)) [[unlikely]] {
 		Helpers::panic("MapMemoryBlock: Unaligned address");
 	}
@@ -213,6 +219,9 @@ void Kernel::unmapMemoryBlock() {
 	u32 addr = regs[1];
 	logSVC("Unmap memory block (block handle = %X, addr = %08X)\n", block, addr);
 
+	// Same as for ControlMemory, the GPU thread can't be using the block while it goes away
+	serviceManager.syncGPU();
+
 	Helpers::warn("Stubbed svcUnmapMemoryBlock!");
 	regs[0] = Result::Success;
 }
@@ -14,7 +14,7 @@
 void Kernel::switchThread(int newThreadIndex) {
 	auto& oldThread = threads[currentThreadIndex];
 	auto& newThread = threads[newThreadIndex];
-	newThread.status = ThreadStatus::Running;
+	setThreadStatus(newThread, ThreadStatus::Running);
 	logThread("Switching from thread %d to %d\n", currentThreadIndex, newThreadIndex);
 
 	// Bail early if the new thread is actually the old thread
@@ -38,42 +38,122 @@ void Kernel::switchThread(int newThreadIndex) {
 	currentThreadIndex = newThreadIndex;
 }
 
-// Sort the threadIndices vector based on the priority of each thread
-// The threads with higher priority (aka the ones with a lower priority value) should come first in the vector
-void Kernel::sortThreads() {
-	std::vector<int>& v = threadIndices;
-	std::sort(v.begin(), v.end(), [&](int a, int b) {
-		return threads[a].priority < threads[b].priority;
-	});
+// Get the index of the highest priority thread that can run, using the ready queue
+// Returns the thread index if a thread is found, or nullopt if only the idle thread can run
+std::optional<int> Kernel::getNextThread() {
+	// Make threads whose sleep or wait timeout is over ready first
+	wakeupTimedOutThreads();
+
+	if (readyPriorities == 0) {
+		return std::nullopt;
+	}
+
+	// Low priority value means high priority, so the highest priority level is the lowest set bit
+	const int priority = std::countr_zero(readyPriorities);
+	return std::countr_zero(readyThreads[priority]);
 }
 
-bool Kernel::canThreadRun(const Thread& t) {
-	if (t.status == ThreadStatus::Ready) {
-		return true;
-	} else if (t.status == ThreadStatus::WaitSleep || t.status == ThreadStatus::WaitSync1
-		|| t.status == ThreadStatus::WaitSyncAny || t.status == ThreadStatus::WaitSyncAll) {
-		// TODO: Set r0 to the correct error code on timeout for WaitSync{1/Any/All}
-		return cpu.getTicks() >= t.wakeupTick;
+void Kernel::addReadyThread(const Thread& t) {
+	// The idle thread is not part of the ready queue, we only fall back to it when no other thread can run
+	if (t.index == idleThreadIndex) {
+		return;
 	}
 
-	// Handle timeouts and stuff here
-	return false;
+	readyThreads[t.priority] |= (1ull << t.index);
+	readyPriorities |= (1ull << t.priority);
 }
 
-// Get the index of the next thread to run by iterating through the thread list and finding the free thread with the highest priority
-// Returns the thread index if a thread is found, or nullopt otherwise
-std::optional<int> Kernel::getNextThread() {
-	for (auto index : threadIndices) {
+void Kernel::removeReadyThread(const Thread& t) {
+	if (t.index == idleThreadIndex) {
+		return;
+	}
+
+	readyThreads[t.priority] &= ~(1ull << t.index);
+	if (readyThreads[t.priority] == 0) {
+		readyPriorities &= ~(1ull << t.priority);
+	}
+}
+
+void Kernel::setThreadStatus(Thread& t, ThreadStatus status) {
+	const bool wasRunnable = isRunnable(t.status);
+	const bool runnable = isRunnable(status);
+	t.status = status;
+
+	if (runnable && !wasRunnable) {
+		addReadyThread(t);
+	} else if (!runnable && wasRunnable) {
+		removeReadyThread(t);
+	}
+
+	// Threads waiting with a timeout need to be woken up by the scheduler. Callers need to set the wakeup tick before the status
+	if (isTimedWait(status) && t.wakeupTick != std::numeric_limits<u64>::max()) {
+		wakeupQueue.push({t.wakeupTick, t.index});
+		updateWakeupEvent();
+	}
+}
+
+void Kernel::changeThreadPriority(Thread& t, u32 priority) {
+	// Move the thread to the bucket for its new priority if it's in the ready queue
+	if (isRunnable(t.status)) {
+		removeReadyThread(t);
+		t.priority = priority;
+		addReadyThread(t);
+	} else {
+		t.priority = priority;
+	}
+}
+
+// Make every thread whose sleep or wait timeout has passed ready to run
+void Kernel::wakeupTimedOutThreads() {
+	const u64 currentTick = cpu.getTicks();
+	bool wokeUpThreads = false;
+
+	while (!wakeupQueue.empty() && wakeupQueue.top().first <= currentTick) {
+		const auto [tick, index] = wakeupQueue.top();
+		wakeupQueue.pop();
+		wokeUpThreads = true;
+
+		// Skip stale entries for threads that already got woken up by the object they were waiting on
+		Thread& t = threads[index];
+		if (isTimedWait(t.status) && t.wakeupTick == tick) {
+			// TODO: Set r0 to the correct error code on timeout for WaitSync{1/Any/All}
+			setThreadStatus(t, ThreadStatus::Ready);
+		}
+	}
+
+	if (wokeUpThreads) {
+		updateWakeupEvent();
+	}
+}
+
+// Register the earliest pending thread wakeup with the scheduler
+void Kernel::updateWakeupEvent() {
+	// Drop stale entries first, so that we don't schedule pointless wakeup events
+	while (!wakeupQueue.empty()) {
+		const auto [tick, index] = wakeupQueue.top();
 		const Thread& t = threads[index];
 
-		// Thread is ready, return it
-		if (canThreadRun(t)) {
-			return index;
+		if (isTimedWait(t.status) && t.wakeupTick == tick) {
+			break;
 		}
+		wakeupQueue.pop();
 	}
 
-	// No thread was found
-	return std::nullopt;
+	Scheduler& scheduler = cpu.getScheduler();
+	scheduler.cancel(wakeupEventHandle);
+
+	if (!wakeupQueue.empty()) {
+		wakeupEventHandle = scheduler.schedule(wakeupEvent, wakeupQueue.top().first);
+	}
+}
+
+void Kernel::handleThreadWakeup() {
+	wakeupTimedOutThreads();
+	// The wakeup event has been consumed by the scheduler, so register the next one even if no thread woke up
+	updateWakeupEvent();
+
+	requireReschedule();
+	evalReschedule();
 }
 
 u64 Kernel::getWakeupTick(s64 ns) {
@@ -88,13 +168,13 @@ u64 Kernel::getWakeupTick(s64 ns) {
 // See if there is a higher priority, ready thread and switch to that
 void Kernel::rescheduleThreads() {
 	Thread& current = threads[currentThreadIndex];  // Current running thread
+	yieldSpinCount = 0;
 
 	// If the current thread is running and hasn't gone to sleep or whatever, set it to Ready instead of Running
 	// So that getNextThread will evaluate it properly
 	if (current.status == ThreadStatus::Running) {
-		current.status = ThreadStatus::Ready;
+		setThreadStatus(current, ThreadStatus::Ready);
 	}
-	ThreadStatus currentStatus = current.status;
 	std::optional<int> newThreadIndex = getNextThread();
 
 	// Case 1: A thread can run
@@ -103,8 +183,26 @@ void Kernel::rescheduleThreads() {
 	} 
 	
 	// Case 2: No other thread can run, straight to the idle thread
+	// The idle thread would just spin until something happens, so skip ahead to the next event instead
 	else {
 		switchThread(idleThreadIndex);
+		skipToNextEvent();
+	}
+}
+
+// Fast-forward emulated time to the next point where something can happen, ie the next scheduler event.
+// Sleeping and timed-wait threads register their wakeups with the scheduler, so this also covers them
+void Kernel::skipToNextEvent() {
+	const Scheduler& scheduler = cpu.getScheduler();
+	const u64 timestamp = scheduler.nextTimestamp;
+
+	yieldSpinCount = 0;
+	if (timestamp > scheduler.currentTimestamp) {
+		const u64 idleCycles = timestamp - scheduler.currentTimestamp;
+		cpu.addTicks(idleCycles);
+
+		idleSkipStats.skippedCycles += idleCycles;
+		idleSkipStats.skipCount++;
 	}
 }
 
@@ -147,7 +245,6 @@ Handle Kernel::makeThread(u32 entrypoint, u32 initialSP, u32 priority, Processor
 	t.gprs[15] = entrypoint;
 	t.priority = priority;
 	t.processorID = id;
-	t.status = status;
 	t.handle = ret;
 	t.waitingAddress = 0;
 	t.threadsWaitingForTermination = 0; // Thread just spawned, no other threads waiting for it to terminate
@@ -157,7 +254,8 @@ Handle Kernel::makeThread(u32 entrypoint, u32 initialSP, u32 priority, Processor
 	// Initial TLS base has already been set in Kernel::Kernel()
 	// TODO: Does svcCreateThread zero-set the TLS of the new thread?
 
-	sortThreads();
+	// Set the status last, as this is what inserts the thread into the ready queue with its priority
+	setThreadStatus(t, status);
 	return ret;
 }
 
@@ -210,7 +308,7 @@ Handle Kernel::makeSemaphore(u32 initialCount, u32 maximumCount) {
 
 void Kernel::sleepThreadOnArbiter(u32 waitingAddress) {
 	Thread& t = threads[currentThreadIndex];
-	t.status = ThreadStatus::WaitArbiter;
+	setThreadStatus(t, ThreadStatus::WaitArbiter);
 	t.waitingAddress = waitingAddress;
 
 	requireReschedule();
@@ -267,37 +365,41 @@ void Kernel::acquireSyncObject(KernelObject* object, const Thread& thread) {
 	}
 }
 
-// Wake up one of the threads in the waitlist (the one with highest prio) and return its index
-// Must not be called with an empty waitlist
-int Kernel::wakeupOneThread(u64 waitlist, Handle handle) {
-	if (waitlist == 0) [[unlikely]]
-		Helpers::panic("[Internal error] It shouldn't be possible to call wakeupOneThread when there's 0 threads waiting!");
+int Kernel::getHighestPriorityThread(u64 mask) {
+	// Pick the first thread in the mask, then check each other thread and compare priorities
+	int threadIndex = std::countr_zero(mask);
+	u32 maxPriority = threads[threadIndex].priority;
+	mask &= mask - 1;  // Remove the first thread from the mask
 
-	// Find the waiting thread with the highest priority.
-	// We do this by first picking the first thread in the waitlist, then checking each other thread and comparing priority
-	int threadIndex = std::countr_zero(waitlist);    // Index of first thread
-	int maxPriority = threads[threadIndex].priority; // Set initial max prio to the prio of the first thread
-	waitlist ^= (1ull << threadIndex); // Remove thread from the waitlist
-
-	while (waitlist != 0) {
-		int newThread = std::countr_zero(waitlist); // Get new thread and evaluate whether it has a higher priority
-		if (threads[newThread].priority < maxPriority) { // Low priority value means high priority
+	while (mask != 0) {
+		const int newThread = std::countr_zero(mask);
+		if (threads[newThread].priority < maxPriority) {  // Low priority value means high priority
 			threadIndex = newThread;
 			maxPriority = threads[newThread].priority;
 		}
 
-		waitlist ^= (1ull << threadIndex); // Remove thread from waitlist
+		mask &= mask - 1;
 	}
 
+	return threadIndex;
+}
+
+// Wake up one of the threads in the waitlist (the one with highest prio) and return its index
+// Must not be called with an empty waitlist
+int Kernel::wakeupOneThread(u64 waitlist, Handle handle) {
+	if (waitlist == 0) [[unlikely]]
+		Helpers::panic("[Internal error] It shouldn't be possible to call wakeupOneThread when there's 0 threads waiting!");
+
+	const int threadIndex = getHighestPriorityThread(waitlist);
 	Thread& t = threads[threadIndex];
 	switch (t.status) {
 		case ThreadStatus::WaitSync1:
-			t.status = ThreadStatus::Ready;
+			setThreadStatus(t, ThreadStatus::Ready);
 			t.gprs[0] = Result::Success; // The thread did not timeout, so write success to r0
 			break;
 
 		case ThreadStatus::WaitSyncAny:
-			t.status = ThreadStatus::Ready;
+			setThreadStatus(t, ThreadStatus::Ready);
 			t.gprs[0] = Result::Success; // The thread did not timeout, so write success to r0
 
 			// Get the index of the event in the object's waitlist, write it to r1
@@ -327,12 +429,12 @@ void Kernel::wakeupAllThreads(u64 waitlist, Handle handle) {
 		Thread& t = threads[index];
 		switch (t.status) {
 		case ThreadStatus::WaitSync1:
-			t.status = ThreadStatus::Ready;
+			setThreadStatus(t, ThreadStatus::Ready);
 			t.gprs[0] = Result::Success; // The thread did not timeout, so write success to r0
 			break;
 
 		case ThreadStatus::WaitSyncAny:
-			t.status = ThreadStatus::Ready;
+			setThreadStatus(t, ThreadStatus::Ready);
 			t.gprs[0] = Result::Success; // The thread did not timeout, so write success to r0
 
 			// Get the index of the event in the object's waitlist, write it to r1
@@ -359,42 +461,34 @@ void Kernel::sleepThread(s64 ns) {
 		// TODO: This is garbage, but it works so eh we can keep it for now
 		Thread& t = threads[currentThreadIndex];
 
-		// See if a thread other than this and the idle thread is waiting to run by temp marking the current function as dead and searching
+		// See if a thread other than this and the idle thread is waiting to run by temporarily taking the current thread off the ready queue
 		// If there is another thread to run, then run it. Otherwise, go back to this thread, not to the idle thread
-		t.status = ThreadStatus::Dead;
+		removeReadyThread(t);
 		auto nextThreadIndex = getNextThread();
-		t.status = ThreadStatus::Ready;
+		addReadyThread(t);
 
 		if (nextThreadIndex.has_value()) {
-			const auto index = nextThreadIndex.value();
-
-			if (index != idleThreadIndex) {
-				switchThread(index);
-			}
+			yieldSpinCount = 0;
+			setThreadStatus(t, ThreadStatus::Ready);
+			switchThread(nextThreadIndex.value());
 		} else {
-			if (currentThreadIndex == idleThreadIndex) {
-				const Scheduler& scheduler = cpu.getScheduler();
-				u64 timestamp = scheduler.nextTimestamp;
-
-				for (auto i : threadIndices) {
-					const Thread& t = threads[i];
-					if (t.status == ThreadStatus::WaitSleep || t.status == ThreadStatus::WaitSync1 || t.status == ThreadStatus::WaitSyncAny ||
-						t.status == ThreadStatus::WaitSyncAll) {
-						timestamp = std::min<u64>(timestamp, t.wakeupTick);
-					}
-				}
-
-				if (timestamp > scheduler.currentTimestamp) {
-					u64 idleCycles = timestamp - scheduler.currentTimestamp;
-					cpu.addTicks(idleCycles);
-				}
+			// No other thread is ready, regardless of priority. Only count this as a spin if the thread keeps yielding from the same spot,
+			// as a thread that yields from different places is making progress rather than polling for something to change
+			const u32 pc = regs[15];
+			yieldSpinCount = (pc == yieldSpinPC) ? yieldSpinCount + 1 : 1;
+			yieldSpinPC = pc;
+
+			if (currentThreadIndex == idleThreadIndex || yieldSpinCount >= maxYieldSpins) {
+				// Nothing else can run until the next event, so nothing the yielding thread observes can change until then
+				skipToNextEvent();
 			}
 		}
 	} else {  // If we're sleeping for >= 0 ns
 		Thread& t = threads[currentThreadIndex];
+		yieldSpinCount = 0;
 
-		t.status = ThreadStatus::WaitSleep;
 		t.wakeupTick = getWakeupTick(ns);
+		setThreadStatus(t, ThreadStatus::WaitSleep);
 
 		requireReschedule();
 	}
@@ -501,7 +595,7 @@ void Kernel::setThreadPriority() {
 
 	if (handle == KernelHandles::CurrentThread) {
 		regs[0] = Result::Success;
-		threads[currentThreadIndex].priority = priority;
+		changeThreadPriority(threads[currentThreadIndex], priority);
 	} else {
 		auto object = getObject(handle, KernelObjectType::Thread);
 		if (object == nullptr) [[unlikely]] {
@@ -509,10 +603,9 @@ void Kernel::setThreadPriority() {
 			return;
 		} else {
 			regs[0] = Result::Success;
-			object->getData<Thread>()->priority = priority;
+			changeThreadPriority(*object->getData<Thread>(), priority);
 		}
 	}
-	sortThreads();
 	requireReschedule();
 }
 
@@ -570,7 +663,7 @@ void Kernel::exitThread() {
 	}
 
 	Thread& t = threads[currentThreadIndex];
-	t.status = ThreadStatus::Dead;
+	setThreadStatus(t, ThreadStatus::Dead);
 	aliveThreadCount--;
 
 	// Check if any threads are sleeping, waiting for this thread to terminate, and wake them up
@@ -1,5 +1,3 @@
-#include <limits>
-
 #include "cpu.hpp"
 #include "kernel.hpp"
 #include "scheduler.hpp"
@@ -12,48 +10,25 @@ Handle Kernel::makeTimer(ResetType type) {
 		Helpers::panic("Created pulse timer");
 	}
 
-	timerHandles.push_back(ret);
 	return ret;
 }
 
-void Kernel::pollTimers() {
-	u64 currentTick = cpu.getTicks();
-
-	// Find the next timestamp we'll poll KTimers on. To do this, we find the minimum tick one of our timers will fire
-	u64 nextTimestamp = std::numeric_limits<u64>::max();
-	// Do we have any active timers anymore? If not, then we won't need to schedule a new timer poll event
-	bool haveActiveTimers = false;
-
-	for (auto handle : timerHandles) {
-		KernelObject* object = getObject(handle, KernelObjectType::Timer);
-		if (object != nullptr) {
-			Timer* timer = object->getData<Timer>();
-
-			if (timer->running) {
-				// If timer has fired, signal it and set the tick it will next time
-				if (currentTick >= timer->fireTick) {
-					signalTimer(handle, timer);
-				}
-
-				// Update our next timer fire timestamp and mark that we should schedule a new event to poll timers
-				// We recheck timer->running because signalling a timer stops it if interval == 0
-				if (timer->running) {
-					nextTimestamp = std::min<u64>(nextTimestamp, timer->fireTick);
-					haveActiveTimers = true;
-				}
-			}
-		}
+// Called by the scheduler when a running timer reaches its fire tick
+void Kernel::fireTimer(Handle timerHandle) {
+	KernelObject* object = getObject(timerHandle, KernelObjectType::Timer);
+	if (object == nullptr) [[unlikely]] {
+		return;
 	}
 
-	// If we still have active timers, schedule next poll event
-	if (haveActiveTimers) {
-		Scheduler& scheduler = cpu.getScheduler();
-		scheduler.addEvent(Scheduler::EventType::UpdateTimers, nextTimestamp);
+	Timer* timer = object->getData<Timer>();
+	if (timer->running) {
+		signalTimer(timerHandle, timer);
 	}
 }
 
 void Kernel::cancelTimer(Timer* timer) {
 	timer->running = false;
+	cpu.getScheduler().cancel(timer->event);
 }
 
 void Kernel::signalTimer(Handle timerHandle, Timer* timer) {
@@ -76,6 +51,7 @@ void Kernel::signalTimer(Handle timerHandle, Timer* timer) {
 		cancelTimer(timer);
 	} else {
 		timer->fireTick = cpu.getTicks() + Scheduler::nsToCycles(timer->interval);
+		timer->event = cpu.getScheduler().schedule(timerEvent, timer->fireTick, timerHandle);
 	}
 }
 
@@ -112,15 +88,12 @@ void Kernel::svcSetTimer() {
 	timer->interval = interval;
 	timer->running = true;
 	timer->fireTick = cpu.getTicks() + Scheduler::nsToCycles(initial);
-	
-	Scheduler& scheduler = cpu.getScheduler();
-	// Signal an event to poll timers as soon as possible
-	scheduler.removeEvent(Scheduler::EventType::UpdateTimers);
-	scheduler.addEvent(Scheduler::EventType::UpdateTimers, cpu.getTicks() + 1);
 
-	// If the initial delay is 0 then instantly signal the timer
+	// If the initial delay is 0 then instantly signal the timer, otherwise schedule it to fire after the initial delay
 	if (initial == 0) {
 		signalTimer(handle, timer);
+	} else {
+		timer->event = cpu.getScheduler().schedule(timerEvent, timer->fireTick, handle);
 	}
 
 	regs[0] = Result::Success;
@@ -1,7 +1,9 @@
 #include "memory.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>  // For time since epoch
+#include <cstring>
 #include <cmrc/cmrc.hpp>
 #include <ctime>
 
@@ -14,10 +16,35 @@ CMRC_DECLARE(ConsoleFonts);
 using namespace KernelMemoryTypes;
 
 Memory::Memory(u64& cpuTicks, const EmulatorConfig& config) : cpuTicks(cpuTicks), config(config) {
-	fcram = new uint8_t[FCRAM_SIZE]();
+	if (config.hostMemoryEnabled) {
+		// Allocate FCRAM and VRAM back-to-back in the backing memory, so both of them can be mapped into the host arena
+		hostMemory = std::make_unique<HostMemory>(usize(FCRAM_SIZE) + VirtualAddrs::VramSize);
+		if (!hostMemory->isValid()) {
+			hostMemory.reset();
+		}
+	}
+
+	if (hostMemory) {
+		fcram = hostMemory->getBackingMemory();
+		vram = fcram + FCRAM_SIZE;
+	} else {
+		fcram = new uint8_t[FCRAM_SIZE]();
+	}
 
 	readTable.resize(totalPageCount, 0);
 	writeTable.resize(totalPageCount, 0);
+	physTable.resize(totalPageCount, 0);
+
+	// VRAM and DSP RAM are added to the physical page table when the GPU and DSP hand them to us via setVRAM and setDSPMem
+	mapPhysicalRegion(PhysicalAddrs::FCRAM, fcram, FCRAM_SIZE);
+	if (hostMemory) {
+		mapPhysicalRegion(PhysicalAddrs::VRAM, vram, VirtualAddrs::VramSize);
+	}
+	jitPageTable = std::make_unique<PageTable>();
+	jitPageTable->fill(nullptr);
+	watchedPages.resize(FCRAM_PAGE_COUNT + VRAM_PAGE_COUNT, 0);
+	pageWriteStamps.resize(FCRAM_PAGE_COUNT + VRAM_PAGE_COUNT, 0);
+	gpuPendingPages.resize(FCRAM_PAGE_COUNT + VRAM_PAGE_COUNT, 0);
 	memoryInfo.reserve(32);  // Pre-allocate some room for memory allocation info to avoid dynamic allocs
 }
 
@@ -28,11 +55,20 @@ void Memory::reset() {
 	usedUserMemory = u32(0_MB);
 	usedSystemMemory = u32(0_MB);
 
-	for (u32 i = 0; i < totalPageCount; i++) {
-		readTable[i] = 0;
-		writeTable[i] = 0;
+	std::fill(readTable.begin(), readTable.end(), 0);
+	std::fill(writeTable.begin(), writeTable.end(), 0);
+	jitPageTable->fill(nullptr);
+	if (hostMemory) {
+		hostMemory->reset();
 	}
 
+	// Stop watching everything. Unwatched pages always count as written, so nobody can trust their old stamps after a reset
+	std::fill(watchedPages.begin(), watchedPages.end(), 0);
+	fcramPageMappings.clear();
+	watchedPageCount = 0;
+	std::fill(gpuPendingPages.begin(), gpuPendingPages.end(), 0);
+	gpuPendingIndices.clear();
+
 	// Map (32 * 4) KB of FCRAM before the stack for the TLS of each thread
 	std::optional<u32> tlsBaseOpt = findPaddr(32 * 4_KB);
 	if (!tlsBaseOpt.has_value()) {  // Should be unreachable but still good to have
@@ -67,6 +103,7 @@ void Memory::reset() {
 
 		readTable[i + initialPage] = pointer;
 		writeTable[i + initialPage] = pointer;
+		updateJITPage(i + initialPage);
 	}
 
 	// Later adjusted based on ROM header when possible
@@ -91,6 +128,7 @@ u8 Memory::read8(u32 vaddr) {
 
 	uintptr_t pointer = readTable[page];
 	if (pointer != 0) [[likely]] {
+		syncPendingGPUWrites(vaddr, sizeof(u8));
 		return *(u8*)(pointer + offset);
 	} else {
 		switch (vaddr) {
@@ -139,6 +177,7 @@ u16 Memory::read16(u32 vaddr) {
 
 	uintptr_t pointer = readTable[page];
 	if (pointer != 0) [[likely]] {
+		syncPendingGPUWrites(vaddr, sizeof(u16));
 		return *(u16*)(pointer + offset);
 	} else {
 		switch (vaddr) {
@@ -154,6 +193,7 @@ u32 Memory::read32(u32 vaddr) {
 
 	uintptr_t pointer = readTable[page];
 	if (pointer != 0) [[likely]] {
+		syncPendingGPUWrites(vaddr, sizeof(u32));
 		return *(u32*)(pointer + offset);
 	} else {
 		switch (vaddr) {
@@ -191,6 +231,7 @@ u32 Memory::read32(u32 vaddr) {
 					}
 
 					// TODO: Properly handle framebuffer readbacks and the like
+					syncPendingGPUWrites(vaddr, sizeof(u32));
 					return *(u32*)&vram[vaddr - VirtualAddrs::VramStart];
 				}
 
@@ -212,12 +253,14 @@ void Memory::write8(u32 vaddr, u8 value) {
 
 	uintptr_t pointer = writeTable[page];
 	if (pointer != 0) [[likely]] {
+		notifyWrite(pointer);
 		*(u8*)(pointer + offset) = value;
 	} else {
 		// VRAM write
 		if (vaddr >= VirtualAddrs::VramStart && vaddr < VirtualAddrs::VramStart + VirtualAddrs::VramSize) {
-			// TODO: Invalidate renderer caches here
-			vram[vaddr - VirtualAddrs::VramStart] = value;
+			u8* vramPointer = &vram[vaddr - VirtualAddrs::VramStart];
+			notifyWrite(uintptr_t(vramPointer));
+			*vramPointer = value;
 		}
 
 		else {
@@ -232,6 +275,7 @@ void Memory::write16(u32 vaddr, u16 value) {
 
 	uintptr_t pointer = writeTable[page];
 	if (pointer != 0) [[likely]] {
+		notifyWrite(pointer);
 		*(u16*)(pointer + offset) = value;
 	} else {
 		Helpers::panic("Unimplemented 16-bit write, addr: %08X, val: %08X", vaddr, value);
@@ -244,6 +288,7 @@ void Memory::write32(u32 vaddr, u32 value) {
 
 	uintptr_t pointer = writeTable[page];
 	if (pointer != 0) [[likely]] {
+		notifyWrite(pointer);
 		*(u32*)(pointer + offset) = value;
 	} else {
 		Helpers::panic("Unimplemented 32-bit write, addr: %08X, val: %08X", vaddr, value);
@@ -261,6 +306,7 @@ void* Memory::getReadPointer(u32 address) {
 
 	uintptr_t pointer = readTable[page];
 	if (pointer == 0) return nullptr;
+	syncPendingGPUWrites(address, 1);
 	return (void*)(pointer + offset);
 }
 
@@ -273,6 +319,129 @@ void* Memory::getWritePointer(u32 address) {
 	return (void*)(pointer + offset);
 }
 
+void Memory::readBlock(u32 vaddr, void* dest, usize size) {
+	u8* out = static_cast<u8*>(dest);
+	syncPendingGPUWrites(vaddr, size);
+
+	while (size > 0) {
+		const u32 offset = vaddr & pageMask;
+		const usize chunkSize = std::min<usize>(size, pageSize - offset);
+		const uintptr_t pointer = readTable[vaddr >> pageShift];
+
+		if (pointer != 0) [[likely]] {
+			std::memcpy(out, (u8*)(pointer + offset), chunkSize);
+		} else {
+			for (usize i = 0; i < chunkSize; i++) {
+				out[i] = read8(vaddr + u32(i));
+			}
+		}
+
+		vaddr += u32(chunkSize);
+		out += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+void Memory::writeBlock(u32 vaddr, const void* src, usize size) {
+	const u8* in = static_cast<const u8*>(src);
+
+	while (size > 0) {
+		const u32 offset = vaddr & pageMask;
+		const usize chunkSize = std::min<usize>(size, pageSize - offset);
+		const uintptr_t pointer = writeTable[vaddr >> pageShift];
+
+		if (pointer != 0) [[likely]] {
+			notifyWrite(pointer);
+			std::memcpy((u8*)(pointer + offset), in, chunkSize);
+		} else {
+			for (usize i = 0; i < chunkSize; i++) {
+				write8(vaddr + u32(i), in[i]);
+			}
+		}
+
+		vaddr += u32(chunkSize);
+		in += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+void Memory::copyBlock(u32 destAddr, u32 sourceAddr, usize size) {
+	while (size > 0) {
+		// Each chunk must not cross a page boundary in either the source or the destination
+		const u32 sourceOffset = sourceAddr & pageMask;
+		const u32 destOffset = destAddr & pageMask;
+		const usize chunkSize = std::min<usize>({size, pageSize - sourceOffset, pageSize - destOffset});
+
+		const uintptr_t source = readTable[sourceAddr >> pageShift];
+		const uintptr_t dest = writeTable[destAddr >> pageShift];
+
+		if (source != 0 && dest != 0) [[likely]] {
+			// The two ranges can alias each other in host memory, so use memmove
+			notifyWrite(dest);
+			std::memmove((u8*)(dest + destOffset), (u8*)(source + sourceOffset), chunkSize);
+		} else {
+			for (usize i = 0; i < chunkSize; i++) {
+				write8(destAddr + u32(i), read8(sourceAddr + u32(i)));
+			}
+		}
+
+		destAddr += u32(chunkSize);
+		sourceAddr += u32(chunkSize);
+		size -= chunkSize;
+	}
+}
+
+void Memory::fillBlock(u32 vaddr, u8 value, usize size) {
+	while (size > 0) {
+		const u32 offset = vaddr & pageMask;
+		const usize chunkSize = std::min<usize>(size, pageSize - offset);
+		const uintptr_t pointer = writeTable[vaddr >> pageShift];
+
+		if (pointer != 0) [[likely]] {
+			notifyWrite(pointer);
+			std::memset((u8*)(pointer + offset), value, chunkSize);
+		} else {
+			for (usize i = 0; i < chunkSize; i++) {
+				write8(vaddr + u32(i), value);
+			}
+		}
+
+		vaddr += u32(chunkSize);
+		size -= chunkSize;
+	}
+}
+
+void Memory::mapPhysicalRegion(u32 paddr, u8* pointer, u32 size) {
+	const u32 firstPage = paddr >> pageShift;
+	const u32 pageCount = size >> pageShift;
+
+	for (u32 i = 0; i < pageCount; i++) {
+		physTable[firstPage + i] = (pointer != nullptr) ? uintptr_t(&pointer[i * pageSize]) : 0;
+	}
+}
+
+std::span<u8> Memory::getContiguousSpan(const std::vector<uintptr_t>& table, u32 vaddr, u32 size) {
+	if (size == 0 || u64(vaddr) + size > (1ull << 32)) {
+		return {};
+	}
+
+	const u32 firstPage = vaddr >> pageShift;
+	const u32 lastPage = u32((u64(vaddr) + size - 1) >> pageShift);
+	const uintptr_t base = table[firstPage];
+	if (base == 0) {
+		return {};
+	}
+
+	// Every following page must be mapped right after the previous one in host memory
+	for (u32 page = firstPage + 1; page <= lastPage; page++) {
+		if (table[page] != base + uintptr_t(page - firstPage) * pageSize) {
+			return {};
+		}
+	}
+
+	return std::span<u8>((u8*)(base + (vaddr & pageMask)), size);
+}
+
 // Thank you Citra devs
 std::string Memory::readString(u32 address, u32 maxSize) {
 	std::string string;
@@ -353,6 +522,7 @@ std::optional<u32> Memory::allocateMemory(u32 vaddr, u32 paddr, u32 size, bool l
 		if (w) {
 			writeTable[virtualPage] = uintptr_t(&fcram[physPage * pageSize]);
 		}
+		updateJITPage(virtualPage);
 
 		// Mark FCRAM page as allocated and go on
 		usedFCRAMPages[physPage] = true;
@@ -360,6 +530,18 @@ std::optional<u32> Memory::allocateMemory(u32 vaddr, u32 paddr, u32 size, bool l
 		physPage++;
 	}
 
+	// Allocations are always physically contiguous, so we can map them into the host arena with a single mapping
+	if (hostMemory && neededPageCount != 0) {
+		hostMemory->map(vaddr, paddr, neededPageCount * pageSize, r, w);
+	}
+
+	// This has to happen after the bulk mapping above, so that watched pages get write-protected again
+	if (w) {
+		for (u32 i = 0; i < neededPageCount; i++) {
+			recordPageMapping((vaddr >> pageShift) + i);
+		}
+	}
+
 	// Back up the info for this allocation in our memoryInfo vector
 	u32 perms = (r ? PERMISSION_R : 0) | (w ? PERMISSION_W : 0) | (x ? PERMISSION_X : 0);
 	memoryInfo.push_back(std::move(MemoryInfo(vaddr, size, perms, KernelMemoryTypes::Reserved)));
@@ -486,12 +668,225 @@ void Memory::mirrorMapping(u32 destAddress, u32 sourceAddress, u32 size) {
 
 		readTable[destPage] = readTable[sourcePage];
 		writeTable[destPage] = writeTable[sourcePage];
+		updateJITPage(destPage);
+		updateHostPage(destPage);
+		recordPageMapping(destPage);
 
 		sourceAddress += pageSize;
 		destAddress += pageSize;
 	}
 }
 
+void Memory::updateHostPage(u32 page) {
+	if (!hostMemory) {
+		return;
+	}
+
+	const uintptr_t readPointer = readTable[page];
+	const uintptr_t writePointer = writeTable[page];
+	const uintptr_t pointer = (readPointer != 0) ? readPointer : writePointer;
+
+	const uintptr_t backingStart = uintptr_t(hostMemory->getBackingMemory());
+	const uintptr_t backingEnd = backingStart + FCRAM_SIZE + VirtualAddrs::VramSize;
+	const u32 vaddr = page << pageShift;
+
+	// Pages that aren't backed by our shared memory (eg DSP RAM) can't be mapped into the arena.
+	// Leave them unmapped so the JIT faults and falls back to the page table for them. Same for pages the GPU is yet to write to
+	if (pointer >= backingStart && pointer < backingEnd && !isPointerGPUPending(pointer)) {
+		// Watched pages stay read-only so that writes to them fault and go through our handlers
+		const bool writeable = writePointer != 0 && !isPointerWatched(writePointer);
+		hostMemory->map(vaddr, pointer - backingStart, pageSize, readPointer != 0, writeable);
+	} else {
+		hostMemory->unmap(vaddr, pageSize);
+	}
+}
+
+u32 Memory::getWatchIndex(uintptr_t pointer) const {
+	const uintptr_t fcramStart = uintptr_t(fcram);
+	const uintptr_t vramStart = uintptr_t(vram);
+
+	if (pointer >= fcramStart && pointer < fcramStart + FCRAM_SIZE) {
+		return u32((pointer - fcramStart) >> pageShift);
+	} else if (vram != nullptr && pointer >= vramStart && pointer < vramStart + VirtualAddrs::VramSize) {
+		return FCRAM_PAGE_COUNT + u32((pointer - vramStart) >> pageShift);
+	}
+
+	return invalidWatchIndex;
+}
+
+u32 Memory::getPhysicalWatchIndex(u32 paddr) const {
+	if (paddr >= PhysicalAddrs::FCRAM && paddr < PhysicalAddrs::FCRAM + FCRAM_SIZE) {
+		return (paddr - PhysicalAddrs::FCRAM) >> pageShift;
+	} else if (paddr >= PhysicalAddrs::VRAM && paddr < PhysicalAddrs::VRAM + VirtualAddrs::VramSize) {
+		return FCRAM_PAGE_COUNT + ((paddr - PhysicalAddrs::VRAM) >> pageShift);
+	}
+
+	return invalidWatchIndex;
+}
+
+void Memory::recordPageMapping(u32 page) {
+	const u32 index = getWatchIndex(writeTable[page]);
+	if (index == invalidWatchIndex || index >= FCRAM_PAGE_COUNT) {
+		return;
+	}
+
+	auto [begin, end] = fcramPageMappings.equal_range(index);
+	if (std::none_of(begin, end, [page](const auto& mapping) { return mapping.second == page; })) {
+		fcramPageMappings.emplace(index, page);
+	}
+
+	if (watchedPages[index] != 0 || gpuPendingPages[index] != 0) {
+		updateJITPage(page);
+		updateHostPage(page);
+	}
+}
+
+void Memory::setPageWatched(u32 index, bool watched) {
+	if ((watchedPages[index] != 0) == watched) {
+		return;
+	}
+
+	watchedPages[index] = watched ? 1 : 0;
+	watchedPageCount += watched ? 1 : -1;
+
+	// VRAM is never mapped in the virtual page tables, so CPU writes to it always go through our handlers anyways
+	if (index < FCRAM_PAGE_COUNT) {
+		updateFCRAMPageMappings(index);
+	}
+}
+
+void Memory::updateFCRAMPageMappings(u32 index) {
+	const uintptr_t pointer = uintptr_t(&fcram[index * pageSize]);
+	auto [begin, end] = fcramPageMappings.equal_range(index);
+
+	for (auto it = begin; it != end; ++it) {
+		const u32 page = it->second;
+		// Skip stale mappings, the virtual page might have been remapped since we recorded it
+		if (writeTable[page] == pointer) {
+			updateJITPage(page);
+			updateHostPage(page);
+		}
+	}
+}
+
+void Memory::pageWritten(u32 index) {
+	pageWriteStamps[index] = ++writeStamp;
+	setPageWatched(index, false);
+}
+
+u64 Memory::watchPhysicalRange(u32 paddr, u32 size) {
+	if (size != 0) {
+		const u32 firstPage = paddr >> pageShift;
+		const u32 lastPage = (paddr + size - 1) >> pageShift;
+
+		for (u32 page = firstPage; page <= lastPage; page++) {
+			const u32 index = getPhysicalWatchIndex(page << pageShift);
+			if (index != invalidWatchIndex) {
+				setPageWatched(index, true);
+			}
+		}
+	}
+
+	return writeStamp;
+}
+
+bool Memory::isPhysicalRangeWritten(u32 paddr, u32 size, u64 stamp) const {
+	if (size == 0) {
+		return false;
+	}
+
+	const u32 firstPage = paddr >> pageShift;
+	const u32 lastPage = (paddr + size - 1) >> pageShift;
+
+	for (u32 page = firstPage; page <= lastPage; page++) {
+		const u32 index = getPhysicalWatchIndex(page << pageShift);
+		// Pages that aren't watched might have been written any number of times without us noticing
+		if (index == invalidWatchIndex || watchedPages[index] == 0 || pageWriteStamps[index] > stamp) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Memory::markPhysicalRangeWritten(u32 paddr, u32 size) {
+	if (watchedPageCount == 0 || size == 0) {
+		return;
+	}
+
+	const u32 firstPage = paddr >> pageShift;
+	const u32 lastPage = (paddr + size - 1) >> pageShift;
+
+	for (u32 page = firstPage; page <= lastPage; page++) {
+		const u32 index = getPhysicalWatchIndex(page << pageShift);
+		if (index != invalidWatchIndex && watchedPages[index] != 0) {
+			pageWritten(index);
+		}
+	}
+}
+
+void Memory::addPendingGPUWrite(u32 paddr, u32 size) {
+	if (size == 0) {
+		return;
+	}
+
+	const u32 firstPage = paddr >> pageShift;
+	const u32 lastPage = u32(std::min<u64>((u64(paddr) + size - 1) >> pageShift, totalPageCount - 1));
+
+	for (u32 page = firstPage; page <= lastPage; page++) {
+		const u32 index = getPhysicalWatchIndex(page << pageShift);
+		if (index == invalidWatchIndex || gpuPendingPages[index] != 0) {
+			continue;
+		}
+
+		gpuPendingPages[index] = 1;
+		gpuPendingIndices.push_back(index);
+		// VRAM never has a fast path to take away
+		if (index < FCRAM_PAGE_COUNT) {
+			updateFCRAMPageMappings(index);
+		}
+	}
+}
+
+void Memory::clearPendingGPUWrites() {
+	// Clear every flag before refreshing the mappings, so that isPointerGPUPending is false for all of them
+	for (const u32 index : gpuPendingIndices) {
+		gpuPendingPages[index] = 0;
+	}
+
+	for (const u32 index : gpuPendingIndices) {
+		if (index < FCRAM_PAGE_COUNT) {
+			updateFCRAMPageMappings(index);
+		}
+	}
+	gpuPendingIndices.clear();
+}
+
+void Memory::waitForPendingGPUWrites(u32 vaddr, usize size) {
+	if (size == 0 || !waitForGPU) {
+		return;
+	}
+
+	const u32 firstPage = vaddr >> pageShift;
+	const u32 lastPage = u32(std::min<u64>((u64(vaddr) + size - 1) >> pageShift, totalPageCount - 1));
+
+	for (u32 page = firstPage; page <= lastPage; page++) {
+		uintptr_t pointer = readTable[page];
+		// VRAM isn't in the virtual page tables, but it's the most common destination of GPU writes
+		const u32 pageAddr = page << pageShift;
+		if (pointer == 0 && vram != nullptr && pageAddr >= VirtualAddrs::VramStart && pageAddr < VirtualAddrs::VramStart + VirtualAddrs::VramSize) {
+			pointer = uintptr_t(&vram[pageAddr - VirtualAddrs::VramStart]);
+		}
+
+		if (pointer != 0 && isPointerGPUPending(pointer)) {
+			// The GPU thread executes commands in order, so once it's idle every pending write has happened
+			waitForGPU();
+			clearPendingGPUWrites();
+			return;
+		}
+	}
+}
+
 // Get the number of ms since Jan 1 1900
 u64 Memory::timeSince3DSEpoch() {
 	using namespace std::chrono;
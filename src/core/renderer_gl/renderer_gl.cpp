@@ -2,10 +2,13 @@
 
 #include <stb_image_write.h>
 
+#include <bit>
+
 #include <cmrc/cmrc.hpp>
 
 #include "PICA/float_types.hpp"
 #include "PICA/gpu.hpp"
+#include "PICA/pica_hash.hpp"
 #include "PICA/regs.hpp"
 #include "math_util.hpp"
 
@@ -21,6 +24,10 @@ void RendererGL::reset() {
 	depthBufferCache.reset();
 	colourBufferCache.reset();
 	textureCache.reset();
+	textureCacheStats = {};
+	drawBatch.vertexCount = 0;
+	drawBatch.indexCount = 0;
+	dirtyRegGroups = PICA::RegGroup::All;
 
 	// Init the colour/depth buffer settings to some random defaults on reset
 	colourBufferLoc = 0;
@@ -48,6 +55,7 @@ void RendererGL::reset() {
 
 void RendererGL::initGraphicsContextInternal() {
 	gl.reset();
+	dirtyRegGroups = PICA::RegGroup::All;
 
 	auto gl_resources = cmrc::RendererGL::get_filesystem();
 
@@ -86,7 +94,7 @@ void RendererGL::initGraphicsContextInternal() {
 	gl.useProgram(displayProgram);
 	glUniform1i(OpenGL::uniformLocation(displayProgram, "u_texture"), 0);  // Init sampler object
 
-	vbo.createFixedSize(sizeof(Vertex) * vertexBufferSize, GL_STREAM_DRAW);
+	vbo.create();
 	gl.bindVBO(vbo);
 	vao.create();
 	gl.bindVAO(vao);
@@ -116,6 +124,11 @@ void RendererGL::initGraphicsContextInternal() {
 	vao.setAttributeFloat<float>(7, 2, sizeof(Vertex), offsetof(Vertex, s.texcoord2));
 	vao.enableAttribute(7);
 
+	// Index buffer for indexed draws. Binding it while the VAO is bound attaches it to the VAO
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	createStreamBuffers();
+
 	dummyVBO.create();
 	dummyVAO.create();
 	gl.disableScissor();
@@ -291,7 +304,7 @@ void RendererGL::setupStencilTest(bool stencilEnable) {
 
 
 void RendererGL::setupTextureEnvState() {
-	// TODO: Only update uniforms when the TEV config changed. Use an UBO potentially.
+	// TODO: Use an UBO potentially.
 
 	static constexpr std::array<u32, 6> ioBases = {
 		PICA::InternalRegs::TexEnv0Source, PICA::InternalRegs::TexEnv1Source, PICA::InternalRegs::TexEnv2Source,
@@ -321,7 +334,7 @@ void RendererGL::setupTextureEnvState() {
 	glUniform1uiv(textureEnvScaleLoc, 6, textureEnvScaleRegs);
 }
 
-void RendererGL::bindTexturesToSlots() {
+void RendererGL::bindTexturesToSlots(u32 dirtyGroups) {
 	static constexpr std::array<u32, 3> ioBases = {
 		PICA::InternalRegs::Tex0BorderColor,
 		PICA::InternalRegs::Tex1BorderColor,
@@ -329,7 +342,8 @@ void RendererGL::bindTexturesToSlots() {
 	};
 
 	for (int i = 0; i < 3; i++) {
-		if ((regs[PICA::InternalRegs::TexUnitCfg] & (1 << i)) == 0) {
+		const bool unitDirty = (dirtyGroups & (PICA::RegGroup::TexUnit0 << i)) != 0;
+		if (!unitDirty || (regs[PICA::InternalRegs::TexUnitCfg] & (1 << i)) == 0) {
 			continue;
 		}
 
@@ -380,7 +394,7 @@ void RendererGL::updateLightingLUT() {
 	glActiveTexture(GL_TEXTURE0);
 }
 
-void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> vertices) {
+OpenGL::Primitives RendererGL::setupDraw(PICA::PrimType primType) {
 	// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
 	static constexpr std::array<OpenGL::Primitives, 4> primTypes = {
 		OpenGL::Triangle,
@@ -400,10 +414,16 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 		gl.enableClipPlane(1);
 	}
 
-	setupBlending();
 	auto poop = getColourBuffer(colourBufferLoc, colourBufferFormat, fbSize[0], fbSize[1]);
 	poop->fbo.bind(OpenGL::DrawAndReadFramebuffer);
 
+	// Only rebuild the state of the register groups that changed since the last draw
+	// This needs to happen after getColourBuffer, which marks some groups as dirty if it creates a new surface
+	const u32 dirty = std::exchange(dirtyRegGroups, 0) | gpu.consumeDirtyRegGroups();
+	if (dirty & PICA::RegGroup::Blending) {
+		setupBlending();
+	}
+
 	const u32 depthControl = regs[PICA::InternalRegs::DepthAndColorMask];
 	const bool depthWrite = regs[PICA::InternalRegs::DepthBufferWrite];
 	const bool depthEnable = depthControl & 1;
@@ -434,12 +454,20 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 		glUniform1i(depthmapEnableLoc, depthMapEnable);
 	}
 
-	setupTextureEnvState();
-	bindTexturesToSlots();
+	if (dirty & PICA::RegGroup::TexEnv) {
+		setupTextureEnvState();
+	}
+
+	if (dirty & PICA::RegGroup::TexUnits) {
+		bindTexturesToSlots(dirty);
+	}
 
 	// Upload PICA Registers as a single uniform. The shader needs access to the rasterizer registers (for depth, starting from index 0x48)
 	// The texturing and the fragment lighting registers. Therefore we upload them all in one go to avoid multiple slow uniform updates
-	glUniform1uiv(picaRegLoc, 0x200 - 0x48, &regs[0x48]);
+	// Every register group lives in this range, so we only need to upload them if one of the groups changed
+	if (dirty != 0) {
+		glUniform1uiv(picaRegLoc, 0x200 - 0x48, &regs[0x48]);
+	}
 
 	if (gpu.lightingLUTDirty) {
 		updateLightingLUT();
@@ -450,40 +478,222 @@ void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> v
 	const GLsizei viewportWidth = GLsizei(f24::fromRaw(regs[PICA::InternalRegs::ViewportWidth] & 0xffffff).toFloat32() * 2.0f);
 	const GLsizei viewportHeight = GLsizei(f24::fromRaw(regs[PICA::InternalRegs::ViewportHeight] & 0xffffff).toFloat32() * 2.0f);
 	const auto rect = poop->getSubRect(colourBufferLoc, fbSize[0], fbSize[1]);
-	OpenGL::setViewport(rect.left + viewportX, rect.bottom + viewportY, viewportWidth, viewportHeight);
+	if (dirty & (PICA::RegGroup::Viewport | PICA::RegGroup::Framebuffer)) {
+		OpenGL::setViewport(rect.left + viewportX, rect.bottom + viewportY, viewportWidth, viewportHeight);
+	}
 
-	const u32 stencilConfig = regs[PICA::InternalRegs::StencilTest];
-	const bool stencilEnable = getBit<0>(stencilConfig);
-
-	// Note: The code below must execute after we've bound the colour buffer & its framebuffer
-	// Because it attaches a depth texture to the aforementioned colour buffer
-	if (depthEnable) {
-		gl.enableDepth();
-		gl.setDepthMask(depthWriteEnable && depthWrite ? GL_TRUE : GL_FALSE);
-		gl.setDepthFunc(depthModes[depthFunc]);
-		bindDepthBuffer();
-	} else {
-		if (depthWriteEnable) {
+	// The depth buffer attachment belongs to the colour buffer's framebuffer, so it only needs to be redone if that changed
+	if (dirty & (PICA::RegGroup::Depth | PICA::RegGroup::Framebuffer)) {
+		const u32 stencilConfig = regs[PICA::InternalRegs::StencilTest];
+		const bool stencilEnable = getBit<0>(stencilConfig);
+
+		// Note: The code below must execute after we've bound the colour buffer & its framebuffer
+		// Because it attaches a depth texture to the aforementioned colour buffer
+		if (depthEnable) {
 			gl.enableDepth();
-			gl.setDepthMask(GL_TRUE);
-			gl.setDepthFunc(GL_ALWAYS);
+			gl.setDepthMask(depthWriteEnable && depthWrite ? GL_TRUE : GL_FALSE);
+			gl.setDepthFunc(depthModes[depthFunc]);
 			bindDepthBuffer();
 		} else {
-			gl.disableDepth();
-
-			if (stencilEnable) {
+			if (depthWriteEnable) {
+				gl.enableDepth();
+				gl.setDepthMask(GL_TRUE);
+				gl.setDepthFunc(GL_ALWAYS);
 				bindDepthBuffer();
+			} else {
+				gl.disableDepth();
+
+				if (stencilEnable) {
+					bindDepthBuffer();
+				}
 			}
 		}
+
+		setupStencilTest(stencilEnable);
 	}
 
-	setupStencilTest(stencilEnable);
+	return primitiveTopology;
+}
+
+u64 RendererGL::getDrawStateHash() {
+	// setupDraw only reads the rasterizer, texturing, framebuffer and fragment lighting registers, which live in [0x40, 0x200)
+	// Along with the framebuffer configuration, which the GPU hands to us separately
+	constexpr u32 firstReg = 0x40;
+	constexpr u32 regCount = 0x200 - firstReg;
+	const std::array<u32, 6> framebufferState = {
+		colourBufferLoc, static_cast<u32>(colourBufferFormat), depthBufferLoc, static_cast<u32>(depthBufferFormat), fbSize[0], fbSize[1],
+	};
 
-	vbo.bufferVertsSub(vertices);
-	OpenGL::draw(primitiveTopology, GLsizei(vertices.size()));
+	const u64 regHash = PICAHash::computeHash(reinterpret_cast<const char*>(&regs[firstReg]), regCount * sizeof(u32));
+	const u64 framebufferHash = PICAHash::computeHash(reinterpret_cast<const char*>(framebufferState.data()), sizeof(framebufferState));
+	return regHash ^ std::rotl(framebufferHash, 1);
+}
+
+void RendererGL::createStreamBuffers() {
+	constexpr GLsizeiptr vertexRingBytes = streamRingSize * sizeof(Vertex);
+	constexpr GLsizeiptr indexRingBytes = streamRingSize * sizeof(u32);
+	streamVertices = nullptr;
+	streamIndices = nullptr;
+
+	// Expects the VBO and the index buffer to be bound
+	persistentStreaming = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+	if (persistentStreaming) {
+		// Keep dynamic storage enabled so that we can fall back to glBufferSubData if mapping fails
+		constexpr GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, vertexRingBytes, nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexRingBytes, nullptr, mapFlags | GL_DYNAMIC_STORAGE_BIT);
+
+		streamVertices = static_cast<Vertex*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexRingBytes, mapFlags));
+		streamIndices = static_cast<u32*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexRingBytes, mapFlags));
+
+		if (streamVertices == nullptr || streamIndices == nullptr) {
+			Helpers::warn("Failed to persistently map the streaming buffers, falling back to glBufferSubData");
+			persistentStreaming = false;
+		}
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, vertexRingBytes, nullptr, GL_STREAM_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexRingBytes, nullptr, GL_STREAM_DRAW);
+	}
+
+	if (!persistentStreaming) {
+		vertexShadow.resize(streamRingSize);
+		indexShadow.resize(streamRingSize);
+		streamVertices = vertexShadow.data();
+		streamIndices = indexShadow.data();
+	}
+
+	segmentFences.fill(nullptr);
+	streamSegment = 0;
+	vertexCursor = 0;
+	indexCursor = 0;
+	drawBatch.vertexCount = 0;
+	drawBatch.indexCount = 0;
+}
+
+void RendererGL::reserveStream(u32 vertexCount, u32 indexCount) {
+	const u32 segmentEnd = (streamSegment + 1) * vertexBufferSize;
+	if (vertexCursor + vertexCount <= segmentEnd && indexCursor + indexCount <= segmentEnd) [[likely]] {
+		return;
+	}
+
+	// Whatever is queued lives in the current segment, so it needs to be submitted before we fence it
+	flushDraws();
+	if (persistentStreaming) {
+		segmentFences[streamSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	streamSegment = (streamSegment + 1) % streamSegmentCount;
+	vertexCursor = streamSegment * vertexBufferSize;
+	indexCursor = streamSegment * vertexBufferSize;
+
+	// Wait for the host GPU to be done with the last draws that read from the segment we're about to overwrite
+	GLsync& fence = segmentFences[streamSegment];
+	if (fence != nullptr) {
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+std::span<Vertex> RendererGL::getVertexBuffer(u32 vertexCount, u32 indexCount) {
+	reserveStream(vertexCount, indexCount);
+	return {streamVertices + vertexCursor, vertexCount};
+}
+
+void RendererGL::queueDraw(PICA::PrimType primType, std::span<const Vertex> vertices, std::span<const u16> indices, bool indexed) {
+	const u32 vertexCount = u32(vertices.size());
+	const u32 indexCount = u32(indices.size());
+
+	// Vertices shaded by the GPU are already in the ring. Others, like the ones from immediate mode, still need to be copied in
+	if (vertices.data() != streamVertices + vertexCursor) {
+		reserveStream(vertexCount, indexCount);
+		std::copy(vertices.begin(), vertices.end(), streamVertices + vertexCursor);
+	}
+
+	// Only triangle lists can be concatenated, strips and fans would need primitive restart. Draws that update the lighting LUT can't
+	// be batched either, as the new LUT would also apply to the draws that were queued before it
+	const bool batchable = (primType == PICA::PrimType::TriangleList || primType == PICA::PrimType::GeometryPrimitive) && !gpu.lightingLUTDirty;
+	// The batch always holds the hash of the state from the last setupDraw. If no register group changed since, there's no need to hash it
+	const bool stateChanged = (dirtyRegGroups | gpu.dirtyRegGroups) != 0;
+	const u64 stateHash = stateChanged ? getDrawStateHash() : drawBatch.stateHash;
+	const bool appendToBatch = batchable && !drawBatch.empty() && drawBatch.stateHash == stateHash && drawBatch.indexed == indexed &&
+							   drawBatch.firstVertex + drawBatch.vertexCount == vertexCursor;
+
+	if (!appendToBatch) {
+		flushDraws();
+		drawBatch.topology = setupDraw(primType);
+		drawBatch.stateHash = stateHash;
+		drawBatch.indexed = indexed;
+		drawBatch.firstVertex = vertexCursor;
+		drawBatch.firstIndex = indexCursor;
+	}
+
+	for (u32 i = 0; i < indexCount; i++) {
+		streamIndices[indexCursor + i] = vertexCursor + indices[i];
+	}
+
+	drawBatch.vertexCount += vertexCount;
+	drawBatch.indexCount += indexCount;
+	vertexCursor += vertexCount;
+	indexCursor += indexCount;
+
+	if (!batchable) {
+		flushDraws();
+	}
+}
+
+void RendererGL::flushDraws() {
+	if (drawBatch.empty()) {
+		return;
+	}
+
+	gl.bindVBO(vbo);
+	gl.bindVAO(vao);
+
+	if (!persistentStreaming) {
+		const std::span<const Vertex> vertices(&vertexShadow[drawBatch.firstVertex], drawBatch.vertexCount);
+		vbo.bufferVertsSub(vertices, drawBatch.firstVertex * sizeof(Vertex));
+
+		if (drawBatch.indexed) {
+			const GLintptr offset = drawBatch.firstIndex * sizeof(u32);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, drawBatch.indexCount * sizeof(u32), &indexShadow[drawBatch.firstIndex]);
+		}
+	}
+
+	if (drawBatch.indexed) {
+		// Only the unique vertices get uploaded, duplicates are expressed through the index buffer
+		const void* offset = reinterpret_cast<const void*>(uintptr_t(drawBatch.firstIndex) * sizeof(u32));
+		glDrawElements(static_cast<GLenum>(drawBatch.topology), GLsizei(drawBatch.indexCount), GL_UNSIGNED_INT, offset);
+	} else {
+		OpenGL::draw(drawBatch.topology, GLint(drawBatch.firstVertex), GLsizei(drawBatch.vertexCount));
+	}
+
+	drawBatch.vertexCount = 0;
+	drawBatch.indexCount = 0;
+}
+
+void RendererGL::releaseDrawState() {
+	flushDraws();
+	// We don't track what the caller is about to change, so rebuild everything setupDraw sets up on the next draw
+	dirtyRegGroups = PICA::RegGroup::All;
+}
+
+void RendererGL::flush() {
+	flushDraws();
+	// The CPU might write to textures before the next command list, so make sure the next draw checks them again
+	dirtyRegGroups |= PICA::RegGroup::TexUnits;
+}
+
+void RendererGL::drawVertices(PICA::PrimType primType, std::span<const Vertex> vertices) { queueDraw(primType, vertices, {}, false); }
+
+void RendererGL::drawIndexedVertices(PICA::PrimType primType, std::span<const Vertex> vertices, std::span<const u16> indices) {
+	queueDraw(primType, vertices, indices, true);
 }
 
 void RendererGL::display() {
+	releaseDrawState();
 	gl.disableScissor();
 	gl.disableBlend();
 	gl.disableDepth();
@@ -531,6 +741,7 @@ void RendererGL::display() {
 
 void RendererGL::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
 	log("GPU: Clear buffer\nStart: %08X End: %08X\nValue: %08X Control: %08X\n", startAddress, endAddress, value, control);
+	releaseDrawState();
 	gl.disableScissor();
 
 	const auto color = colourBufferCache.findFromAddress(startAddress);
@@ -600,6 +811,8 @@ void RendererGL::bindDepthBuffer() {
 		tex = buffer.value().get().texture.m_handle;
 	} else {
 		tex = depthBufferCache.add(sampleBuffer).texture.m_handle;
+		// Allocating the buffer bound its texture to the active texture unit, which is unit 0 outside of bindTexturesToSlots
+		dirtyRegGroups |= PICA::RegGroup::TexUnit0;
 	}
 
 	if (PICA::DepthFmt::Depth24Stencil8 != depthBufferFormat) {
@@ -610,15 +823,48 @@ void RendererGL::bindDepthBuffer() {
 }
 
 OpenGL::Texture RendererGL::getTexture(Texture& tex) {
+	Memory& mem = gpu.getMemory();
+	const u32 size = u32(tex.sizeInBytes());
+	const auto getTextureData = [&]() { return std::span<const u8>{gpu.getPointerPhys<u8>(tex.location), size}; };
+	const auto hashTextureData = [](std::span<const u8> data) {
+		return PICAHash::computeHash(reinterpret_cast<const char*>(data.data()), data.size());
+	};
+
 	// Similar logic as the getColourFBO/bindDepthBuffer functions
 	auto buffer = textureCache.find(tex);
 
 	if (buffer.has_value()) {
-		return buffer.value().get().texture;
+		Texture& cachedTex = buffer.value().get();
+
+		// Memory tracks writes to the pages backing the texture, so we only need to look at its data if one of them was written.
+		// Even then, games often rewrite textures with the same data, so hash it and only decode it again if it actually changed
+		if (mem.isPhysicalRangeWritten(tex.location, size, cachedTex.writeStamp)) {
+			const auto textureData = getTextureData();
+			const u64 hash = hashTextureData(textureData);
+
+			if (hash != cachedTex.contentHash) {
+				cachedTex.decodeTexture(textureData, textureDecodeBuffer);
+				cachedTex.contentHash = hash;
+				textureCacheStats.reuploads++;
+			} else {
+				textureCacheStats.hits++;
+			}
+
+			cachedTex.writeStamp = mem.watchPhysicalRange(tex.location, size);
+		} else {
+			textureCacheStats.hits++;
+		}
+
+		return cachedTex.texture;
 	} else {
-		const auto textureData = std::span{gpu.getPointerPhys<u8>(tex.location), tex.sizeInBytes()};  // Get pointer to the texture data in 3DS memory
+		const auto textureData = getTextureData();  // Get pointer to the texture data in 3DS memory
 		Texture& newTex = textureCache.add(tex);
-		newTex.decodeTexture(textureData);
+		newTex.decodeTexture(textureData, textureDecodeBuffer);
+		// Adding the texture might have evicted one that another texture unit had bound, so rebind all of them on the next draw
+		dirtyRegGroups |= PICA::RegGroup::TexUnits;
+		newTex.contentHash = hashTextureData(textureData);
+		newTex.writeStamp = mem.watchPhysicalRange(tex.location, size);
+		textureCacheStats.misses++;
 
 		return newTex.texture;
 	}
@@ -634,6 +880,7 @@ PICA::ColorFmt ToColorFmt(u32 format) {
 }
 
 void RendererGL::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
+	releaseDrawState();
 	const u32 inputWidth = inputSize & 0xffff;
 	const u32 inputHeight = inputSize >> 16;
 	const auto inputFormat = ToColorFmt(Helpers::getBits<8, 3>(flags));
@@ -682,6 +929,7 @@ void RendererGL::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u
 }
 
 void RendererGL::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {
+	releaseDrawState();
 	// Texture copy size is aligned to 16 byte units
 	const u32 copySize = totalBytes & ~0xf;
 	if (copySize == 0) {
@@ -773,12 +1021,15 @@ std::optional<ColourBuffer> RendererGL::getColourBuffer(u32 addr, PICA::ColorFmt
 		return std::nullopt;
 	}
 
-	// Otherwise create and cache a new buffer.
+	// Otherwise create and cache a new buffer. Allocating it binds its texture to texture unit 0, so that needs to be rebound
+	// And the new framebuffer doesn't have a depth buffer attached yet
 	ColourBuffer sampleBuffer(addr, format, width, height);
+	dirtyRegGroups |= PICA::RegGroup::TexUnit0 | PICA::RegGroup::Framebuffer;
 	return colourBufferCache.add(sampleBuffer);
 }
 
 void RendererGL::screenshot(const std::string& name) {
+	releaseDrawState();
 	constexpr uint width = 400;
 	constexpr uint height = 2 * 240;
 
@@ -804,6 +1055,13 @@ void RendererGL::screenshot(const std::string& name) {
 }
 
 void RendererGL::deinitGraphicsContext() {
+	flushDraws();
+	for (GLsync& fence : segmentFences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
 	// Invalidate all surface caches since they'll no longer be valid
 	textureCache.reset();
 	depthBufferCache.reset();
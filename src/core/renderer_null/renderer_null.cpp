@@ -11,5 +11,6 @@ void RendererNull::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32
 void RendererNull::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {}
 void RendererNull::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {}
 void RendererNull::drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) {}
+void RendererNull::drawIndexedVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices) {}
 void RendererNull::screenshot(const std::string& name) {}
 void RendererNull::deinitGraphicsContext() {}
\ No newline at end of file
@@ -0,0 +1,978 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "PICA/float_types.hpp"
+#include "PICA/gpu.hpp"
+#include "PICA/regs.hpp"
+#include "renderer_sw/renderer_sw.hpp"
+
+using namespace Floats;
+using namespace Helpers;
+using namespace PICA;
+
+namespace {
+	using vec3 = std::array<float, 3>;
+	using vec4 = std::array<float, 4>;
+
+	float dot(const vec3& a, const vec3& b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+	vec3 cross(const vec3& a, const vec3& b) { return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]}; }
+
+	vec3 normalize(const vec3& v) {
+		const float length = std::sqrt(dot(v, v));
+		if (length == 0.f) {
+			return v;
+		}
+
+		const float invLength = 1.0f / length;
+		return {v[0] * invLength, v[1] * invLength, v[2] * invLength};
+	}
+
+	vec3 rotateVec3ByQuaternion(const vec3& v, const vec4& q) {
+		const vec3 u = {q[0], q[1], q[2]};
+		const float s = q[3];
+		const float uDotV = 2.0f * dot(u, v);
+		const float scale = s * s - dot(u, u);
+		const vec3 c = cross(u, v);
+
+		return {
+			uDotV * u[0] + scale * v[0] + 2.0f * s * c[0],
+			uDotV * u[1] + scale * v[1] + 2.0f * s * c[1],
+			uDotV * u[2] + scale * v[2] + 2.0f * s * c[2],
+		};
+	}
+
+	vec4 abgr8888ToVec4(u32 abgr) {
+		constexpr float scale = 1.0f / 255.0f;
+		return {float(abgr & 0xff) * scale, float((abgr >> 8) & 0xff) * scale, float((abgr >> 16) & 0xff) * scale, float(abgr >> 24) * scale};
+	}
+
+	// Lighting colours are stored as 3 10-bit fields, of which only the bottom 8 bits are used
+	vec3 regToColour(u32 reg) {
+		constexpr float scale = 1.0f / 255.0f;
+		return {float(getBits<20, 8>(reg)) * scale, float(getBits<10, 8>(reg)) * scale, float(getBits<0, 8>(reg)) * scale};
+	}
+
+	// Convert an arbitrary-width floating point literal to an f32
+	float decodeFP(u32 hex, u32 E, u32 M) {
+		const u32 width = M + E + 1;
+		const u32 bias = 128 - (1 << (E - 1));
+		u32 exponent = (hex >> M) & ((1 << E) - 1);
+		const u32 mantissa = hex & ((1 << M) - 1);
+		const u32 sign = (hex >> (E + M)) << 31;
+
+		if ((hex & ((1 << (width - 1)) - 1)) != 0) {
+			if (exponent == (1u << E) - 1) {
+				exponent = 255;
+			} else {
+				exponent += bias;
+			}
+			hex = sign | (mantissa << (23 - M)) | (exponent << 23);
+		} else {
+			hex = sign;
+		}
+
+		return std::bit_cast<float>(hex);
+	}
+
+	float f24ToFloat(u32 reg) { return f24::fromRaw(reg & 0xffffff).toFloat32(); }
+
+	// Comparison functions shared by the alpha, stencil and depth tests
+	template <typename T>
+	bool compare(u32 func, T value, T reference) {
+		switch (func) {
+			case 0: return false;                // Never
+			case 1: return true;                 // Always
+			case 2: return value == reference;   // Equal
+			case 3: return value != reference;   // Not equal
+			case 4: return value < reference;    // Less than
+			case 5: return value <= reference;   // Less than or equal
+			case 6: return value > reference;    // Greater than
+			case 7: return value >= reference;   // Greater than or equal
+			default: return true;
+		}
+	}
+
+	u8 applyStencilOp(u32 op, u8 value, u8 reference) {
+		switch (op) {
+			case 0: return value;                              // Keep
+			case 1: return 0;                                  // Zero
+			case 2: return reference;                          // Replace
+			case 3: return (value == 0xff) ? value : value + 1;  // Increment with saturation
+			case 4: return (value == 0) ? value : value - 1;     // Decrement with saturation
+			case 5: return ~value;                             // Invert
+			case 6: return value + 1;                          // Increment with wrap-around
+			case 7: return value - 1;                          // Decrement with wrap-around
+			default: return value;
+		}
+	}
+
+	// Fetch a blending factor for channel "channel". Func = 15 is undocumented and stubbed to GL_ONE for now, like the GL backend
+	float getBlendFactor(u32 func, int channel, const vec4& source, const vec4& dest, const vec4& constant) {
+		switch (func) {
+			case 0: return 0.0f;
+			case 1: return 1.0f;
+			case 2: return source[channel];
+			case 3: return 1.0f - source[channel];
+			case 4: return dest[channel];
+			case 5: return 1.0f - dest[channel];
+			case 6: return source[3];
+			case 7: return 1.0f - source[3];
+			case 8: return dest[3];
+			case 9: return 1.0f - dest[3];
+			case 10: return constant[channel];
+			case 11: return 1.0f - constant[channel];
+			case 12: return constant[3];
+			case 13: return 1.0f - constant[3];
+			case 14: return (channel == 3) ? 1.0f : std::min(source[3], 1.0f - dest[3]);  // Source alpha saturate
+			default: return 1.0f;
+		}
+	}
+
+	float applyBlendEquation(u32 equation, float source, float sourceFactor, float dest, float destFactor) {
+		switch (equation) {
+			case 1: return source * sourceFactor - dest * destFactor;  // Subtract
+			case 2: return dest * destFactor - source * sourceFactor;  // Reverse subtract
+			case 3: return std::min(source, dest);                     // Min
+			case 4: return std::max(source, dest);                     // Max
+			default: return source * sourceFactor + dest * destFactor;  // Add. The unused equations are equivalent to it
+		}
+	}
+
+	u8 applyLogicOp(u32 op, u8 s, u8 d) {
+		switch (op) {
+			case 0: return 0;                // Clear
+			case 1: return s & d;            // And
+			case 2: return s & ~d;           // And reverse
+			case 3: return s;                // Copy
+			case 4: return 0xff;             // Set
+			case 5: return ~s;               // Copy inverted
+			case 6: return d;                // No-op
+			case 7: return ~d;               // Invert
+			case 8: return ~(s & d);         // Nand
+			case 9: return s | d;            // Or
+			case 10: return ~(s | d);        // Nor
+			case 11: return s ^ d;           // Xor
+			case 12: return ~(s ^ d);        // Equivalent
+			case 13: return ~s & d;          // And inverted
+			case 14: return s | ~d;          // Or reverse
+			case 15: return ~s | d;          // Or inverted
+			default: return s;
+		}
+	}
+
+	// An edge is "top-left" if it is a top edge (horizontal, with the triangle below it) or a left edge
+	// Pixels whose centre lies exactly on an edge are only drawn if it's a top-left edge, so that shared edges are only drawn once
+	bool isTopLeft(s32 ax, s32 ay, s32 bx, s32 by) {
+		const s32 dx = bx - ax;
+		const s32 dy = by - ay;
+		return (dy < 0) || (dy == 0 && dx < 0);
+	}
+}  // namespace
+
+void RendererSw::captureDrawState() {
+	using namespace PICA::InternalRegs;
+
+	state.width = fbSize[0];
+	state.height = fbSize[1];
+	state.colourFormat = colourBufferFormat;
+	state.depthFormat = depthBufferFormat;
+
+	const u32 colourSize = state.width * state.height * sizePerPixel(colourBufferFormat);
+	const u32 depthSize = state.width * state.height * sizePerPixel(depthBufferFormat);
+	const auto colourSpan = mem.getPhysSpan(colourBufferLoc, colourSize);
+	const auto depthSpan = mem.getPhysSpan(depthBufferLoc, depthSize);
+	state.colourBuffer = colourSpan.empty() ? nullptr : colourSpan.data();
+	state.depthBuffer = depthSpan.empty() ? nullptr : depthSpan.data();
+
+	state.viewportHalfWidth = f24ToFloat(regs[ViewportWidth]);
+	state.viewportHalfHeight = f24ToFloat(regs[ViewportHeight]);
+	state.viewportX = s32(regs[ViewportXY] & 0x3ff);
+	state.viewportY = s32((regs[ViewportXY] >> 16) & 0x3ff);
+
+	state.userClipEnable = (regs[ClipEnable] & 1) != 0;
+	state.userClipPlane = {f24ToFloat(regs[ClipData0]), f24ToFloat(regs[ClipData1]), f24ToFloat(regs[ClipData2]), f24ToFloat(regs[ClipData3])};
+
+	state.depthScale = f24ToFloat(regs[DepthScale]);
+	state.depthOffset = f24ToFloat(regs[DepthOffset]);
+	state.depthMapEnable = (regs[DepthmapEnable] & 1) != 0;
+
+	// Depth test & writes. If the depth test is off but depth writes are on, the PICA writes depth unconditionally
+	const u32 depthControl = regs[DepthAndColorMask];
+	const bool depthBufferWrite = regs[DepthBufferWrite] != 0;
+	const bool depthEnable = getBit<0>(depthControl);
+	const bool depthWriteEnable = getBit<12>(depthControl);
+	const u32 colourMask = getBits<8, 4>(depthControl);
+
+	if (depthEnable) {
+		state.depthTest = true;
+		state.depthFunc = getBits<4, 3>(depthControl);
+		state.depthWrite = depthWriteEnable && depthBufferWrite;
+	} else {
+		state.depthTest = depthWriteEnable;
+		state.depthFunc = 1;  // Always pass
+		state.depthWrite = depthWriteEnable;
+	}
+	state.colourMask = {(colourMask & 1) != 0, (colourMask & 2) != 0, (colourMask & 4) != 0, (colourMask & 8) != 0};
+
+	// Stencil test. There's only a stencil buffer for D24S8 depth buffers
+	const u32 stencilConfig = regs[StencilTest];
+	const u32 stencilOpConfig = regs[StencilOp];
+	state.stencilTest = getBit<0>(stencilConfig) && hasStencil(depthBufferFormat);
+	state.stencilFunc = getBits<4, 3>(stencilConfig);
+	state.stencilWriteMask = depthBufferWrite ? getBits<8, 8>(stencilConfig) : 0;
+	state.stencilRef = getBits<16, 8>(stencilConfig);
+	state.stencilRefMask = getBits<24, 8>(stencilConfig);
+	state.stencilFailOp = getBits<0, 3>(stencilOpConfig);
+	state.depthFailOp = getBits<4, 3>(stencilOpConfig);
+	state.passOp = getBits<8, 3>(stencilOpConfig);
+
+	if (state.depthBuffer == nullptr && (state.depthTest || state.stencilTest)) {
+		Helpers::warn("[RendererSW] Depth buffer at %08X is not backed by memory, disabling depth & stencil test", depthBufferLoc);
+		state.depthTest = false;
+		state.stencilTest = false;
+	}
+
+	const u32 alphaConfig = regs[AlphaTestConfig];
+	state.alphaTest = getBit<0>(alphaConfig);
+	state.alphaFunc = getBits<4, 3>(alphaConfig);
+	state.alphaRef = getBits<8, 8>(alphaConfig);
+
+	// Blending. If it is not enabled, then logic ops are enabled instead
+	const u32 blendControl = regs[BlendFunc];
+	state.blendEnable = (regs[ColourOperation] & (1 << 8)) != 0;
+	state.rgbEquation = getBits<0, 3>(blendControl);
+	state.alphaEquation = getBits<8, 3>(blendControl);
+	state.rgbSourceFunc = getBits<16, 4>(blendControl);
+	state.rgbDestFunc = getBits<20, 4>(blendControl);
+	state.alphaSourceFunc = getBits<24, 4>(blendControl);
+	state.alphaDestFunc = getBits<28, 4>(blendControl);
+	state.blendColour = abgr8888ToVec4(regs[BlendColour]);
+	state.logicOp = getBits<0, 4>(regs[LogicOp]);
+
+	// Textures
+	static constexpr std::array<u32, 3> textureIoBases = {Tex0BorderColor, Tex1BorderColor, Tex2BorderColor};
+	const u32 textureConfig = regs[TexUnitCfg];
+	state.tex2UsesTexcoord1 = getBit<13>(textureConfig);
+
+	for (int i = 0; i < 3; i++) {
+		SwTexture& tex = state.textures[i];
+		state.textureEnabled[i] = (textureConfig & (1 << i)) != 0;
+		tex.valid = false;
+
+		if (!state.textureEnabled[i]) {
+			continue;
+		}
+
+		const u32 ioBase = textureIoBases[i];
+		const u32 dim = regs[ioBase + 1];
+		const u32 addr = (regs[ioBase + 4] & 0x0FFFFFFF) << 3;
+
+		tex.height = dim & 0x7ff;
+		tex.width = getBits<16, 11>(dim);
+		tex.config = regs[ioBase + 2];
+		tex.format = static_cast<TextureFmt>(regs[ioBase + (i == 0 ? 13 : 5)] & 0xF);
+		tex.borderColour = abgr8888ToVec4(regs[ioBase]);
+
+		// Mapping a texture from NULL is common, and like the GL backend we read it as transparent black
+		if (addr == 0 || tex.width == 0 || tex.height == 0) {
+			continue;
+		}
+
+		const auto span = mem.getPhysSpan(addr, u32(SwTexture::sizeInBytes(tex.format, tex.width, tex.height)));
+		if (!span.empty()) {
+			tex.data = span;
+			tex.valid = true;
+		}
+	}
+
+	// Texture environment
+	static constexpr std::array<u32, 6> tevIoBases = {
+		TexEnv0Source, TexEnv1Source, TexEnv2Source, TexEnv3Source, TexEnv4Source, TexEnv5Source,
+	};
+
+	for (int i = 0; i < 6; i++) {
+		const u32 ioBase = tevIoBases[i];
+
+		state.tevSource[i] = regs[ioBase];
+		state.tevOperand[i] = regs[ioBase + 1];
+		state.tevCombiner[i] = regs[ioBase + 2];
+		state.tevColour[i] = abgr8888ToVec4(regs[ioBase + 3]);
+		state.tevScale[i] = regs[ioBase + 4];
+	}
+
+	state.tevBufferColour = abgr8888ToVec4(regs[TexEnvBufferColor]);
+	state.tevUpdateBuffer = regs[TexEnvUpdateBuffer];
+
+	// Fragment lighting
+	state.lightingEnable = getBit<0>(regs[0x008F]);
+	if (state.lightingEnable) {
+		state.lightingAmbient = regToColour(regs[0x01C0]);
+		state.lightCount = (regs[0x01C2] & 0x7) + 1;
+		state.lightingConfig0 = regs[0x01C3];
+		state.lightingConfig1 = regs[0x01C4];
+		state.lutInputAbs = regs[0x01D0];
+		state.lutInputSelect = regs[0x01D1];
+		state.lutInputScale = regs[0x01D2];
+
+		const u32 permutation = regs[0x01D9];
+		for (u32 i = 0; i < state.lightCount; i++) {
+			LightState& light = state.lights[i];
+			light.id = (permutation >> (i * 3)) & 7;
+
+			const u32 base = 0x0140 + 0x10 * light.id;
+			light.specular0 = regToColour(regs[base]);
+			light.specular1 = regToColour(regs[base + 1]);
+			light.diffuse = regToColour(regs[base + 2]);
+			light.ambient = regToColour(regs[base + 3]);
+			light.config = regs[base + 9];
+
+			const u32 vectorLow = regs[base + 4];
+			const u32 vectorHigh = regs[base + 5];
+			light.vector = normalize({
+				decodeFP(getBits<0, 16>(vectorLow), 5, 10),
+				decodeFP(getBits<16, 16>(vectorLow), 5, 10),
+				decodeFP(getBits<0, 16>(vectorHigh), 5, 10),
+			});
+
+			const u32 spotLow = regs[base + 6];
+			const u32 spotHigh = regs[base + 7];
+			light.spotDirection = normalize({
+				decodeFP(getBits<0, 16>(spotLow), 1, 11),
+				decodeFP(getBits<16, 16>(spotLow), 1, 11),
+				decodeFP(getBits<0, 16>(spotHigh), 1, 11),
+			});
+		}
+	}
+}
+
+void RendererSw::clipAndSetupTriangle(const PICA::Vertex& v0, const PICA::Vertex& v1, const PICA::Vertex& v2) {
+	// Convert the shader output to the attributes we interpolate across the triangle
+	const auto toClipVertex = [](const PICA::Vertex& vert) {
+		ClipVertex out;
+		const auto& s = vert.s;
+
+		for (int i = 0; i < 4; i++) {
+			out.position[i] = s.positions[i].toFloat32();
+			out.attribs[ColourR + i] = std::min(std::abs(s.colour[i].toFloat32()), 1.0f);
+		}
+
+		out.attribs[Tex0U] = s.texcoord0[0].toFloat32();
+		out.attribs[Tex0V] = s.texcoord0[1].toFloat32();
+		out.attribs[Tex0W] = s.texcoord0_w.toFloat32();
+		out.attribs[Tex1U] = s.texcoord1[0].toFloat32();
+		out.attribs[Tex1V] = s.texcoord1[1].toFloat32();
+		out.attribs[Tex2U] = s.texcoord2[0].toFloat32();
+		out.attribs[Tex2V] = s.texcoord2[1].toFloat32();
+
+		// The quaternion describes a transformation from surface-local space to eye space
+		const vec4 quaternion = {s.quaternion[0].toFloat32(), s.quaternion[1].toFloat32(), s.quaternion[2].toFloat32(), s.quaternion[3].toFloat32()};
+		const vec3 normal = normalize(rotateVec3ByQuaternion({0.f, 0.f, 1.f}, quaternion));
+		const vec3 tangent = normalize(rotateVec3ByQuaternion({1.f, 0.f, 0.f}, quaternion));
+		const vec3 bitangent = normalize(rotateVec3ByQuaternion({0.f, 1.f, 0.f}, quaternion));
+
+		for (int i = 0; i < 3; i++) {
+			out.attribs[NormalX + i] = normal[i];
+			out.attribs[TangentX + i] = tangent[i];
+			out.attribs[BitangentX + i] = bitangent[i];
+			out.attribs[ViewX + i] = s.view[i].toFloat32();
+		}
+
+		return out;
+	};
+
+	// Clipping planes, in the form of a vector p where a vertex v is inside the plane if dot(p, v) >= 0
+	// Apart from the usual clip volume, the PICA clips against z <= 0 and an optional user-defined plane
+	static constexpr float wEpsilon = 1e-5f;
+	std::array<vec4, 8> planes = {{
+		{0.f, 0.f, 0.f, 1.f},   // w >= epsilon (Offset applied below)
+		{0.f, 0.f, -1.f, 0.f},  // z <= 0
+		{0.f, 0.f, 1.f, 1.f},   // z >= -w
+		{-1.f, 0.f, 0.f, 1.f},  // x <= w
+		{1.f, 0.f, 0.f, 1.f},   // x >= -w
+		{0.f, -1.f, 0.f, 1.f},  // y <= w
+		{0.f, 1.f, 0.f, 1.f},   // y >= -w
+		state.userClipPlane,
+	}};
+	const usize planeCount = state.userClipEnable ? 8 : 7;
+
+	const auto distance = [&](const ClipVertex& v, usize plane) {
+		const vec4& p = planes[plane];
+		const float d = p[0] * v.position[0] + p[1] * v.position[1] + p[2] * v.position[2] + p[3] * v.position[3];
+		return (plane == 0) ? d - wEpsilon : d;
+	};
+
+	// Every plane can add at most one vertex to the polygon
+	static constexpr usize maxVertices = 3 + 8;
+	std::array<ClipVertex, maxVertices> buffers[2];
+	usize count = 3;
+
+	buffers[0][0] = toClipVertex(v0);
+	buffers[0][1] = toClipVertex(v1);
+	buffers[0][2] = toClipVertex(v2);
+	int current = 0;
+
+	for (usize plane = 0; plane < planeCount; plane++) {
+		const auto& input = buffers[current];
+		auto& output = buffers[current ^ 1];
+		usize outCount = 0;
+
+		bool allInside = true;
+		for (usize i = 0; i < count; i++) {
+			if (distance(input[i], plane) < 0.f) {
+				allInside = false;
+				break;
+			}
+		}
+
+		// Fast path for the common case where the polygon is entirely on the inside of the plane
+		if (allInside) {
+			continue;
+		}
+
+		for (usize i = 0; i < count; i++) {
+			const ClipVertex& a = input[i];
+			const ClipVertex& b = input[(i + 1) % count];
+			const float da = distance(a, plane);
+			const float db = distance(b, plane);
+
+			if (da >= 0.f) {
+				output[outCount++] = a;
+			}
+
+			// The edge crosses the plane, so emit the intersection point
+			if ((da >= 0.f) != (db >= 0.f)) {
+				const float t = da / (da - db);
+				ClipVertex& v = output[outCount++];
+
+				for (int j = 0; j < 4; j++) {
+					v.position[j] = a.position[j] + (b.position[j] - a.position[j]) * t;
+				}
+
+				for (u32 j = 0; j < AttribCount; j++) {
+					v.attribs[j] = a.attribs[j] + (b.attribs[j] - a.attribs[j]) * t;
+				}
+			}
+		}
+
+		count = outCount;
+		current ^= 1;
+
+		if (count < 3) {
+			return;
+		}
+	}
+
+	// Triangulate the clipped polygon as a fan
+	const auto& polygon = buffers[current];
+	for (usize i = 1; i + 1 < count; i++) {
+		setupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+	}
+}
+
+void RendererSw::setupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2) {
+	TriangleSetup tri;
+	std::array<const ClipVertex*, 3> verts = {&v0, &v1, &v2};
+
+	for (int i = 0; i < 3; i++) {
+		const ClipVertex& v = *verts[i];
+		const float invW = 1.0f / v.position[3];
+
+		// Viewport transform, with the result converted to 28.4 fixed point
+		const float x = (v.position[0] * invW + 1.0f) * state.viewportHalfWidth + float(state.viewportX);
+		const float y = (v.position[1] * invW + 1.0f) * state.viewportHalfHeight + float(state.viewportY);
+		tri.x[i] = s32(std::lround(x * 16.0f));
+		tri.y[i] = s32(std::lround(y * 16.0f));
+
+		tri.invW[i] = invW;
+		tri.zOverW[i] = v.position[2] * invW;
+		for (u32 j = 0; j < AttribCount; j++) {
+			tri.attribsOverW[i][j] = v.attribs[j] * invW;
+		}
+	}
+
+	// The PICA doesn't cull triangles itself, so make every triangle counter-clockwise and skip degenerate ones
+	s64 area = s64(tri.x[1] - tri.x[0]) * s64(tri.y[2] - tri.y[0]) - s64(tri.y[1] - tri.y[0]) * s64(tri.x[2] - tri.x[0]);
+	if (area == 0) {
+		return;
+	}
+
+	if (area < 0) {
+		area = -area;
+		std::swap(tri.x[1], tri.x[2]);
+		std::swap(tri.y[1], tri.y[2]);
+		std::swap(tri.invW[1], tri.invW[2]);
+		std::swap(tri.zOverW[1], tri.zOverW[2]);
+		std::swap(tri.attribsOverW[1], tri.attribsOverW[2]);
+	}
+
+	tri.invArea = 1.0f / float(area);
+	tri.minX = std::max<s32>(0, std::min({tri.x[0], tri.x[1], tri.x[2]}) >> 4);
+	tri.minY = std::max<s32>(0, std::min({tri.y[0], tri.y[1], tri.y[2]}) >> 4);
+	tri.maxX = std::min<s32>(s32(state.width) - 1, std::max({tri.x[0], tri.x[1], tri.x[2]}) >> 4);
+	tri.maxY = std::min<s32>(s32(state.height) - 1, std::max({tri.y[0], tri.y[1], tri.y[2]}) >> 4);
+
+	if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+		return;
+	}
+
+	triangles.push_back(tri);
+}
+
+void RendererSw::rasterizeTriangle(const TriangleSetup& tri, s32 bandMinY, s32 bandMaxY) {
+	const s32 minY = std::max(tri.minY, bandMinY);
+	const s32 maxY = std::min(tri.maxY, bandMaxY);
+	if (minY > maxY) {
+		return;
+	}
+
+	// Edge i is the edge opposite vertex i, so its edge function is proportional to the barycentric weight of vertex i
+	struct Edge {
+		s64 stepX, stepY;  // Change of the edge function per pixel in each direction
+		s64 bias;          // -1 for edges that aren't top-left, so that pixels exactly on them are rejected
+		s64 origin;        // Value at the centre of pixel (minX, minY)
+	};
+
+	std::array<Edge, 3> edges;
+	const s32 originX = (tri.minX << 4) + 8;
+	const s32 originY = (minY << 4) + 8;
+
+	for (int i = 0; i < 3; i++) {
+		const int a = (i + 1) % 3;
+		const int b = (i + 2) % 3;
+		const s64 dx = tri.x[b] - tri.x[a];
+		const s64 dy = tri.y[b] - tri.y[a];
+
+		edges[i].stepX = -dy * 16;
+		edges[i].stepY = dx * 16;
+		edges[i].bias = isTopLeft(tri.x[a], tri.y[a], tri.x[b], tri.y[b]) ? 0 : -1;
+		edges[i].origin = dx * s64(originY - tri.y[a]) - dy * s64(originX - tri.x[a]);
+	}
+
+	// Edge functions are evaluated for 4 pixels at a time, in a form that the compiler can vectorize
+	static constexpr s32 laneCount = 4;
+
+	for (s32 y = minY; y <= maxY; y++) {
+		const s64 rowOffset = y - minY;
+		std::array<s64, 3> rowStart;
+		for (int i = 0; i < 3; i++) {
+			rowStart[i] = edges[i].origin + edges[i].stepY * rowOffset + edges[i].bias;
+		}
+
+		for (s32 x = tri.minX; x <= tri.maxX; x += laneCount) {
+			const s64 columnOffset = x - tri.minX;
+			std::array<s64, laneCount> w0, w1, w2;
+			std::array<bool, laneCount> inside;
+
+			for (s32 lane = 0; lane < laneCount; lane++) {
+				w0[lane] = rowStart[0] + edges[0].stepX * (columnOffset + lane);
+				w1[lane] = rowStart[1] + edges[1].stepX * (columnOffset + lane);
+				w2[lane] = rowStart[2] + edges[2].stepX * (columnOffset + lane);
+				inside[lane] = (w0[lane] | w1[lane] | w2[lane]) >= 0;
+			}
+
+			for (s32 lane = 0; lane < laneCount; lane++) {
+				if (!inside[lane] || x + lane > tri.maxX) {
+					continue;
+				}
+
+				// Undo the top-left bias before computing barycentrics
+				const std::array<float, 3> barycentrics = {
+					float(w0[lane] - edges[0].bias) * tri.invArea,
+					float(w1[lane] - edges[1].bias) * tri.invArea,
+					float(w2[lane] - edges[2].bias) * tri.invArea,
+				};
+				shadeFragment(tri, x + lane, y, barycentrics);
+			}
+		}
+	}
+}
+
+void RendererSw::shadeFragment(const TriangleSetup& tri, s32 x, s32 y, const std::array<float, 3>& barycentrics) {
+	// Perspective-correct attribute interpolation
+	const float invW = barycentrics[0] * tri.invW[0] + barycentrics[1] * tri.invW[1] + barycentrics[2] * tri.invW[2];
+	const float w = 1.0f / invW;
+
+	std::array<float, AttribCount> attribs;
+	for (u32 i = 0; i < AttribCount; i++) {
+		attribs[i] = (barycentrics[0] * tri.attribsOverW[0][i] + barycentrics[1] * tri.attribsOverW[1][i] + barycentrics[2] * tri.attribsOverW[2][i]) * w;
+	}
+
+	// z / w is linear in screen space, so it doesn't need perspective correction
+	const float zOverW = barycentrics[0] * tri.zOverW[0] + barycentrics[1] * tri.zOverW[1] + barycentrics[2] * tri.zOverW[2];
+	float depth = zOverW * state.depthScale + state.depthOffset;
+	if (!state.depthMapEnable) {  // Divide z by w if depthmap enable == 0 (ie using W-buffering)
+		depth *= w;
+	}
+	depth = std::clamp(depth, 0.0f, 1.0f);
+
+	const vec4 colour = runTextureEnvironment(attribs);
+
+	if (state.alphaTest) {
+		const u8 alpha = u8(std::lround(colour[3] * 255.0f));
+		if (!compare<u8>(state.alphaFunc, alpha, state.alphaRef)) {
+			return;
+		}
+	}
+
+	// Framebuffers are stored upside down and tiled in 8x8 tiles
+	const u32 row = state.height - 1 - u32(y);
+
+	if (state.depthTest || state.stencilTest) {
+		u8* depthPixel = state.depthBuffer + SwTexture::getSwizzledOffset(u32(x), row, state.width, sizePerPixel(state.depthFormat));
+		if (!stencilAndDepthTest(depthPixel, depth)) {
+			return;
+		}
+	}
+
+	if (state.colourBuffer != nullptr) {
+		u8* colourPixel = state.colourBuffer + SwTexture::getSwizzledOffset(u32(x), row, state.width, sizePerPixel(state.colourFormat));
+		writeColour(colourPixel, colour);
+	}
+}
+
+std::array<float, 4> RendererSw::runTextureEnvironment(const std::array<float, AttribCount>& attribs) {
+	// OpenGL ES 1.1 reference pages for TEVs (this is what the PICA200 implements):
+	// https://registry.khronos.org/OpenGL-Refpages/es1.1/xhtml/glTexEnv.xml
+	// Sources 6 to 12 are unimplemented and read as 0
+	std::array<vec4, 16> sources = {};
+
+	sources[0] = {attribs[ColourR], attribs[ColourG], attribs[ColourB], attribs[ColourA]};  // Primary/vertex colour
+	if (state.lightingEnable) {
+		calculateLighting(attribs, sources[1], sources[2]);
+	} else {
+		sources[1] = sources[2] = {1.f, 1.f, 1.f, 1.f};
+	}
+
+	if (state.textureEnabled[0]) sources[3] = state.textures[0].sample(attribs[Tex0U], attribs[Tex0V]);
+	if (state.textureEnabled[1]) sources[4] = state.textures[1].sample(attribs[Tex1U], attribs[Tex1V]);
+	if (state.textureEnabled[2]) {
+		const bool useTexcoord1 = state.tex2UsesTexcoord1;
+		sources[5] = state.textures[2].sample(attribs[useTexcoord1 ? Tex1U : Tex2U], attribs[useTexcoord1 ? Tex1V : Tex2V]);
+	}
+
+	sources[13] = {0.f, 0.f, 0.f, 0.f};  // Previous buffer
+	sources[15] = sources[0];            // Previous combiner
+	vec4 nextPreviousBuffer = state.tevBufferColour;
+
+	for (int stage = 0; stage < 6; stage++) {
+		sources[14] = state.tevColour[stage];  // Constant colour
+
+		const u32 sourceConfig = state.tevSource[stage];
+		const u32 operandConfig = state.tevOperand[stage];
+		std::array<vec4, 3> operands;
+
+		for (int i = 0; i < 3; i++) {
+			const vec4& colourSource = sources[(sourceConfig >> (i * 4)) & 15];
+			const vec4& alphaSource = sources[(sourceConfig >> (i * 4 + 16)) & 15];
+			const u32 colourOperand = (operandConfig >> (i * 4)) & 15;
+			const u32 alphaOperand = (operandConfig >> (12 + i * 4)) & 7;
+			vec4& result = operands[i];
+			result = {0.f, 0.f, 0.f, 0.f};
+
+			// TODO: figure out what the undocumented values do
+			switch (colourOperand) {
+				case 0: result = colourSource; break;                                                                        // Source colour
+				case 1: result = {1.f - colourSource[0], 1.f - colourSource[1], 1.f - colourSource[2], 0.f}; break;          // One minus source colour
+				case 2: result = {colourSource[3], colourSource[3], colourSource[3], 0.f}; break;                            // Source alpha
+				case 3: result = {1.f - colourSource[3], 1.f - colourSource[3], 1.f - colourSource[3], 0.f}; break;          // One minus source alpha
+				case 4: result = {colourSource[0], colourSource[0], colourSource[0], 0.f}; break;                            // Source red
+				case 5: result = {1.f - colourSource[0], 1.f - colourSource[0], 1.f - colourSource[0], 0.f}; break;          // One minus source red
+				case 8: result = {colourSource[1], colourSource[1], colourSource[1], 0.f}; break;                            // Source green
+				case 9: result = {1.f - colourSource[1], 1.f - colourSource[1], 1.f - colourSource[1], 0.f}; break;          // One minus source green
+				case 12: result = {colourSource[2], colourSource[2], colourSource[2], 0.f}; break;                           // Source blue
+				case 13: result = {1.f - colourSource[2], 1.f - colourSource[2], 1.f - colourSource[2], 0.f}; break;         // One minus source blue
+				default: break;
+			}
+
+			switch (alphaOperand) {
+				case 0: result[3] = alphaSource[3]; break;        // Source alpha
+				case 1: result[3] = 1.f - alphaSource[3]; break;  // One minus source alpha
+				case 2: result[3] = alphaSource[0]; break;        // Source red
+				case 3: result[3] = 1.f - alphaSource[0]; break;  // One minus source red
+				case 4: result[3] = alphaSource[1]; break;        // Source green
+				case 5: result[3] = 1.f - alphaSource[1]; break;  // One minus source green
+				case 6: result[3] = alphaSource[2]; break;        // Source blue
+				case 7: result[3] = 1.f - alphaSource[2]; break;  // One minus source blue
+				default: break;
+			}
+		}
+
+		const u32 colourCombine = state.tevCombiner[stage] & 15;
+		const u32 alphaCombine = (state.tevCombiner[stage] >> 16) & 15;
+		const vec4& s0 = operands[0];
+		const vec4& s1 = operands[1];
+		const vec4& s2 = operands[2];
+		vec4 result = {1.f, 1.f, 1.f, 1.f};
+
+		// TODO: figure out what the undocumented values do
+		for (int c = 0; c < 3; c++) {
+			switch (colourCombine) {
+				case 0: result[c] = s0[c]; break;                                           // Replace
+				case 1: result[c] = s0[c] * s1[c]; break;                                   // Modulate
+				case 2: result[c] = std::min(1.0f, s0[c] + s1[c]); break;                   // Add
+				case 3: result[c] = std::clamp(s0[c] + s1[c] - 0.5f, 0.0f, 1.0f); break;    // Add signed
+				case 4: result[c] = s0[c] * s2[c] + s1[c] * (1.0f - s2[c]); break;          // Interpolate
+				case 5: result[c] = std::max(0.0f, s0[c] - s1[c]); break;                   // Subtract
+				case 8: result[c] = std::min(1.0f, s0[c] * s1[c] + s2[c]); break;           // Multiply then add
+				case 9: result[c] = std::min(1.0f, (s0[c] + s1[c]) * s2[c]); break;         // Add then multiply
+				default: break;
+			}
+		}
+
+		if (colourCombine == 6 || colourCombine == 7) {  // Dot3 RGB and Dot3 RGBA
+			float dot3 = 0.f;
+			for (int c = 0; c < 3; c++) {
+				dot3 += (s0[c] - 0.5f) * (s1[c] - 0.5f);
+			}
+
+			dot3 *= 4.0f;
+			result[0] = result[1] = result[2] = dot3;
+			if (colourCombine == 7) {
+				result[3] = dot3;
+			}
+		}
+
+		if (colourCombine != 7) {  // The colour combiner also writes the alpha channel in the "Dot3 RGBA" mode
+			switch (alphaCombine) {
+				case 0: result[3] = s0[3]; break;                                          // Replace
+				case 1: result[3] = s0[3] * s1[3]; break;                                  // Modulate
+				case 2: result[3] = std::min(1.0f, s0[3] + s1[3]); break;                  // Add
+				case 3: result[3] = std::clamp(s0[3] + s1[3] - 0.5f, 0.0f, 1.0f); break;   // Add signed
+				case 4: result[3] = s0[3] * s2[3] + s1[3] * (1.0f - s2[3]); break;         // Interpolate
+				case 5: result[3] = std::max(0.0f, s0[3] - s1[3]); break;                  // Subtract
+				case 8: result[3] = std::min(1.0f, s0[3] * s1[3] + s2[3]); break;          // Multiply then add
+				case 9: result[3] = std::min(1.0f, (s0[3] + s1[3]) * s2[3]); break;        // Add then multiply
+				default: break;
+			}
+		}
+
+		// Combiner outputs are 8-bit on hardware, so they saturate after scaling
+		const float colourScale = float(1 << (state.tevScale[stage] & 3));
+		const float alphaScale = float(1 << ((state.tevScale[stage] >> 16) & 3));
+		for (int c = 0; c < 3; c++) {
+			result[c] = std::clamp(result[c] * colourScale, 0.0f, 1.0f);
+		}
+		result[3] = std::clamp(result[3] * alphaScale, 0.0f, 1.0f);
+
+		sources[15] = result;
+		sources[13] = nextPreviousBuffer;
+
+		if (stage < 4) {
+			if ((state.tevUpdateBuffer & (0x100 << stage)) != 0) {
+				nextPreviousBuffer[0] = result[0];
+				nextPreviousBuffer[1] = result[1];
+				nextPreviousBuffer[2] = result[2];
+			}
+
+			if ((state.tevUpdateBuffer & (0x1000 << stage)) != 0) {
+				nextPreviousBuffer[3] = result[3];
+			}
+		}
+	}
+
+	return sources[15];
+}
+
+// Implements the following algorthm: https://mathb.in/26766, same as the GL fragment shader
+void RendererSw::calculateLighting(const std::array<float, AttribCount>& attribs, std::array<float, 4>& primary, std::array<float, 4>& secondary) {
+	enum : u32 { D0, D1, SP, FR, RB, RG, RR, LutCount };
+
+	const vec3 normal = normalize({attribs[NormalX], attribs[NormalY], attribs[NormalZ]});
+	const vec3 rawView = {attribs[ViewX], attribs[ViewY], attribs[ViewZ]};
+	const vec3 view = normalize(rawView);
+
+	primary = {state.lightingAmbient[0], state.lightingAmbient[1], state.lightingAmbient[2], 1.0f};
+	secondary = {0.f, 0.f, 0.f, 1.0f};
+	std::array<float, LutCount> d = {};
+
+	for (u32 i = 0; i < state.lightCount; i++) {
+		const LightState& light = state.lights[i];
+		const vec3& lightVector = light.vector;
+		vec3 halfVector;
+
+		if (getBit<0>(light.config) == 0) {  // Positional light
+			const vec3 toLight = normalize({lightVector[0] + rawView[0], lightVector[1] + rawView[1], lightVector[2] + rawView[2]});
+			halfVector = normalize({toLight[0] + view[0], toLight[1] + view[1], toLight[2] + view[2]});
+		} else {  // Directional light
+			halfVector = normalize({lightVector[0] + view[0], lightVector[1] + view[1], lightVector[2] + view[2]});
+		}
+
+		for (u32 c = 0; c < LutCount; c++) {
+			if (((state.lightingConfig1 >> (16 + c)) & 1) != 0) {
+				d[c] = 1.0f;
+				continue;
+			}
+
+			const u32 scaleID = (state.lutInputScale >> (c * 4)) & 7;
+			float scale = float(1u << scaleID);
+			if (scaleID >= 6) scale /= 256.0f;
+
+			float input;
+			switch ((state.lutInputSelect >> (c * 4)) & 7) {
+				case 0: input = dot(normal, halfVector); break;
+				case 1: input = dot(view, halfVector); break;
+				case 2: input = dot(normal, view); break;
+				case 3: input = dot(lightVector, normal); break;
+				case 4: input = -dot(lightVector, light.spotDirection); break;  // -L dot P (aka Spotlight aka SP)
+				default: input = 1.0f; break;                                      // TODO: cos <greek symbol> (aka CP)
+			}
+
+			d[c] = lookupLightingLUT(c, light.id, input * 0.5f + 0.5f) * scale;
+			if (((state.lutInputAbs >> (2 * c)) & 1) != 0) {
+				d[c] = std::abs(d[c]);
+			}
+		}
+
+		switch (getBits<4, 4>(light.config)) {
+			case 0:
+				d[D1] = 0.0f;
+				d[FR] = 0.0f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 1:
+				d[D0] = 0.0f;
+				d[D1] = 0.0f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 2:
+				d[FR] = 0.0f;
+				d[SP] = 0.0f;
+				d[RG] = d[RB] = d[RR];
+				break;
+			case 3:
+				d[SP] = 0.0f;
+				d[RG] = d[RB] = d[RR] = 1.0f;
+				break;
+			case 4: d[FR] = 0.0f; break;
+			case 5: d[D1] = 0.0f; break;
+			case 6: d[RG] = d[RB] = d[RR]; break;
+			default: break;
+		}
+
+		// Distance attenuation, indirect & shadow factors are unimplemented, like in the GL shader
+		float NdotL = dot(normal, lightVector);
+		// Two sided diffuse
+		NdotL = (getBit<1>(light.config) == 0) ? std::max(0.0f, NdotL) : std::abs(NdotL);
+
+		const float lightFactor = d[SP];
+		const vec3 reflection = {d[RR], d[RG], d[RB]};
+		for (int c = 0; c < 3; c++) {
+			primary[c] += lightFactor * (light.ambient[c] + light.diffuse[c] * NdotL);
+			secondary[c] += lightFactor * (light.specular0[c] * d[D0] + light.specular1[c] * d[D1] * reflection[c]);
+		}
+	}
+
+	if (getBit<2>(state.lightingConfig0)) primary[3] = d[FR];
+	if (getBit<3>(state.lightingConfig0)) secondary[3] = d[FR];
+
+	for (int c = 0; c < 4; c++) {
+		primary[c] = std::clamp(primary[c], 0.0f, 1.0f);
+		secondary[c] = std::clamp(secondary[c], 0.0f, 1.0f);
+	}
+}
+
+float RendererSw::lookupLightingLUT(u32 lut, u32 light, float value) {
+	// Map the shader's LUT indices to the PICA's. FR, RB, RG and RR come right after D1, and each light has its own spotlight LUT
+	static constexpr u32 spotlightLUT = 2;
+	if (lut >= 3 && lut <= 6) lut -= 1;
+	else if (lut == spotlightLUT) lut = Lights::LUT_SP0 + light;
+
+	// Linear filtering with clamp-to-edge, the same as sampling the LUT texture in the GL backend
+	const float position = std::clamp(value * 256.0f - 0.5f, 0.0f, 255.0f);
+	const u32 index = u32(position);
+	const u32 nextIndex = std::min<u32>(index + 1, 255);
+	const float frac = position - float(index);
+
+	const auto entry = [&](u32 i) { return float(gpu.lightingLUT[lut * 256 + i] & 0xfff) / 4095.0f; };
+	return entry(index) + (entry(nextIndex) - entry(index)) * frac;
+}
+
+bool RendererSw::stencilAndDepthTest(u8* depthPixel, float depth) {
+	u32 storedDepth;
+	u8 stencil = 0;
+	u32 newDepth;
+
+	switch (state.depthFormat) {
+		case DepthFmt::Depth16:
+			storedDepth = u32(depthPixel[0]) | (u32(depthPixel[1]) << 8);
+			newDepth = u32(depth * 65535.0f);
+			break;
+
+		case DepthFmt::Depth24Stencil8: stencil = depthPixel[3]; [[fallthrough]];
+		default:
+			storedDepth = u32(depthPixel[0]) | (u32(depthPixel[1]) << 8) | (u32(depthPixel[2]) << 16);
+			newDepth = u32(depth * 16777215.0f);
+			break;
+	}
+
+	if (state.stencilTest) {
+		const u8 reference = state.stencilRef & state.stencilRefMask;
+		const u8 value = stencil & state.stencilRefMask;
+		u32 op;
+		bool passed = true;
+
+		// Same as glStencilFunc, the reference value is compared against the stored value
+		if (!compare<u8>(state.stencilFunc, reference, value)) {
+			op = state.stencilFailOp;
+			passed = false;
+		} else if (state.depthTest && !compare<u32>(state.depthFunc, newDepth, storedDepth)) {
+			op = state.depthFailOp;
+			passed = false;
+		} else {
+			op = state.passOp;
+		}
+
+		const u8 newStencil = applyStencilOp(op, stencil, state.stencilRef);
+		depthPixel[3] = (stencil & ~state.stencilWriteMask) | (newStencil & state.stencilWriteMask);
+
+		if (!passed) {
+			return false;
+		}
+	} else if (state.depthTest && !compare<u32>(state.depthFunc, newDepth, storedDepth)) {
+		return false;
+	}
+
+	if (state.depthTest && state.depthWrite) {
+		depthPixel[0] = u8(newDepth);
+		depthPixel[1] = u8(newDepth >> 8);
+		if (state.depthFormat != DepthFmt::Depth16) {
+			depthPixel[2] = u8(newDepth >> 16);
+		}
+	}
+
+	return true;
+}
+
+void RendererSw::writeColour(u8* pixel, std::array<float, 4> colour) {
+	const std::array<u8, 4> dest = decodeColour(pixel, state.colourFormat);
+	std::array<u8, 4> result;
+
+	if (state.blendEnable) {
+		const vec4 destColour = {float(dest[0]) / 255.0f, float(dest[1]) / 255.0f, float(dest[2]) / 255.0f, float(dest[3]) / 255.0f};
+
+		for (int c = 0; c < 4; c++) {
+			const bool alpha = c == 3;
+			const u32 equation = alpha ? state.alphaEquation : state.rgbEquation;
+			const u32 sourceFunc = alpha ? state.alphaSourceFunc : state.rgbSourceFunc;
+			const u32 destFunc = alpha ? state.alphaDestFunc : state.rgbDestFunc;
+
+			const float sourceFactor = getBlendFactor(sourceFunc, c, colour, destColour, state.blendColour);
+			const float destFactor = getBlendFactor(destFunc, c, colour, destColour, state.blendColour);
+			const float blended = applyBlendEquation(equation, colour[c], sourceFactor, destColour[c], destFactor);
+			result[c] = u8(std::lround(std::clamp(blended, 0.0f, 1.0f) * 255.0f));
+		}
+	} else {
+		for (int c = 0; c < 4; c++) {
+			result[c] = applyLogicOp(state.logicOp, u8(std::lround(colour[c] * 255.0f)), dest[c]);
+		}
+	}
+
+	for (int c = 0; c < 4; c++) {
+		if (!state.colourMask[c]) {
+			result[c] = dest[c];
+		}
+	}
+
+	encodeColour(pixel, state.colourFormat, result);
+}
@@ -1,26 +1,414 @@
 #include "renderer_sw/renderer_sw.hpp"
 
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "PICA/gpu.hpp"
+#include "colour.hpp"
+
+using namespace Helpers;
+using namespace PICA;
+
 RendererSw::RendererSw(GPU& gpu, const std::array<u32, regNum>& internalRegs, const std::array<u32, extRegNum>& externalRegs)
-	: Renderer(gpu, internalRegs, externalRegs) {}
+	: Renderer(gpu, internalRegs, externalRegs), mem(gpu.getMemory()) {
+	screenPixels.resize(screenWidth * screenHeight * 4, 0);
+}
+
 RendererSw::~RendererSw() {}
 
-void RendererSw::reset() { printf("RendererSW: Unimplemented reset call\n"); }
-void RendererSw::display() { printf("RendererSW: Unimplemented display call\n"); }
+void RendererSw::reset() {
+	// Init the colour/depth buffer settings to some random defaults on reset
+	colourBufferLoc = 0;
+	colourBufferFormat = PICA::ColorFmt::RGBA8;
+
+	depthBufferLoc = 0;
+	depthBufferFormat = PICA::DepthFmt::Depth16;
+
+	std::fill(screenPixels.begin(), screenPixels.end(), 0);
+}
+
+// There's no graphics context to speak of, the frontend presents our screen image however it likes
+void RendererSw::initGraphicsContext(SDL_Window* window) { reset(); }
+void RendererSw::deinitGraphicsContext() {}
+
+std::array<u8, 4> RendererSw::decodeColour(const u8* pixel, PICA::ColorFmt format) {
+	switch (format) {
+		case ColorFmt::RGBA8: return {pixel[3], pixel[2], pixel[1], pixel[0]};
+		case ColorFmt::RGB8: return {pixel[2], pixel[1], pixel[0], 0xff};
+
+		case ColorFmt::RGB565: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert5To8Bit(getBits<11, 5, u8>(value)),
+				Colour::convert6To8Bit(getBits<5, 6, u8>(value)),
+				Colour::convert5To8Bit(getBits<0, 5, u8>(value)),
+				0xff,
+			};
+		}
+
+		case ColorFmt::RGBA5551: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert5To8Bit(getBits<11, 5, u8>(value)),
+				Colour::convert5To8Bit(getBits<6, 5, u8>(value)),
+				Colour::convert5To8Bit(getBits<1, 5, u8>(value)),
+				u8(getBit<0>(value) ? 0xff : 0),
+			};
+		}
+
+		case ColorFmt::RGBA4: {
+			const u16 value = u16(pixel[0]) | (u16(pixel[1]) << 8);
+			return {
+				Colour::convert4To8Bit(getBits<12, 4, u8>(value)),
+				Colour::convert4To8Bit(getBits<8, 4, u8>(value)),
+				Colour::convert4To8Bit(getBits<4, 4, u8>(value)),
+				Colour::convert4To8Bit(getBits<0, 4, u8>(value)),
+			};
+		}
+
+		default: Helpers::panic("[RendererSW] Unknown colour format %d", static_cast<int>(format));
+	}
+}
+
+void RendererSw::encodeColour(u8* pixel, PICA::ColorFmt format, const std::array<u8, 4>& colour) {
+	const auto [r, g, b, a] = colour;
+
+	switch (format) {
+		case ColorFmt::RGBA8:
+			pixel[0] = a;
+			pixel[1] = b;
+			pixel[2] = g;
+			pixel[3] = r;
+			break;
+
+		case ColorFmt::RGB8:
+			pixel[0] = b;
+			pixel[1] = g;
+			pixel[2] = r;
+			break;
+
+		case ColorFmt::RGB565: {
+			const u16 value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+			pixel[0] = u8(value);
+			pixel[1] = u8(value >> 8);
+			break;
+		}
+
+		case ColorFmt::RGBA5551: {
+			const u16 value = ((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7);
+			pixel[0] = u8(value);
+			pixel[1] = u8(value >> 8);
+			break;
+		}
+
+		case ColorFmt::RGBA4: {
+			const u16 value = ((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4);
+			pixel[0] = u8(value);
+			pixel[1] = u8(value >> 8);
+			break;
+		}
+
+		default: Helpers::panic("[RendererSW] Unknown colour format %d", static_cast<int>(format));
+	}
+}
+
+// NOTE: The transfer engine and the LCD have RGB5551 and RGB565 swapped compared to the internal regs format
+static PICA::ColorFmt transferFormatToColorFmt(u32 format) {
+	switch (format) {
+		case 2: return PICA::ColorFmt::RGB565;
+		case 3: return PICA::ColorFmt::RGBA5551;
+		case 0:
+		case 1:
+		case 4: return static_cast<PICA::ColorFmt>(format);
+		default: return PICA::ColorFmt::RGBA8;
+	}
+}
+
+void RendererSw::composeScreen(u32 addr, u32 format, u32 stride, u32 width, u32 xOffset, u32 yOffset) {
+	static constexpr u32 height = 240;
+	const PICA::ColorFmt colourFormat = transferFormatToColorFmt(format);
+	const u32 bpp = u32(sizePerPixel(colourFormat));
+
+	if (stride == 0) {
+		stride = height * bpp;
+	}
+
+	const auto framebuffer = mem.getPhysSpan(addr, stride * (width - 1) + height * bpp);
+	if (framebuffer.empty()) {
+		return;
+	}
+
+	// The LCD framebuffers are rotated, with each column of the screen stored bottom to top
+	for (u32 y = 0; y < height; y++) {
+		u8* out = &screenPixels[((yOffset + y) * screenWidth + xOffset) * 4];
+
+		for (u32 x = 0; x < width; x++) {
+			const u8* pixel = &framebuffer[x * stride + (height - 1 - y) * bpp];
+			const auto colour = decodeColour(pixel, colourFormat);
+
+			out[0] = colour[0];
+			out[1] = colour[1];
+			out[2] = colour[2];
+			out[3] = 0xff;
+			out += 4;
+		}
+	}
+}
+
+void RendererSw::display() {
+	using namespace PICA::ExternalRegs;
+	std::fill(screenPixels.begin(), screenPixels.end(), 0);
+
+	const u32 topActiveFb = externalRegs[Framebuffer0Select] & 1;
+	const u32 topScreenAddr = externalRegs[topActiveFb == 0 ? Framebuffer0AFirstAddr : Framebuffer0ASecondAddr];
+	composeScreen(topScreenAddr, externalRegs[Framebuffer0Config] & 7, externalRegs[Framebuffer0Stride], 400, 0, 0);
+
+	const u32 bottomActiveFb = externalRegs[Framebuffer1Select] & 1;
+	const u32 bottomScreenAddr = externalRegs[bottomActiveFb == 0 ? Framebuffer1AFirstAddr : Framebuffer1ASecondAddr];
+	composeScreen(bottomScreenAddr, externalRegs[Framebuffer1Config] & 7, externalRegs[Framebuffer1Stride], 320, 40, 240);
+}
+
+void RendererSw::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) {
+	if (endAddress <= startAddress) {
+		return;
+	}
 
-void RendererSw::initGraphicsContext(SDL_Window* window) { printf("RendererSW: Unimplemented initGraphicsContext call\n"); }
-void RendererSw::clearBuffer(u32 startAddress, u32 endAddress, u32 value, u32 control) { printf("RendererSW: Unimplemented clearBuffer call\n"); }
+	const auto buffer = mem.getPhysSpan(startAddress, endAddress - startAddress);
+	if (buffer.empty()) {
+		Helpers::warn("[RendererSW] Tried to clear unbacked buffer at %08X", startAddress);
+		return;
+	}
+
+	// Bit 8 selects 24-bit fill values and bit 9 32-bit ones, otherwise the value is 16-bit
+	if (getBit<9>(control)) {
+		for (usize i = 0; i + 4 <= buffer.size(); i += 4) {
+			std::memcpy(&buffer[i], &value, sizeof(u32));
+		}
+	} else if (getBit<8>(control)) {
+		for (usize i = 0; i + 3 <= buffer.size(); i += 3) {
+			buffer[i] = u8(value);
+			buffer[i + 1] = u8(value >> 8);
+			buffer[i + 2] = u8(value >> 16);
+		}
+	} else {
+		const u16 value16 = u16(value);
+		for (usize i = 0; i + 2 <= buffer.size(); i += 2) {
+			std::memcpy(&buffer[i], &value16, sizeof(u16));
+		}
+	}
+}
 
 void RendererSw::displayTransfer(u32 inputAddr, u32 outputAddr, u32 inputSize, u32 outputSize, u32 flags) {
-	printf("RendererSW: Unimplemented displayTransfer call\n");
+	const u32 inputWidth = inputSize & 0xffff;
+	const u32 inputHeight = inputSize >> 16;
+	const auto inputFormat = transferFormatToColorFmt(getBits<8, 3>(flags));
+	const auto outputFormat = transferFormatToColorFmt(getBits<12, 3>(flags));
+	const bool verticalFlip = flags & 1;
+	const bool inputLinear = getBit<1>(flags);  // Linear -> tiled
+	const bool dontSwizzle = getBit<5>(flags);  // Linear -> linear
+	const PICA::Scaling scaling = static_cast<PICA::Scaling>(getBits<24, 2>(flags));
+
+	const u32 horizontalScale = (scaling == PICA::Scaling::X || scaling == PICA::Scaling::XY) ? 1 : 0;
+	const u32 verticalScale = (scaling == PICA::Scaling::XY) ? 1 : 0;
+	const u32 outputWidth = (outputSize & 0xffff) >> horizontalScale;
+	const u32 outputHeight = (outputSize >> 16) >> verticalScale;
+
+	const u32 inputBpp = u32(sizePerPixel(inputFormat));
+	const u32 outputBpp = u32(sizePerPixel(outputFormat));
+	const auto input = mem.getPhysSpan(inputAddr, inputWidth * inputHeight * inputBpp);
+	const auto output = mem.getPhysSpan(outputAddr, outputWidth * outputHeight * outputBpp);
+
+	if (input.empty() || output.empty()) {
+		Helpers::warn("[RendererSW] Display transfer between unbacked buffers (%08X -> %08X)", inputAddr, outputAddr);
+		return;
+	}
+
+	const auto inputOffset = [&](u32 x, u32 y) -> u32 {
+		if (dontSwizzle || inputLinear) {
+			return (x + y * inputWidth) * inputBpp;
+		}
+		return SwTexture::getSwizzledOffset(x, y, inputWidth, inputBpp);
+	};
+
+	const auto readInput = [&](u32 x, u32 y) {
+		x = std::min(x, inputWidth - 1);
+		y = std::min(y, inputHeight - 1);
+		return decodeColour(&input[inputOffset(x, y)], inputFormat);
+	};
+
+	for (u32 y = 0; y < outputHeight; y++) {
+		const u32 outputY = verticalFlip ? outputHeight - 1 - y : y;
+
+		for (u32 x = 0; x < outputWidth; x++) {
+			const u32 inputX = x << horizontalScale;
+			const u32 inputY = y << verticalScale;
+			std::array<u8, 4> colour = readInput(inputX, inputY);
+
+			// Downscaling averages the 2 or 4 input pixels that make up each output pixel
+			if (horizontalScale != 0) {
+				std::array<u32, 4> sum = {};
+				const u32 samples = 1 << (horizontalScale + verticalScale);
+
+				for (u32 dy = 0; dy <= verticalScale; dy++) {
+					for (u32 dx = 0; dx <= horizontalScale; dx++) {
+						const auto sample = readInput(inputX + dx, inputY + dy);
+						for (int c = 0; c < 4; c++) {
+							sum[c] += sample[c];
+						}
+					}
+				}
+
+				for (int c = 0; c < 4; c++) {
+					colour[c] = u8(sum[c] / samples);
+				}
+			}
+
+			u32 outputOffset;
+			if (inputLinear && !dontSwizzle) {
+				outputOffset = SwTexture::getSwizzledOffset(x, outputY, outputWidth, outputBpp);
+			} else {
+				outputOffset = (x + outputY * outputWidth) * outputBpp;
+			}
+
+			encodeColour(&output[outputOffset], outputFormat, colour);
+		}
+	}
 }
 
 void RendererSw::textureCopy(u32 inputAddr, u32 outputAddr, u32 totalBytes, u32 inputSize, u32 outputSize, u32 flags) {
-	printf("RendererSW: Unimplemented textureCopy call\n");
+	// Texture copy size is aligned to 16 byte units
+	const u32 copySize = totalBytes & ~0xf;
+	if (copySize == 0) {
+		printf("TextureCopy total bytes less than 16!\n");
+		return;
+	}
+
+	// The width and gap are provided in 16-byte units. A width of 0 means a contiguous copy
+	u32 inputWidth = (inputSize & 0xffff) << 4;
+	u32 inputGap = (inputSize >> 16) << 4;
+	u32 outputWidth = (outputSize & 0xffff) << 4;
+	u32 outputGap = (outputSize >> 16) << 4;
+
+	if (inputWidth == 0) {
+		inputWidth = copySize;
+		inputGap = 0;
+	}
+
+	if (outputWidth == 0) {
+		outputWidth = copySize;
+		outputGap = 0;
+	}
+
+	// Size of the memory touched on each side, including the gaps between lines
+	const auto spanSize = [copySize](u32 width, u32 gap) { return copySize + ((copySize - 1) / width) * gap; };
+	const auto input = mem.getPhysSpan(inputAddr, spanSize(inputWidth, inputGap));
+	const auto output = mem.getPhysSpan(outputAddr, spanSize(outputWidth, outputGap));
+
+	if (input.empty() || output.empty()) {
+		Helpers::warn("[RendererSW] Texture copy between unbacked buffers (%08X -> %08X)", inputAddr, outputAddr);
+		return;
+	}
+
+	const u8* src = input.data();
+	u8* dst = output.data();
+	u32 remainingSize = copySize;
+	u32 remainingInput = inputWidth;
+	u32 remainingOutput = outputWidth;
+
+	while (remainingSize > 0) {
+		const u32 size = std::min({remainingInput, remainingOutput, remainingSize});
+		std::memmove(dst, src, size);
+
+		src += size;
+		dst += size;
+		remainingInput -= size;
+		remainingOutput -= size;
+		remainingSize -= size;
+
+		if (remainingInput == 0) {
+			remainingInput = inputWidth;
+			src += inputGap;
+		}
+
+		if (remainingOutput == 0) {
+			remainingOutput = outputWidth;
+			dst += outputGap;
+		}
+	}
 }
 
 void RendererSw::drawVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices) {
-	printf("RendererSW: Unimplemented drawVertices call\n");
+	captureDrawState();
+	if (state.colourBuffer == nullptr) {
+		Helpers::warn("[RendererSW] Colour buffer at %08X is not backed by memory", colourBufferLoc);
+		return;
+	}
+
+	// Assemble, clip and set up every triangle up front
+	triangles.clear();
+	const usize count = vertices.size();
+
+	switch (primType) {
+		case PICA::PrimType::TriangleStrip:
+			for (usize i = 2; i < count; i++) {
+				// Every odd triangle has its winding reversed. We don't cull, but keep the winding consistent anyways
+				if (i & 1) {
+					clipAndSetupTriangle(vertices[i - 1], vertices[i - 2], vertices[i]);
+				} else {
+					clipAndSetupTriangle(vertices[i - 2], vertices[i - 1], vertices[i]);
+				}
+			}
+			break;
+
+		case PICA::PrimType::TriangleFan:
+			for (usize i = 2; i < count; i++) {
+				clipAndSetupTriangle(vertices[0], vertices[i - 1], vertices[i]);
+			}
+			break;
+
+		// The fourth type is meant to be "Geometry primitive". TODO: Find out what that is
+		default:
+			for (usize i = 0; i + 2 < count; i += 3) {
+				clipAndSetupTriangle(vertices[i], vertices[i + 1], vertices[i + 2]);
+			}
+			break;
+	}
+
+	if (triangles.empty()) {
+		return;
+	}
+
+	u64 coveredPixels = 0;
+	for (const auto& tri : triangles) {
+		coveredPixels += u64(tri.maxX - tri.minX + 1) * u64(tri.maxY - tri.minY + 1);
+	}
+
+	const s32 height = s32(state.height);
+	if (coveredPixels < parallelPixelThreshold) {
+		for (const auto& tri : triangles) {
+			rasterizeTriangle(tri, 0, height - 1);
+		}
+		return;
+	}
+
+	// Bands are distributed round-robin so that the work is spread evenly even if the geometry is concentrated in one part of the screen
+	const s32 bandCount = (height + bandHeight - 1) / bandHeight;
+	threadPool.run([&](u32 index, u32 threadCount) {
+		for (s32 band = s32(index); band < bandCount; band += s32(threadCount)) {
+			const s32 bandMinY = band * bandHeight;
+			const s32 bandMaxY = std::min(bandMinY + bandHeight, height) - 1;
+
+			for (const auto& tri : triangles) {
+				if (tri.maxY >= bandMinY && tri.minY <= bandMaxY) {
+					rasterizeTriangle(tri, bandMinY, bandMaxY);
+				}
+			}
+		}
+	});
 }
 
-void RendererSw::screenshot(const std::string& name) { printf("RendererSW: Unimplemented screenshot call\n"); }
-void RendererSw::deinitGraphicsContext() { printf("RendererSW: Unimplemented DeinitGraphicsContext call\n"); }
\ No newline at end of file
+void RendererSw::screenshot(const std::string& name) {
+	stbi_write_png(name.c_str(), screenWidth, screenHeight, 4, screenPixels.data(), screenWidth * 4);
+}
@@ -0,0 +1,116 @@
+#include "renderer_sw/textures.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PICA/texture_decoder.hpp"
+
+using namespace Helpers;
+
+namespace {
+	enum class WrapMode { ClampToEdge, ClampToBorder, Repeat, Mirror };
+
+	// The wrapping mode field is 3 bits instead of 2 bits. The bottom 4 undocumented wrapping modes are taken from Citra.
+	constexpr std::array<WrapMode, 8> wrappingModes = {
+		WrapMode::ClampToEdge, WrapMode::ClampToBorder, WrapMode::Repeat, WrapMode::Mirror,
+		WrapMode::ClampToEdge, WrapMode::ClampToBorder, WrapMode::Repeat, WrapMode::Repeat,
+	};
+
+	// Apply a wrapping mode to texel coordinate "coord" for a texture dimension of "size" texels
+	// Returns false if the coordinate is outside the texture and should read the border colour
+	bool wrapCoordinate(s32& coord, s32 size, WrapMode mode) {
+		switch (mode) {
+			case WrapMode::ClampToEdge: coord = std::clamp(coord, 0, size - 1); return true;
+			case WrapMode::ClampToBorder: return coord >= 0 && coord < size;
+			case WrapMode::Repeat:
+				coord %= size;
+				if (coord < 0) coord += size;
+				return true;
+
+			case WrapMode::Mirror: {
+				const s32 period = size * 2;
+				coord %= period;
+				if (coord < 0) coord += period;
+				if (coord >= size) coord = period - 1 - coord;
+				return true;
+			}
+		}
+
+		return true;
+	}
+
+	std::array<float, 4> abgrToFloat(u32 abgr) {
+		constexpr float scale = 1.0f / 255.0f;
+		return {float(abgr & 0xff) * scale, float((abgr >> 8) & 0xff) * scale, float((abgr >> 16) & 0xff) * scale, float(abgr >> 24) * scale};
+	}
+
+	// https://en.wikipedia.org/wiki/Z-order_curve
+	// Returns the offset of a texel inside its 8x8 tile
+	u32 mortonInterleave(u32 u, u32 v) {
+		static constexpr u32 xOffsets[] = {0, 1, 4, 5, 16, 17, 20, 21};
+		static constexpr u32 yOffsets[] = {0, 2, 8, 10, 32, 34, 40, 42};
+
+		return xOffsets[u & 7] + yOffsets[v & 7];
+	}
+}  // namespace
+
+u64 SwTexture::sizeInBytes(PICA::TextureFmt format, u32 width, u32 height) {
+	return PICA::TextureDecoder::sizeInBytes(format, width, height);
+}
+
+u32 SwTexture::getSwizzledOffset(u32 u, u32 v, u32 width, u32 bytesPerPixel) {
+	u32 offset = ((u & ~7) * 8) + ((v & ~7) * width);  // Offset of the 8x8 tile the texel belongs to
+	offset += mortonInterleave(u, v);                  // Add the in-tile offset of the texel
+
+	return offset * bytesPerPixel;
+}
+
+std::array<float, 4> SwTexture::sample(float s, float t) const {
+	if (!valid) [[unlikely]] {
+		return {0.f, 0.f, 0.f, 0.f};
+	}
+
+	// We don't have mipmaps, so the magnification filter decides between nearest & bilinear filtering
+	const bool linear = (config & 0x2) != 0;
+	const float u = s * float(width);
+	const float v = t * float(height);
+
+	if (!linear) {
+		return fetch(s32(std::floor(u)), s32(std::floor(v)));
+	}
+
+	const float uBase = std::floor(u - 0.5f);
+	const float vBase = std::floor(v - 0.5f);
+	const float uFrac = (u - 0.5f) - uBase;
+	const float vFrac = (v - 0.5f) - vBase;
+	const s32 u0 = s32(uBase);
+	const s32 v0 = s32(vBase);
+
+	const auto c00 = fetch(u0, v0);
+	const auto c10 = fetch(u0 + 1, v0);
+	const auto c01 = fetch(u0, v0 + 1);
+	const auto c11 = fetch(u0 + 1, v0 + 1);
+
+	std::array<float, 4> result;
+	for (int i = 0; i < 4; i++) {
+		const float bottom = c00[i] + (c10[i] - c00[i]) * uFrac;
+		const float top = c01[i] + (c11[i] - c01[i]) * uFrac;
+		result[i] = bottom + (top - bottom) * vFrac;
+	}
+
+	return result;
+}
+
+std::array<float, 4> SwTexture::fetch(s32 u, s32 v) const {
+	const WrapMode wrapT = wrappingModes[getBits<8, 3>(config)];
+	const WrapMode wrapS = wrappingModes[getBits<12, 3>(config)];
+
+	if (!wrapCoordinate(u, s32(width), wrapS) || !wrapCoordinate(v, s32(height), wrapT)) {
+		return borderColour;
+	}
+
+	// Sampling coordinates start from the bottom row, while the image is stored from the top row
+	return abgrToFloat(decodeTexel(u32(u), height - 1 - u32(v)));
+}
+
+u32 SwTexture::decodeTexel(u32 u, u32 v) const { return PICA::TextureDecoder::decodeTexel(format, u, v, width, data); }
@@ -0,0 +1,118 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+// Comparator for our event heap. std::push_heap/pop_heap build max-heaps, so we invert the comparison to get the earliest event on top
+bool Scheduler::isLater(const QueueEntry& a, const QueueEntry& b) {
+	if (a.timestamp != b.timestamp) {
+		return a.timestamp > b.timestamp;
+	}
+
+	return a.sequence > b.sequence;
+}
+
+Scheduler::EventType Scheduler::registerEventType(std::string name, Callback callback) {
+	eventTypes.push_back({std::move(name), std::move(callback)});
+	return static_cast<EventType>(eventTypes.size() - 1);
+}
+
+Scheduler::EventHandle Scheduler::schedule(EventType type, u64 timestamp, u64 userdata) {
+	if (type >= eventTypes.size()) [[unlikely]] {
+		Helpers::panic("Scheduler: Tried to schedule unregistered event type %d", type);
+	}
+
+	u32 slotIndex;
+	if (!freeSlots.empty()) {
+		slotIndex = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		slotIndex = static_cast<u32>(slots.size());
+		slots.push_back(Slot{});
+	}
+
+	Slot& slot = slots[slotIndex];
+	slot.type = type;
+	slot.userdata = userdata;
+	slot.active = true;
+
+	queue.push_back({timestamp, sequence++, slotIndex, slot.generation});
+	std::push_heap(queue.begin(), queue.end(), isLater);
+	nextTimestamp = std::min(nextTimestamp, timestamp);
+
+	return EventHandle{.slot = slotIndex, .generation = slot.generation};
+}
+
+bool Scheduler::cancel(EventHandle& handle) {
+	if (!isScheduled(handle)) {
+		handle = EventHandle{};
+		return false;
+	}
+
+	releaseSlot(handle.slot);
+	handle = EventHandle{};
+	staleEntries++;
+
+	updateNextTimestamp();
+	return true;
+}
+
+void Scheduler::releaseSlot(u32 slotIndex) {
+	Slot& slot = slots[slotIndex];
+	slot.active = false;
+	slot.generation++;
+	freeSlots.push_back(slotIndex);
+}
+
+void Scheduler::updateNextTimestamp() {
+	while (!queue.empty() && isStale(queue.front())) {
+		std::pop_heap(queue.begin(), queue.end(), isLater);
+		queue.pop_back();
+		staleEntries--;
+	}
+
+	// Only bother compacting once a good chunk of the queue is dead weight
+	if (staleEntries > 64 && staleEntries * 2 > queue.size()) {
+		compact();
+	}
+
+	nextTimestamp = queue.empty() ? std::numeric_limits<u64>::max() : queue.front().timestamp;
+}
+
+void Scheduler::compact() {
+	std::erase_if(queue, [this](const QueueEntry& entry) { return isStale(entry); });
+	std::make_heap(queue.begin(), queue.end(), isLater);
+	staleEntries = 0;
+}
+
+void Scheduler::runEvents() {
+	// updateNextTimestamp guarantees the top of the queue is never a cancelled event
+	while (currentTimestamp >= nextTimestamp) {
+		std::pop_heap(queue.begin(), queue.end(), isLater);
+		const QueueEntry entry = queue.back();
+		queue.pop_back();
+
+		// Free the slot before running the callback, so that the callback can schedule new events (including rescheduling itself)
+		const Slot& slot = slots[entry.slot];
+		const EventType type = slot.type;
+		const u64 userdata = slot.userdata;
+		releaseSlot(entry.slot);
+		updateNextTimestamp();
+
+		eventTypes[type].callback(userdata, currentTimestamp - entry.timestamp);
+	}
+}
+
+void Scheduler::reset() {
+	currentTimestamp = 0;
+	nextTimestamp = std::numeric_limits<u64>::max();
+	sequence = 0;
+	staleEntries = 0;
+	queue.clear();
+
+	// Invalidate every outstanding handle
+	for (u32 i = 0; i < slots.size(); i++) {
+		if (slots[i].active) {
+			releaseSlot(i);
+		}
+	}
+}
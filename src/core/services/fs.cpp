@@ -156,9 +156,7 @@ Rust::Result<Handle, Result::HorizonResult> FSService::openArchiveHandle(u32 arc
 FSPath FSService::readPath(u32 type, u32 pointer, u32 size) {
 	std::vector<u8> data;
 	data.resize(size);
-
-	for (u32 i = 0; i < size; i++)
-		data[i] = mem.read8(pointer + i);
+	mem.readBlock(pointer, data.data(), size);
 
 	return FSPath(type, data);
 }
@@ -1,4 +1,7 @@
 #include "services/gsp_gpu.hpp"
+
+#include <algorithm>
+
 #include "PICA/regs.hpp"
 #include "ipc.hpp"
 #include "kernel.hpp"
@@ -37,7 +40,41 @@ namespace GXCommands {
 	};
 }
 
+GPUService::GPUService(Memory& mem, GPU& gpu, Kernel& kernel, u32& currentPID, const EmulatorConfig& config)
+	: mem(mem), gpu(gpu), kernel(kernel), currentPID(currentPID), scheduler(kernel.getScheduler()) {
+	syncEvent = scheduler.registerEventType("GPUSync", [this](u64 userdata, u64 cyclesLate) { syncGPU(); });
+
+	// The GPU thread calls into the renderer, which only works if the renderer isn't tied to the emulation thread's graphics context
+	gpuThreadEnabled = config.gpuThreadEnabled && gpu.supportsGPUThread();
+	if (config.gpuThreadEnabled && !gpuThreadEnabled) {
+		Helpers::warn("The GPU thread is not supported by the selected renderer, processing GPU commands on the emulation thread");
+	}
+
+	if (gpuThreadEnabled) {
+		gpuThread = std::thread(&GPUService::gpuThreadLoop, this);
+		mem.setGPUWaitCallback([this]() { waitForGPU(); });
+	}
+}
+
+GPUService::~GPUService() {
+	if (gpuThreadEnabled) {
+		mem.setGPUWaitCallback(nullptr);
+		waitForGPU();
+
+		stopGPUThread = true;
+		submittedCommands++;
+		submittedCommands.notify_one();
+		gpuThread.join();
+	}
+}
+
 void GPUService::reset() {
+	// Let in-flight commands finish before resetting. Their interrupts are meant for the old process, so throw them away
+	waitForGPU();
+	GPUInterrupt discarded;
+	while (finishedInterrupts.pop(&discarded, 1) != 0) {}
+	mem.clearPendingGPUWrites();
+
 	privilegedProcess = 0xFFFFFFFF; // Set the privileged process to an invalid handle
 	interruptEvent = std::nullopt;
 	gspThreadCount = 0;
@@ -46,6 +83,12 @@ void GPUService::reset() {
 
 void GPUService::handleSyncRequest(u32 messagePointer) {
 	const u32 command = mem.read32(messagePointer);
+
+	// Every GSP request besides submitting more work may read or modify state the GPU thread is using, so catch up first
+	if (command != ServiceCommands::TriggerCmdReqQueue) {
+		syncGPU();
+	}
+
 	switch (command) {
 		case ServiceCommands::TriggerCmdReqQueue: [[likely]] triggerCmdReqQueue(messagePointer); break;
 		case ServiceCommands::AcquireRight: acquireRight(messagePointer); break;
@@ -353,15 +396,11 @@ void GPUService::processCommandBuffer() {
 		log("Processing %d GPU commands\n", commandsLeft);
 
 		while (commandsLeft != 0) {
-			const u32 cmdID = cmd[0] & 0xff;
-			switch (cmdID) {
-				case GXCommands::ProcessCommandList: processCommandList(cmd); break;
-				case GXCommands::MemoryFill: memoryFill(cmd); break;
-				case GXCommands::TriggerDisplayTransfer: triggerDisplayTransfer(cmd); break;
-				case GXCommands::TriggerDMARequest: triggerDMARequest(cmd); break;
-				case GXCommands::TriggerTextureCopy: triggerTextureCopy(cmd); break;
-				case GXCommands::FlushCacheRegions: flushCacheRegions(cmd); break;
-				default: Helpers::panic("GSP::GPU::ProcessCommands: Unknown cmd ID %d", cmdID);
+			GXCommand command = readCommand(cmd);
+			if (gpuThreadEnabled) {
+				submitCommand(command);
+			} else {
+				executeCommand(command);
 			}
 
 			commandsLeft--;
@@ -369,6 +408,119 @@ void GPUService::processCommandBuffer() {
 	}
 }
 
+GPUService::GXCommand GPUService::readCommand(const u32* cmd) {
+	GXCommand command;
+	std::memcpy(command.words.data(), cmd, sizeof(command.words));
+	command.commandList = nullptr;
+
+	if ((cmd[0] & 0xff) == GXCommands::ProcessCommandList) {
+		command.commandList = static_cast<u32*>(mem.getReadPointer(cmd[1] & ~7));
+	}
+	return command;
+}
+
+void GPUService::executeCommand(GXCommand& command) {
+	u32* cmd = command.words.data();
+	const u32 cmdID = cmd[0] & 0xff;
+	switch (cmdID) {
+		case GXCommands::ProcessCommandList: processCommandList(cmd, command.commandList); break;
+		case GXCommands::MemoryFill: memoryFill(cmd); break;
+		case GXCommands::TriggerDisplayTransfer: triggerDisplayTransfer(cmd); break;
+		case GXCommands::TriggerDMARequest: triggerDMARequest(cmd); break;
+		case GXCommands::TriggerTextureCopy: triggerTextureCopy(cmd); break;
+		case GXCommands::FlushCacheRegions: flushCacheRegions(cmd); break;
+		default: Helpers::panic("GSP::GPU::ProcessCommands: Unknown cmd ID %d", cmdID);
+	}
+}
+
+void GPUService::submitCommand(GXCommand& command) {
+	// Hand out the interrupts of commands that finished in the meantime. This also keeps the interrupt queue from filling up
+	deliverFinishedInterrupts();
+
+	// DMAs read their source through guest virtual addresses, which are only safe to look up on the emulation thread.
+	// Run them here once the GPU thread has caught up instead, so that they still happen after every command submitted before them
+	if ((command.words[0] & 0xff) == GXCommands::TriggerDMARequest) {
+		syncGPU();
+		executeCommand(command);
+		deliverFinishedInterrupts();
+		return;
+	}
+
+	// If the GPU thread is too far behind, wait for it to drain its queue
+	if (commandQueue.push(&command, 1) == 0) [[unlikely]] {
+		syncGPU();
+		commandQueue.push(&command, 1);
+	}
+	// This has to come after the sync above, which gives every pending page back. The GPU thread might already be running the
+	// command, but the emulation thread can't read anything until we're done here anyways
+	markPendingWrites(command);
+
+	submittedCommands.fetch_add(1, std::memory_order_release);
+	submittedCommands.notify_one();
+
+	if (!scheduler.isScheduled(syncEventHandle)) {
+		syncEventHandle = scheduler.schedule(syncEvent, scheduler.currentTimestamp + gpuSyncDelay);
+	}
+}
+
+void GPUService::gpuThreadLoop() {
+	u64 executed = 0;
+
+	while (true) {
+		// Sleep until new commands get submitted
+		submittedCommands.wait(executed, std::memory_order_acquire);
+		if (stopGPUThread) {
+			return;
+		}
+
+		GXCommand command;
+		while (commandQueue.pop(&command, 1) != 0) {
+			executeCommand(command);
+
+			executed++;
+			completedCommands.store(executed, std::memory_order_release);
+			completedCommands.notify_all();
+		}
+	}
+}
+
+void GPUService::commandFinished(GPUInterrupt type) {
+	if (gpuThreadEnabled) {
+		finishedInterrupts.push(&type, 1);
+	} else {
+		requestInterrupt(type);
+	}
+}
+
+void GPUService::deliverFinishedInterrupts() {
+	GPUInterrupt type;
+	while (finishedInterrupts.pop(&type, 1) != 0) {
+		requestInterrupt(type);
+	}
+}
+
+void GPUService::waitForGPU() {
+	if (!gpuThreadEnabled) {
+		return;
+	}
+
+	const u64 submitted = submittedCommands.load(std::memory_order_acquire);
+	u64 completed = completedCommands.load(std::memory_order_acquire);
+
+	while (completed < submitted) {
+		completedCommands.wait(completed, std::memory_order_acquire);
+		completed = completedCommands.load(std::memory_order_acquire);
+	}
+}
+
+void GPUService::syncGPU() {
+	if (gpuThreadEnabled) {
+		waitForGPU();
+		mem.clearPendingGPUWrites();
+		deliverFinishedInterrupts();
+	}
+}
+
 static u32 VaddrToPaddr(u32 addr) {
 	if (addr >= VirtualAddrs::VramStart && addr < (VirtualAddrs::VramStart + VirtualAddrs::VramSize)) [[likely]] {
 		return addr - VirtualAddrs::VramStart + PhysicalAddrs::VRAM;
@@ -391,6 +543,47 @@ static u32 VaddrToPaddr(u32 addr) {
 	return 0xF3310932;
 }
 
+void GPUService::markPendingWrites(const GXCommand& command) {
+	const u32* cmd = command.words.data();
+
+	switch (cmd[0] & 0xff) {
+		case GXCommands::MemoryFill:
+			for (int i = 0; i < 2; i++) {
+				const u32 start = cmd[1 + i * 3];
+				const u32 end = cmd[3 + i * 3];
+				if (start != 0 && end > start) {
+					mem.addPendingGPUWrite(VaddrToPaddr(start), end - start);
+				}
+			}
+			break;
+
+		case GXCommands::TriggerDisplayTransfer: {
+			// Assume 4 bytes per pixel and no downscaling, we just need to cover every byte that might be written
+			const u32 outputSize = cmd[4];
+			mem.addPendingGPUWrite(VaddrToPaddr(cmd[2]), (outputSize & 0xffff) * (outputSize >> 16) * 4);
+			break;
+		}
+
+		case GXCommands::TriggerTextureCopy: {
+			// The output is written in lines of "width" bytes, with "gap" bytes skipped after each one. Both are in units of 16 bytes
+			const u32 totalBytes = cmd[3];
+			const u32 outputWidth = (cmd[5] & 0xffff) * 16;
+			const u32 outputGap = (cmd[5] >> 16) * 16;
+
+			u64 size = totalBytes;
+			if (outputWidth != 0) {
+				const u64 lines = (u64(totalBytes) + outputWidth - 1) / outputWidth;
+				size = lines * (outputWidth + outputGap);
+			}
+			mem.addPendingGPUWrite(VaddrToPaddr(cmd[2]), u32(std::min<u64>(size, 0xFFFFFFFF)));
+			break;
+		}
+
+		// Command lists render to whatever their own register writes set up, so we can't tell where they write without running them
+		default: break;
+	}
+}
+
 // Fill 2 GPU framebuffers, buf0 and buf1, using a specific word value
 void GPUService::memoryFill(u32* cmd) {
 	u32 control = cmd[7];
@@ -409,12 +602,12 @@ void GPUService::memoryFill(u32* cmd) {
 
 	if (start0 != 0) {
 		gpu.clearBuffer(VaddrToPaddr(start0), VaddrToPaddr(end0), value0, control0);
-		requestInterrupt(GPUInterrupt::PSC0);
+		commandFinished(GPUInterrupt::PSC0);
 	}
 
 	if (start1 != 0) {
 		gpu.clearBuffer(VaddrToPaddr(start1), VaddrToPaddr(end1), value1, control1);
-		requestInterrupt(GPUInterrupt::PSC1);
+		commandFinished(GPUInterrupt::PSC1);
 	}
 }
 
@@ -427,7 +620,7 @@ void GPUService::triggerDisplayTransfer(u32* cmd) {
 
 	log("GSP::GPU::TriggerDisplayTransfer (Stubbed)\n");
 	gpu.displayTransfer(inputAddr, outputAddr, inputSize, outputSize, flags);
-	requestInterrupt(GPUInterrupt::PPF); // Send "Display transfer finished" interrupt
+	commandFinished(GPUInterrupt::PPF); // Send "Display transfer finished" interrupt
 }
 
 void GPUService::triggerDMARequest(u32* cmd) {
@@ -438,7 +631,7 @@ void GPUService::triggerDMARequest(u32* cmd) {
 
 	log("GSP::GPU::TriggerDMARequest (source = %08X, dest = %08X, size = %08X)\n", source, dest, size);
 	gpu.fireDMA(dest, source, size);
-	requestInterrupt(GPUInterrupt::DMA);
+	commandFinished(GPUInterrupt::DMA);
 }
 
 void GPUService::flushCacheRegions(u32* cmd) {
@@ -481,15 +674,15 @@ void GPUService::setBufferSwapImpl(u32 screenId, const FramebufferInfo& info) {
 }
 
 // Actually send command list (aka display list) to GPU
-void GPUService::processCommandList(u32* cmd) {
+void GPUService::processCommandList(u32* cmd, u32* commandList) {
 	const u32 address = cmd[1] & ~7; // Buffer address
 	const u32 size = cmd[2] & ~3; // Buffer size in bytes
 	[[maybe_unused]] const bool updateGas = cmd[3] == 1; // Update gas additive blend results (0 = don't update, 1 = update)
 	[[maybe_unused]] const bool flushBuffer = cmd[7] == 1; // Flush buffer (0 = don't flush, 1 = flush)
 
 	log("GPU::GSP::processCommandList. Address: %08X, size in bytes: %08X\n", address, size);
-	gpu.startCommandList(address, size);
-	requestInterrupt(GPUInterrupt::P3D); // Send an IRQ when command list processing is over
+	gpu.startCommandList(commandList, size);
+	commandFinished(GPUInterrupt::P3D); // Send an IRQ when command list processing is over
 }
 
 // TODO: Emulate the transfer engine & its registers
@@ -506,7 +699,7 @@ void GPUService::triggerTextureCopy(u32* cmd) {
 	gpu.textureCopy(inputAddr, outputAddr, totalBytes, inputSize, outputSize, flags);
 	// This uses the transfer engine and thus needs to fire a PPF interrupt.
 	// NSMB2 relies on this
-	requestInterrupt(GPUInterrupt::PPF);
+	commandFinished(GPUInterrupt::PPF);
 }
 
 // Used when transitioning from the app to an OS applet, such as software keyboard, mii maker, mii selector, etc
@@ -17,8 +17,8 @@ __declspec(dllexport) DWORD AmdPowerXpressRequestHighPerformance = 1;
 #endif
 
 Emulator::Emulator()
-	: config(getConfigPath()), kernel(cpu, memory, gpu, config), cpu(memory, kernel, *this), gpu(memory, config), memory(cpu.getTicksRef(), config),
-	  cheats(memory, kernel.getServiceManager().getHID()), lua(*this), running(false)
+	: config(getConfigPath()), memory(scheduler.currentTimestamp, config), cpu(memory, kernel, *this), gpu(memory, config),
+	  kernel(cpu, memory, gpu, config), cheats(memory, kernel.getServiceManager().getHID()), lua(*this), running(false)
 #ifdef PANDA3DS_ENABLE_HTTP_SERVER
 	  ,
 	  httpServer(this)
@@ -32,6 +32,21 @@ Emulator::Emulator()
 	audioDevice.init(dsp->getSamples());
 	setAudioEnabled(config.audioEnabled);
 
+	vblankEvent = scheduler.registerEventType("VBlank", [this](u64 userdata, u64 cyclesLate) {
+		// Signal that we've reached the end of a frame
+		frameDone = true;
+		lua.signalEvent(LuaEvent::Frame);
+
+		// Send VBlank interrupts. The GPU thread has to catch up first, as buffer swaps take effect here
+		ServiceManager& srv = kernel.getServiceManager();
+		srv.syncGPU();
+		srv.sendGPUInterrupt(GPUInterrupt::VBlank0);
+		srv.sendGPUInterrupt(GPUInterrupt::VBlank1);
+
+		// Queue next VBlank event
+		scheduler.schedule(vblankEvent, scheduler.currentTimestamp - cyclesLate + CPU::ticksPerSec / 60);
+	});
+
 #ifdef PANDA3DS_ENABLE_DISCORD_RPC
 	if (config.discordRpcEnabled) {
 		discordRpc.init();
@@ -51,6 +66,8 @@ Emulator::~Emulator() {
 }
 
 void Emulator::reset(ReloadOption reload) {
+	// Don't reset the GPU from under the GPU thread
+	kernel.getServiceManager().syncGPU();
 	cpu.reset();
 	gpu.reset();
 	memory.reset();
@@ -58,6 +75,7 @@ void Emulator::reset(ReloadOption reload) {
 
 	// Reset scheduler and add a VBlank event
 	scheduler.reset();
+	scheduler.schedule(vblankEvent, CPU::ticksPerSec / 60);
 
 	// Kernel must be reset last because it depends on CPU/Memory state
 	kernel.reset();
@@ -123,6 +141,7 @@ void Emulator::togglePause() { running ? pause() : resume(); }
 void Emulator::runFrame() {
 	if (running) {
 		cpu.runFrame(); // Run 1 frame of instructions
+		kernel.getServiceManager().syncGPU();  // Make sure the GPU thread has finished the frame
 		gpu.display();  // Display graphics
 
 		// Run cheats if any are loaded
@@ -136,46 +155,7 @@ void Emulator::runFrame() {
 	}
 }
 
-void Emulator::pollScheduler() {
-	auto& events = scheduler.events;
-
-	// Pop events until there's none pending anymore
-	while (scheduler.currentTimestamp >= scheduler.nextTimestamp) {
-		// Read event timestamp and type, pop it from the scheduler and handle it
-		auto [time, eventType] = std::move(*events.begin());
-		events.erase(events.begin());
-
-		scheduler.updateNextTimestamp();
-
-		switch (eventType) {
-			case Scheduler::EventType::VBlank: [[likely]] {
-				// Signal that we've reached the end of a frame
-				frameDone = true;
-				lua.signalEvent(LuaEvent::Frame);
-
-				// Send VBlank interrupts
-				ServiceManager& srv = kernel.getServiceManager();
-				srv.sendGPUInterrupt(GPUInterrupt::VBlank0);
-				srv.sendGPUInterrupt(GPUInterrupt::VBlank1);
-
-				// Queue next VBlank event
-				scheduler.addEvent(Scheduler::EventType::VBlank, time + CPU::ticksPerSec / 60);
-				break;
-			}
-
-			case Scheduler::EventType::UpdateTimers: kernel.pollTimers(); break;
-			case Scheduler::EventType::RunDSP: {
-				dsp->runAudioFrame();
-				break;
-			}
-
-			default: {
-				Helpers::panic("Scheduler: Unimplemented event type received: %d\n", static_cast<int>(eventType));
-				break;
-			}
-		}
-	}
-}
+void Emulator::pollScheduler() { scheduler.runEvents(); }
 
 // Get path for saving files (AppData on Windows, /home/user/.local/share/ApplicationName on Linux, etc)
 // Inside that path, we be use a game-specific folder as well. Eg if we were loading a ROM called PenguinDemo.3ds, the savedata would be in
@@ -242,6 +222,8 @@ bool Emulator::loadROM(const std::filesystem::path& path) {
 
 	if (success) {
 		romPath = path;
+		// Warm up the shader JIT with the shaders this title used in previous sessions before running the first frame
+		gpu.loadShaderCache(dataPath / "ShaderCache.bin");
 #ifdef PANDA3DS_ENABLE_DISCORD_RPC
 		updateDiscord();
 #endif
@@ -0,0 +1,108 @@
+#include "host_memory.hpp"
+
+#if defined(__linux__) && (UINTPTR_MAX == UINT64_MAX)
+#define PANDA3DS_HOST_MEMORY_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef PANDA3DS_HOST_MEMORY_SUPPORTED
+HostMemory::HostMemory(usize backingSize) : backingSize(backingSize) {
+	// Use the raw syscall instead of memfd_create() as older glibc and Android versions don't expose a wrapper for it
+	fd = int(syscall(SYS_memfd_create, "Panda3DS guest RAM", 0));
+	if (fd < 0) {
+		Helpers::warn("HostMemory: Failed to create backing memory, falling back to plain page tables");
+		return;
+	}
+
+	if (ftruncate(fd, off_t(backingSize)) != 0) {
+		Helpers::warn("HostMemory: Failed to resize backing memory, falling back to plain page tables");
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	void* backingView = mmap(nullptr, backingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (backingView == MAP_FAILED) {
+		Helpers::warn("HostMemory: Failed to map backing memory, falling back to plain page tables");
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	// Reserve the guest address space without committing any memory for it
+	void* reservation = mmap(nullptr, arenaSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (reservation == MAP_FAILED) {
+		Helpers::warn("HostMemory: Failed to reserve guest address space, falling back to plain page tables");
+		munmap(backingView, backingSize);
+		close(fd);
+		fd = -1;
+		return;
+	}
+
+	backing = static_cast<u8*>(backingView);
+	arena = static_cast<u8*>(reservation);
+}
+
+HostMemory::~HostMemory() {
+	if (arena != nullptr) {
+		munmap(arena, arenaSize);
+	}
+
+	if (backing != nullptr) {
+		munmap(backing, backingSize);
+	}
+
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+void HostMemory::map(u32 vaddr, usize backingOffset, u32 size, bool read, bool write) {
+	if (!read && !write) {
+		unmap(vaddr, size);
+		return;
+	}
+
+	if (backingOffset + size > backingSize) [[unlikely]] {
+		Helpers::panic("HostMemory::map: Mapping past the end of backing memory (offset = %zX, size = %08X)", backingOffset, size);
+	}
+
+	const int prot = (read ? PROT_READ : 0) | (write ? PROT_WRITE : 0);
+	void* result = mmap(arena + vaddr, size, prot, MAP_SHARED | MAP_FIXED, fd, off_t(backingOffset));
+
+	if (result == MAP_FAILED) [[unlikely]] {
+		Helpers::panic("HostMemory::map: Failed to map %08X bytes at vaddr %08X", size, vaddr);
+	}
+}
+
+void HostMemory::unmap(u32 vaddr, u32 size) {
+	// Replace the mapping with fresh inaccessible reserved memory instead of calling munmap, so the range stays reserved for us
+	void* result = mmap(arena + vaddr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+	if (result == MAP_FAILED) [[unlikely]] {
+		Helpers::panic("HostMemory::unmap: Failed to unmap %08X bytes at vaddr %08X", size, vaddr);
+	}
+}
+
+void HostMemory::reset() {
+	if (arena == nullptr) {
+		return;
+	}
+
+	void* result = mmap(arena, arenaSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	if (result == MAP_FAILED) [[unlikely]] {
+		Helpers::panic("HostMemory::reset: Failed to unmap guest address space");
+	}
+}
+
+#else
+// Unsupported host, the backend is always invalid and Memory never calls into it
+HostMemory::HostMemory(usize backingSize) : backingSize(backingSize) {}
+HostMemory::~HostMemory() {}
+void HostMemory::map(u32 vaddr, usize backingOffset, u32 size, bool read, bool write) {}
+void HostMemory::unmap(u32 vaddr, u32 size) {}
+void HostMemory::reset() {}
+#endif
@@ -7,6 +7,23 @@ Renderer::Renderer(GPU& gpu, const std::array<u32, regNum>& internalRegs, const
 	: gpu(gpu), regs(internalRegs), externalRegs(externalRegs) {}
 Renderer::~Renderer() {}
 
+void Renderer::drawIndexedVertices(PICA::PrimType primType, std::span<const PICA::Vertex> vertices, std::span<const u16> indices) {
+	expandedVertices.resize(indices.size());
+	for (usize i = 0; i < indices.size(); i++) {
+		expandedVertices[i] = vertices[indices[i]];
+	}
+
+	drawVertices(primType, expandedVertices);
+}
+
+std::span<PICA::Vertex> Renderer::getVertexBuffer(u32 vertexCount, u32 indexCount) {
+	if (vertexScratch.size() < vertexCount) {
+		vertexScratch.resize(vertexCount);
+	}
+
+	return std::span(vertexScratch).first(vertexCount);
+}
+
 std::optional<RendererType> Renderer::typeFromString(std::string inString) {
 	// Transform to lower-case to make the setting case-insensitive
 	std::transform(inString.begin(), inString.end(), inString.begin(), [](unsigned char c) { return std::tolower(c); });
@@ -0,0 +1,68 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(u32 threadCount, u32 maxThreads) {
+	if (threadCount == 0) {
+		threadCount = std::clamp<u32>(std::thread::hardware_concurrency(), 1, maxThreads);
+	}
+
+	// The calling thread also runs jobs, so spawn one worker less than the number of threads we want to use
+	for (u32 i = 0; i + 1 < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock lock(jobMutex);
+		stopWorkers = true;
+	}
+
+	jobStart.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop(u32 index) {
+	u64 lastGeneration = 0;
+
+	while (true) {
+		std::unique_lock lock(jobMutex);
+		jobStart.wait(lock, [&] { return stopWorkers || jobGeneration != lastGeneration; });
+		if (stopWorkers) {
+			return;
+		}
+
+		lastGeneration = jobGeneration;
+		lock.unlock();
+
+		job(index + 1, u32(workers.size()) + 1);
+
+		lock.lock();
+		if (--busyWorkers == 0) {
+			jobDone.notify_one();
+		}
+	}
+}
+
+void ThreadPool::run(const std::function<void(u32, u32)>& func) {
+	if (workers.empty()) {
+		func(0, 1);
+		return;
+	}
+
+	{
+		std::unique_lock lock(jobMutex);
+		job = func;
+		busyWorkers = u32(workers.size());
+		jobGeneration++;
+	}
+
+	jobStart.notify_all();
+	func(0, u32(workers.size()) + 1);
+
+	std::unique_lock lock(jobMutex);
+	jobDone.wait(lock, [&] { return busyWorkers == 0; });
+}
@@ -2,6 +2,7 @@
 
 #include <PICA/dynapica/shader_rec.hpp>
 #include <PICA/shader.hpp>
+#include <PICA/shader_batch.hpp>
 #include <catch2/catch_approx.hpp>
 #include <catch2/catch_template_test_macros.hpp>
 #include <catch2/catch_test_macros.hpp>
@@ -36,6 +37,64 @@ static std::unique_ptr<PICAShader> assembleVertexShader(std::initializer_list<ni
 	return newShader;
 }
 
+// nihstro's inline assembler can't encode flow control targets or comparisons, so control flow tests are assembled from raw
+// instruction words instead. Every instruction uses operand descriptor 0, which writes xyzw and doesn't swizzle its sources
+namespace RawShader {
+	constexpr u32 input(u32 index) { return index; }
+	constexpr u32 output(u32 index) { return index; }
+	constexpr u32 temp(u32 index) { return 0x10 + index; }
+	constexpr u32 uniform(u32 index) { return 0x20 + index; }
+
+	// Swizzle that keeps the components in xyzw order
+	constexpr u32 noSwizzle = 0x1B;
+	constexpr u32 defaultDescriptor = 0xF | (noSwizzle << 5) | (noSwizzle << 14) | (noSwizzle << 23);
+
+	enum CmpOp : u32 { Equal = 0, NotEqual = 1, Less = 2, LessEqual = 3, Greater = 4, GreaterEqual = 5 };
+	enum Condition : u32 { Or = 0, And = 1, X = 2, Y = 3 };
+
+	// dest = src1 <op> src2. src2 can only be an input or temporary register. Index 3 offsets src1 by the loop counter
+	constexpr u32 arithmetic(u32 opcode, u32 dest, u32 src1, u32 src2 = 0, u32 index = 0) {
+		return (opcode << 26) | (dest << 21) | (index << 19) | (src1 << 12) | (src2 << 7);
+	}
+
+	// cmp.x = src1.x <opX> src2.x, cmp.y = src1.y <opY> src2.y
+	constexpr u32 cmp(u32 opX, u32 opY, u32 src1, u32 src2) {
+		return (ShaderOpcodes::CMP1 << 26) | (opX << 24) | (opY << 21) | (src1 << 12) | (src2 << 7);
+	}
+
+	// IFC, CALLC or JMPC, taken depending on how the cmp registers compare to refX and refY
+	constexpr u32 conditional(u32 opcode, u32 condition, bool refX, bool refY, u32 dest, u32 num = 0) {
+		return (opcode << 26) | (u32(refX) << 25) | (u32(refY) << 24) | (condition << 22) | (dest << 10) | num;
+	}
+
+	// IFU, CALLU or JMPU, taken depending on bool uniform "bit". A JMPU with num = 1 jumps if the uniform is false instead
+	constexpr u32 uniformConditional(u32 opcode, u32 bit, u32 dest, u32 num = 0) { return (opcode << 26) | (bit << 22) | (dest << 10) | num; }
+
+	// Loop over the instructions up to and including "last", with the iteration count, counter start and step in int uniform "index"
+	constexpr u32 loop(u32 index, u32 last) { return (ShaderOpcodes::LOOP << 26) | (index << 22) | (last << 10); }
+
+	constexpr u32 nop() { return ShaderOpcodes::NOP << 26; }
+	constexpr u32 end() { return ShaderOpcodes::END << 26; }
+}  // namespace RawShader
+
+static std::unique_ptr<PICAShader> assembleRawShader(std::initializer_list<u32> code) {
+	auto newShader = std::make_unique<PICAShader>(ShaderType::Vertex);
+	newShader->reset();
+
+	for (const u32 instruction : code) {
+		newShader->uploadWord(instruction);
+	}
+	newShader->uploadDescriptor(RawShader::defaultDescriptor);
+	newShader->finalize();
+	return newShader;
+}
+
+static void setFloatUniform(PICAShader& shader, u32 index, std::array<float, 4> value) {
+	for (int i = 0; i < 4; i++) {
+		shader.floatUniforms[index][i] = Floats::f24::fromFloat32(value[i]);
+	}
+}
+
 class ShaderInterpreterTest {
   protected:
 	std::unique_ptr<PICAShader> shader = {};
@@ -80,6 +139,32 @@ class ShaderInterpreterTest {
 	}
 };
 
+// Runs the same inputs on every lane of the batched interpreter and returns the outputs of the first lane
+class ShaderBatchTest final : public ShaderInterpreterTest {
+  private:
+	PICAShaderBatch shaderBatch{*shader};
+
+	void runShader() override {
+		for (u32 lane = 0; lane < PICAShaderBatch::laneCount; lane++) {
+			for (u32 reg = 0; reg < 16; reg++) {
+				shaderBatch.setInput(lane, reg, shader->inputs[reg]);
+			}
+		}
+
+		shaderBatch.run(PICAShaderBatch::laneCount);
+		for (u32 reg = 0; reg < 16; reg++) {
+			shader->outputs[reg] = shaderBatch.getOutput(0, reg);
+		}
+	}
+
+  public:
+	explicit ShaderBatchTest(std::initializer_list<nihstro::InlineAsm> code) : ShaderInterpreterTest(code) {}
+
+	static std::unique_ptr<ShaderBatchTest> assembleTest(std::initializer_list<nihstro::InlineAsm> code) {
+		return std::make_unique<ShaderBatchTest>(code);
+	}
+};
+
 #if defined(PANDA3DS_SHADER_JIT_SUPPORTED)
 class ShaderJITTest final : public ShaderInterpreterTest {
   private:
@@ -94,9 +179,30 @@ class ShaderJITTest final : public ShaderInterpreterTest {
 		return std::make_unique<ShaderJITTest>(code);
 	}
 };
-#define SHADER_TEST_CASE(NAME, TAG) TEMPLATE_TEST_CASE(NAME, TAG, ShaderInterpreterTest, ShaderJITTest)
+
+// Uniform specialization bakes the bool and int uniforms into the compiled code, so the shader gets prepared right before every run
+class ShaderSpecializedJITTest final : public ShaderInterpreterTest {
+  private:
+	ShaderJIT shaderJit = {};
+
+	void runShader() override {
+		shaderJit.prepare(*shader);
+		shaderJit.run(*shader);
+	}
+
+  public:
+	explicit ShaderSpecializedJITTest(std::initializer_list<nihstro::InlineAsm> code) : ShaderInterpreterTest(code) {
+		shaderJit.setUniformSpecialization(true);
+	}
+
+	static std::unique_ptr<ShaderSpecializedJITTest> assembleTest(std::initializer_list<nihstro::InlineAsm> code) {
+		return std::make_unique<ShaderSpecializedJITTest>(code);
+	}
+};
+#define SHADER_TEST_CASE(NAME, TAG) \
+	TEMPLATE_TEST_CASE(NAME, TAG, ShaderInterpreterTest, ShaderBatchTest, ShaderJITTest, ShaderSpecializedJITTest)
 #else
-#define SHADER_TEST_CASE(NAME, TAG) TEMPLATE_TEST_CASE(NAME, TAG, ShaderInterpreterTest)
+#define SHADER_TEST_CASE(NAME, TAG) TEMPLATE_TEST_CASE(NAME, TAG, ShaderInterpreterTest, ShaderBatchTest)
 #endif
 
 namespace Catch {
@@ -364,4 +470,264 @@ SHADER_TEST_CASE("Address Register Offset", "[video_core][shader][shader_jit]")
 	REQUIRE(shader->runVector({-73.f}) == floatUniforms[95]);
 	REQUIRE(shader->runVector({-127.f}) == floatUniforms[41]);
 	REQUIRE(shader->runVector({-129.f}) == floatUniforms[40]);
-}
\ No newline at end of file
+}
+// Runs a batch where every lane has its own inputs, so that lanes can take different paths through the program, and checks each lane
+// against the scalar interpreter. Input register 0 of every lane is (x, y, 0, 1), and output registers 0 and 1 get compared
+static void requireBatchMatchesInterpreter(PICAShader& shader, std::span<const std::array<float, 2>> lanes) {
+	// The batch leaves its state behind in the shader unit, so the reference runs on a copy of it
+	const auto reference = std::make_unique<PICAShader>(shader);
+	const auto batch = std::make_unique<PICAShaderBatch>(shader);
+	std::vector<std::array<Floats::f24, 4>> inputs;
+
+	for (const auto& [x, y] : lanes) {
+		inputs.push_back({f24::fromFloat32(x), f24::fromFloat32(y), f24::zero(), f24::fromFloat32(1.0f)});
+		batch->setInput(u32(inputs.size() - 1), 0, inputs.back());
+	}
+	batch->run(u32(lanes.size()));
+
+	for (u32 lane = 0; lane < lanes.size(); lane++) {
+		reference->inputs[0] = inputs[lane];
+		reference->run();
+
+		for (u32 reg = 0; reg < 2; reg++) {
+			INFO("lane " << lane << ", output " << reg);
+			REQUIRE(batch->getOutput(lane, reg) == reference->outputs[reg]);
+		}
+	}
+}
+
+// Lanes with every combination of v0.x > 0.5 and v0.y > 0.5, in an order where neighbouring lanes disagree
+static const std::array<std::array<float, 2>, PICAShaderBatch::laneCount> divergentLanes = {{
+	{0.0f, 0.0f},
+	{1.0f, 0.0f},
+	{0.0f, 1.0f},
+	{1.0f, 1.0f},
+	{3.0f, -2.0f},
+	{-1.0f, 2.0f},
+	{0.25f, 0.75f},
+	{2.0f, 3.0f},
+}};
+
+static void setDivergenceUniforms(PICAShader& shader) {
+	setFloatUniform(shader, 0, {0.5f, 0.5f, 0.5f, 0.5f});
+	setFloatUniform(shader, 1, {1.0f, 2.0f, 3.0f, 4.0f});
+	setFloatUniform(shader, 2, {5.0f, 6.0f, 7.0f, 8.0f});
+	setFloatUniform(shader, 3, {9.0f, 10.0f, 11.0f, 12.0f});
+}
+
+TEST_CASE("Batch IFC divergence", "[shader][vertex][batch]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ cmp(Less, Less, uniform(0), input(0)),
+		/* 1 */ conditional(ShaderOpcodes::IFC, X, true, false, 7, 2),  // if (v0.x > 0.5) [2, 7) else [7, 9)
+		/* 2 */ arithmetic(ShaderOpcodes::ADD, output(0), input(0), input(0)),
+		/* 3 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(1)),
+		/* 4 */ conditional(ShaderOpcodes::IFC, Y, false, true, 6, 0),  // Nested if (v0.y > 0.5) [5, 6)
+		/* 5 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(2)),
+		/* 6 */ arithmetic(ShaderOpcodes::ADD, output(0), uniform(3), input(0)),
+		/* 7 */ arithmetic(ShaderOpcodes::MUL, output(0), input(0), input(0)),
+		/* 8 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(3)),
+		/* 9 */ end(),
+	});
+	setDivergenceUniforms(*shader);
+
+	requireBatchMatchesInterpreter(*shader, divergentLanes);
+	requireBatchMatchesInterpreter(*shader, std::span(divergentLanes).first(5));
+}
+
+TEST_CASE("Batch CALLC divergence", "[shader][vertex][batch]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ cmp(Less, Less, uniform(0), input(0)),
+		/* 1 */ arithmetic(ShaderOpcodes::MOV, temp(0), input(0)),
+		/* 2 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(1)),
+		/* 3 */ conditional(ShaderOpcodes::CALLC, Y, false, true, 8, 2),    // Call [8, 10) if v0.y > 0.5
+		/* 4 */ conditional(ShaderOpcodes::CALLC, Or, false, false, 10, 1),  // Call [10, 11) if v0.x <= 0.5 or v0.y <= 0.5
+		/* 5 */ arithmetic(ShaderOpcodes::MOV, output(0), temp(0)),
+		/* 6 */ end(),
+		/* 7 */ nop(),
+		/* 8 */ arithmetic(ShaderOpcodes::ADD, temp(0), uniform(2), temp(0)),
+		/* 9 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(3)),
+		/* 10 */ arithmetic(ShaderOpcodes::MUL, temp(0), temp(0), temp(0)),
+	});
+	setDivergenceUniforms(*shader);
+
+	requireBatchMatchesInterpreter(*shader, divergentLanes);
+}
+
+// Divergent jumps, and ENDs that some lanes are masked off for, can't be handled by the SIMD path and fall back to runScalar
+TEST_CASE("Batch JMPC divergence", "[shader][vertex][batch]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ cmp(Less, Less, uniform(0), input(0)),
+		/* 1 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(1)),
+		/* 2 */ conditional(ShaderOpcodes::JMPC, X, true, false, 5),  // Jump to 5 if v0.x > 0.5
+		/* 3 */ arithmetic(ShaderOpcodes::MOV, output(0), input(0)),
+		/* 4 */ end(),
+		/* 5 */ arithmetic(ShaderOpcodes::ADD, output(0), input(0), input(0)),
+		/* 6 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(2)),
+		/* 7 */ end(),
+	});
+	setDivergenceUniforms(*shader);
+
+	requireBatchMatchesInterpreter(*shader, divergentLanes);
+
+	// Every lane jumps, which stays on the SIMD path
+	const std::array<std::array<float, 2>, 3> uniformLanes = {{{1.0f, 0.0f}, {2.0f, 1.0f}, {3.0f, 2.0f}}};
+	requireBatchMatchesInterpreter(*shader, uniformLanes);
+}
+
+TEST_CASE("Batch JMPU and END with masked lanes", "[shader][vertex][batch]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ cmp(Less, Less, uniform(0), input(0)),
+		/* 1 */ arithmetic(ShaderOpcodes::MOV, output(0), input(0)),
+		/* 2 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(1)),
+		/* 3 */ conditional(ShaderOpcodes::IFC, X, true, false, 7, 0),  // if (v0.x > 0.5) [4, 7)
+		/* 4 */ uniformConditional(ShaderOpcodes::JMPU, 0, 9),           // Jump to 9 if b0
+		/* 5 */ arithmetic(ShaderOpcodes::MOV, output(1), uniform(2)),
+		/* 6 */ end(),
+		/* 7 */ arithmetic(ShaderOpcodes::ADD, output(0), input(0), input(0)),
+		/* 8 */ end(),
+		/* 9 */ arithmetic(ShaderOpcodes::MUL, output(0), input(0), input(0)),
+		/* 10 */ end(),
+	});
+	setDivergenceUniforms(*shader);
+
+	// b0 set: The lanes in the if block jump out of it while the others are masked off
+	shader->boolUniform = 1;
+	requireBatchMatchesInterpreter(*shader, divergentLanes);
+
+	// b0 clear: The lanes in the if block reach an END while the others are masked off
+	shader->boolUniform = 0;
+	requireBatchMatchesInterpreter(*shader, divergentLanes);
+}
+
+// LOOP runs its body i.x + 1 times, with aL starting at i.y and going up by i.z after every iteration
+TEST_CASE("LOOP iteration count", "[shader][vertex][batch]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ arithmetic(ShaderOpcodes::MOV, temp(0), input(0)),
+		/* 1 */ loop(0, 3),
+		/* 2 */ loop(1, 3),  // Nested loop that ends on the same instruction
+		/* 3 */ arithmetic(ShaderOpcodes::ADD, temp(0), uniform(1), temp(0), 3),  // r0 += c[1 + aL]
+		/* 4 */ arithmetic(ShaderOpcodes::MOV, output(0), temp(0)),
+		/* 5 */ end(),
+	});
+
+	// c[i] = (i, 1, 0, 0), so r0.x sums up the uniforms read and r0.y counts the iterations
+	for (u32 i = 0; i < 96; i++) {
+		setFloatUniform(*shader, i, {float(i), 1.0f, 0.0f, 0.0f});
+	}
+
+	const auto requireResult = [&](float sum, float iterations) {
+		shader->inputs[0] = {f24::zero(), f24::zero(), f24::zero(), f24::zero()};
+		shader->run();
+		REQUIRE(shader->outputs[0][0].toFloat32() == sum);
+		REQUIRE(shader->outputs[0][1].toFloat32() == iterations);
+
+		const auto batch = std::make_unique<PICAShaderBatch>(*shader);
+		for (u32 lane = 0; lane < PICAShaderBatch::laneCount; lane++) {
+			batch->setInput(lane, 0, shader->inputs[0]);
+		}
+		batch->run(PICAShaderBatch::laneCount);
+
+		for (u32 lane = 0; lane < PICAShaderBatch::laneCount; lane++) {
+			INFO("lane " << lane);
+			REQUIRE(batch->getOutput(lane, 0)[0].toFloat32() == sum);
+			REQUIRE(batch->getOutput(lane, 0)[1].toFloat32() == iterations);
+		}
+	};
+
+	// Outer loop runs once. Inner loop runs 4 times with aL = 2, 5, 8, 11, reading c3, c6, c9 and c12
+	shader->intUniforms[0] = {0, 0, 0, 0};
+	shader->intUniforms[1] = {3, 2, 3, 0};
+	requireResult(30.0f, 4.0f);
+
+	// Outer loop runs twice, and the inner one 3 times on each of them with aL = 0, 1, 2, reading c1, c2 and c3
+	shader->intUniforms[0] = {1, 0, 0, 0};
+	shader->intUniforms[1] = {2, 0, 1, 0};
+	requireResult(12.0f, 6.0f);
+}
+
+#if defined(PANDA3DS_SHADER_JIT_SUPPORTED)
+// Compiles the shader unit's current program, uniforms included, and checks the JIT's output registers 0 and 1 against the interpreter
+static void requireJITMatchesInterpreter(ShaderJIT& shaderJit, PICAShader& shader) {
+	const auto reference = std::make_unique<PICAShader>(shader);
+	reference->run();
+
+	REQUIRE(shaderJit.prepare(shader));
+	shaderJit.run(shader);
+
+	for (u32 reg = 0; reg < 2; reg++) {
+		INFO("output " << reg);
+		REQUIRE(shader.outputs[reg] == reference->outputs[reg]);
+	}
+}
+
+TEST_CASE("JIT uniform specialization", "[shader][vertex][shader_jit]") {
+	using namespace RawShader;
+	const auto shader = assembleRawShader({
+		/* 0 */ arithmetic(ShaderOpcodes::MOV, temp(0), uniform(1)),
+		/* 1 */ arithmetic(ShaderOpcodes::MOV, temp(1), uniform(0)),
+		/* 2 */ uniformConditional(ShaderOpcodes::IFU, 0, 4, 1),  // if (b0) [3, 4) else [4, 5)
+		/* 3 */ arithmetic(ShaderOpcodes::ADD, temp(0), uniform(2), temp(0)),
+		/* 4 */ arithmetic(ShaderOpcodes::MUL, temp(0), temp(0), temp(0)),
+		/* 5 */ uniformConditional(ShaderOpcodes::IFU, 1, 7, 1),  // if (b1) [6, 7) else [7, 8)
+		/* 6 */ arithmetic(ShaderOpcodes::MUL, temp(0), temp(0), temp(0)),
+		/* 7 */ arithmetic(ShaderOpcodes::ADD, temp(0), uniform(3), temp(0)),
+		/* 8 */ uniformConditional(ShaderOpcodes::CALLU, 2, 20, 1),  // Call [20, 21) if b2
+		/* 9 */ uniformConditional(ShaderOpcodes::JMPU, 3, 11),      // Skip 10 if b3
+		/* 10 */ arithmetic(ShaderOpcodes::MUL, temp(0), temp(0), temp(0)),
+		/* 11 */ loop(0, 12),  // Loop over 12, with i0 = (iterations - 1, counter start, counter step)
+		/* 12 */ arithmetic(ShaderOpcodes::ADD, temp(1), uniform(4), temp(1), 3),  // r1 += c[4 + aL]
+		/* 13 */ arithmetic(ShaderOpcodes::MOV, output(0), temp(0)),
+		/* 14 */ arithmetic(ShaderOpcodes::MOV, output(1), temp(1)),
+		/* 15 */ end(),
+		/* 16 */ nop(),
+		/* 17 */ nop(),
+		/* 18 */ nop(),
+		/* 19 */ nop(),
+		/* 20 */ arithmetic(ShaderOpcodes::ADD, temp(0), uniform(5), temp(0)),
+	});
+
+	for (u32 i = 0; i < 24; i++) {
+		const float value = float(i);
+		setFloatUniform(*shader, i, {value, -value, value * 0.5f, 1.0f});
+	}
+
+	ShaderJIT shaderJit;
+	shaderJit.setUniformSpecialization(true);
+
+	// b0 and b2 set, b1 and b3 clear, loop 4 times with aL = 4, 6, 8, 10
+	const u32 firstBools = 0b0101;
+	shader->boolUniform = firstBools;
+	shader->intUniforms[0] = {3, 4, 2, 0};
+	requireJITMatchesInterpreter(shaderJit, *shader);
+	// r1 = c0 + c8 + c10 + c12 + c14
+	REQUIRE(shader->outputs[1][0].toFloat32() == 44.0f);
+	const auto firstOutput = shader->outputs[0];
+
+	// The opposite way through every branch. Reusing the shader compiled for the first set of uniforms would give the first result
+	const u32 secondBools = 0b1010;
+	shader->boolUniform = secondBools;
+	requireJITMatchesInterpreter(shaderJit, *shader);
+	REQUIRE(shader->outputs[0] != firstOutput);
+
+	// A different iteration count for the loop
+	shader->intUniforms[0] = {1, 4, 2, 0};
+	requireJITMatchesInterpreter(shaderJit, *shader);
+	REQUIRE(shader->outputs[1][0].toFloat32() == 18.0f);
+
+	// Back to the first uniforms, which should hit the cache. Bool uniforms that the program doesn't use aren't part of the key
+	shader->boolUniform = firstBools | 0xff00;
+	shader->intUniforms[0] = {3, 4, 2, 0};
+	requireJITMatchesInterpreter(shaderJit, *shader);
+	REQUIRE(shader->outputs[0] == firstOutput);
+
+	shaderJit.endFrame();
+	const auto& stats = shaderJit.getFrameStats();
+	REQUIRE(stats.cacheMisses == 3);
+	REQUIRE(stats.cacheHits == 1);
+}
+#endif
@@ -0,0 +1,189 @@
+#include <PICA/texture_decoder.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+#include <span>
+#include <vector>
+
+using PICA::TextureFmt;
+
+// The tile decoder used for whole textures must give the same texels as decoding them one by one
+TEST_CASE("Tile decoder matches per-texel decoding", "[texture]") {
+	std::mt19937 rng(0x3d5);
+
+	for (u32 format = u32(TextureFmt::RGBA8); format <= u32(TextureFmt::ETC1A4); format++) {
+		const auto textureFormat = static_cast<TextureFmt>(format);
+
+		for (const u32 size : {8u, 16u}) {
+			std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(textureFormat, size, size));
+			for (u8& byte : data) {
+				byte = u8(rng());
+			}
+
+			std::vector<u32> decoded;
+			PICA::TextureDecoder::decodeTexture(textureFormat, size, size, data, decoded);
+			REQUIRE(decoded.size() == size * size);
+
+			for (u32 v = 0; v < size; v++) {
+				for (u32 u = 0; u < size; u++) {
+					INFO("format " << format << ", " << size << "x" << size << ", texel (" << u << ", " << v << ")");
+					REQUIRE(decoded[v * size + u] == PICA::TextureDecoder::decodeTexel(textureFormat, u, v, size, data));
+				}
+			}
+		}
+	}
+}
+
+// Decodes the whole texture and checks texel (u, v) against a known value, through both the tile decoder and decodeTexel
+static void requireTexel(TextureFmt format, u32 width, u32 height, std::span<const u8> data, u32 u, u32 v, u32 expected) {
+	std::vector<u32> decoded;
+	PICA::TextureDecoder::decodeTexture(format, width, height, data, decoded);
+
+	INFO("texel (" << u << ", " << v << ")");
+	REQUIRE(decoded[v * width + u] == expected);
+	REQUIRE(PICA::TextureDecoder::decodeTexel(format, u, v, width, data) == expected);
+}
+
+static void write16(std::vector<u8>& data, u32 index, u16 value) {
+	data[index * 2] = u8(value);
+	data[index * 2 + 1] = u8(value >> 8);
+}
+
+static void write64(std::vector<u8>& data, u32 offset, u64 value) {
+	for (u32 i = 0; i < 8; i++) {
+		data[offset + i] = u8(value >> (i * 8));
+	}
+}
+
+// Texels 0-3 of a tile are (0, 0), (1, 0), (0, 1) and (1, 1). Outputs are ABGR8888
+TEST_CASE("16-bit texel conversion", "[texture]") {
+	std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(TextureFmt::RGBA5551, 8, 8));
+
+	// RGBA5551: rrrrrgggggbbbbba
+	write16(data, 0, 0xF801);  // r = 31, a = 1
+	write16(data, 1, 0x07C0);  // g = 31, a = 0
+	write16(data, 2, 0x003E);  // b = 31, a = 0
+	write16(data, 3, 0x8045);  // r = 16, g = 1, b = 2, a = 1
+	requireTexel(TextureFmt::RGBA5551, 8, 8, data, 0, 0, 0xFF0000FF);
+	requireTexel(TextureFmt::RGBA5551, 8, 8, data, 1, 0, 0x0000FF00);
+	requireTexel(TextureFmt::RGBA5551, 8, 8, data, 0, 1, 0x00FF0000);
+	requireTexel(TextureFmt::RGBA5551, 8, 8, data, 1, 1, 0xFF100884);
+
+	// RGB565: rrrrrggggggbbbbb
+	write16(data, 0, 0xF800);  // r = 31
+	write16(data, 1, 0x07E0);  // g = 63
+	write16(data, 2, 0x001F);  // b = 31
+	write16(data, 3, 0x8421);  // r = 16, g = 33, b = 1
+	requireTexel(TextureFmt::RGB565, 8, 8, data, 0, 0, 0xFF0000FF);
+	requireTexel(TextureFmt::RGB565, 8, 8, data, 1, 0, 0xFF00FF00);
+	requireTexel(TextureFmt::RGB565, 8, 8, data, 0, 1, 0xFFFF0000);
+	requireTexel(TextureFmt::RGB565, 8, 8, data, 1, 1, 0xFF088684);
+
+	// RGBA4: rrrrggggbbbbaaaa
+	write16(data, 0, 0x1234);
+	write16(data, 1, 0xF00F);
+	write16(data, 2, 0x0A50);
+	write16(data, 3, 0x000C);
+	requireTexel(TextureFmt::RGBA4, 8, 8, data, 0, 0, 0x44332211);
+	requireTexel(TextureFmt::RGBA4, 8, 8, data, 1, 0, 0xFF0000FF);
+	requireTexel(TextureFmt::RGBA4, 8, 8, data, 0, 1, 0x0055AA00);
+	requireTexel(TextureFmt::RGBA4, 8, 8, data, 1, 1, 0xCC000000);
+}
+
+// 4-bit formats store the even texel of every byte in the low nibble
+TEST_CASE("4-bit texel nibble order", "[texture]") {
+	std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(TextureFmt::I4, 8, 8));
+	data[0] = 0x7A;
+	data[1] = 0x30;
+
+	requireTexel(TextureFmt::I4, 8, 8, data, 0, 0, 0xFFAAAAAA);
+	requireTexel(TextureFmt::I4, 8, 8, data, 1, 0, 0xFF777777);
+	requireTexel(TextureFmt::I4, 8, 8, data, 0, 1, 0xFF000000);
+	requireTexel(TextureFmt::I4, 8, 8, data, 1, 1, 0xFF333333);
+
+	requireTexel(TextureFmt::A4, 8, 8, data, 0, 0, 0xAA000000);
+	requireTexel(TextureFmt::A4, 8, 8, data, 1, 0, 0x77000000);
+	requireTexel(TextureFmt::A4, 8, 8, data, 0, 1, 0x00000000);
+	requireTexel(TextureFmt::A4, 8, 8, data, 1, 1, 0x33000000);
+}
+
+// Every byte of an I8 texture holds its own offset, so the intensity of a texel is where it's stored
+TEST_CASE("Morton order in textures with several tiles", "[texture]") {
+	std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(TextureFmt::I8, 16, 8));
+	for (u32 i = 0; i < data.size(); i++) {
+		data[i] = u8(i);
+	}
+	const auto intensity = [](u32 value) { return 0xFF000000 | (value * 0x010101); };
+
+	// 2 tiles side by side
+	requireTexel(TextureFmt::I8, 16, 8, data, 0, 0, intensity(0));
+	requireTexel(TextureFmt::I8, 16, 8, data, 1, 0, intensity(1));
+	requireTexel(TextureFmt::I8, 16, 8, data, 0, 1, intensity(2));
+	requireTexel(TextureFmt::I8, 16, 8, data, 2, 0, intensity(4));
+	requireTexel(TextureFmt::I8, 16, 8, data, 0, 2, intensity(8));
+	requireTexel(TextureFmt::I8, 16, 8, data, 3, 5, intensity(39));
+	requireTexel(TextureFmt::I8, 16, 8, data, 7, 7, intensity(63));
+	requireTexel(TextureFmt::I8, 16, 8, data, 8, 0, intensity(64));
+	requireTexel(TextureFmt::I8, 16, 8, data, 9, 1, intensity(67));
+	requireTexel(TextureFmt::I8, 16, 8, data, 15, 7, intensity(127));
+
+	// 2 tiles on top of each other
+	requireTexel(TextureFmt::I8, 8, 16, data, 4, 0, intensity(16));
+	requireTexel(TextureFmt::I8, 8, 16, data, 3, 5, intensity(39));
+	requireTexel(TextureFmt::I8, 8, 16, data, 0, 8, intensity(64));
+	requireTexel(TextureFmt::I8, 8, 16, data, 1, 9, intensity(67));
+	requireTexel(TextureFmt::I8, 8, 16, data, 7, 15, intensity(127));
+}
+
+// ETC texel (u, v) of a block is number u * 4 + v in the subindex, negation and alpha bits
+TEST_CASE("ETC1 block decoding", "[texture]") {
+	std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(TextureFmt::ETC1, 8, 8));
+
+	// Differential mode, split into left and right halves. Colour 1 is RGB555 (16, 8, 4) = (132, 66, 33),
+	// colour 2 is (16 + 1, 8 - 1, 4 + 3) = (140, 57, 57). The left half uses modifiers {2, 8} and the right one {5, 17}
+	const u64 differential = (16ull << 59) | (1ull << 56) | (8ull << 51) | (7ull << 48) | (4ull << 43) | (3ull << 40) |  // Colours
+							 (0ull << 37) | (1ull << 34) |                                                          // Modifier tables
+							 (1ull << 33) |                                                                         // Differential, not flipped
+							 (0x8402ull << 16) |  // Negate texels 1, 10 and 15
+							 0x0420ull;           // Use the big modifier for texels 5 and 10
+
+	// Individual mode, split into top and bottom halves. Colour 1 is RGB444 (15, 0, 8) = (255, 0, 136),
+	// colour 2 is (1, 2, 3) = (17, 34, 51). The top half uses modifiers {47, 183} and the bottom one {9, 29}
+	const u64 individual = (0xFull << 60) | (0x0ull << 52) | (0x8ull << 44) | (0x1ull << 56) | (0x2ull << 48) | (0x3ull << 40) |  // Colours
+						   (7ull << 37) | (2ull << 34) |  // Modifier tables
+						   (1ull << 32) |                 // Individual, flipped
+						   (0x0220ull << 16) |            // Negate texels 5 and 9
+						   0x8020ull;                     // Use the big modifier for texels 5 and 15
+
+	// Blocks go left to right, then top to bottom. Blocks 0 and 3 stay zeroed, ie black with a +2 modifier
+	write64(data, 8, differential);
+	write64(data, 16, individual);
+
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 0, 0, 0xFF020202);
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 7, 7, 0xFF020202);
+
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 0, 0, 0xFF234486);  // Colour 1 + 2
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 0, 1, 0xFF1F4082);  // Colour 1 - 2
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 1, 1, 0xFF294A8C);  // Colour 1 + 8
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 2, 0, 0xFF3E3E91);  // Colour 2 + 5
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 2, 2, 0xFF28287B);  // Colour 2 - 17
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 4 + 3, 3, 0xFF343487);  // Colour 2 - 5
+
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 0, 4 + 0, 0xFFB72FFF);  // Colour 1 + 47, red clamped
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 1, 4 + 1, 0xFF000048);  // Colour 1 - 183, green and blue clamped
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 2, 4 + 1, 0xFF5900D0);  // Colour 1 - 47, green clamped
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 0, 4 + 2, 0xFF3C2B1A);  // Colour 2 + 9
+	requireTexel(TextureFmt::ETC1, 8, 8, data, 3, 4 + 3, 0xFF503F2E);  // Colour 2 + 29
+}
+
+TEST_CASE("ETC1A4 block alpha", "[texture]") {
+	std::vector<u8> data(PICA::TextureDecoder::sizeInBytes(TextureFmt::ETC1A4, 8, 8));
+	// Every block is 8 bytes of alpha followed by 8 bytes of colour. Texel n of block 0 has an alpha of n
+	write64(data, 0, 0xFEDCBA9876543210);
+
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 0, 0, 0x00020202);
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 0, 1, 0x11020202);
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 1, 0, 0x44020202);
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 2, 1, 0x99020202);
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 3, 3, 0xFF020202);
+	requireTexel(TextureFmt::ETC1A4, 8, 8, data, 4, 0, 0x00020202);
+}